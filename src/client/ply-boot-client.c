@@ -28,14 +28,40 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "ply-array.h"
+#include "ply-buffer.h"
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-utils.h"
 
+/* Both ends of the socket block, so the daemon can end up stuck writing
+ * replies the client isn't reading while the client is stuck writing
+ * requests the daemon isn't reading.  Writing only this much at a time
+ * gets the client back to the event loop to read replies in between.
+ */
+#ifndef PLY_BOOT_CLIENT_MAX_WRITE_SIZE
+#define PLY_BOOT_CLIENT_MAX_WRITE_SIZE 4096
+#endif
+
+typedef struct
+{
+        ply_boot_client_t                 *client;
+        char                              *command;
+        char                              *argument;
+        ply_boot_client_response_handler_t handler;
+        ply_boot_client_response_handler_t failed_handler;
+        void                              *user_data;
+
+        /* Set for batches, which carry other requests */
+        ply_list_t                        *batched_requests;
+} ply_boot_client_request_t;
+
 struct _ply_boot_client
 {
         ply_event_loop_t                    *loop;
@@ -48,21 +74,26 @@ struct _ply_boot_client
         ply_boot_client_disconnect_handler_t disconnect_handler;
         void                                *disconnect_handler_user_data;
 
+        /* The batch being put together between begin_batch and
+         * end_batch
+         */
+        ply_boot_client_request_t           *batch;
+
+        /* 0 until the daemon has said which protocol it speaks */
+        int                                  protocol_version;
+
         uint32_t                             is_connected : 1;
+        uint32_t                             is_negotiating_protocol_version : 1;
+        /* Set while requests can't go out until the daemon replies to
+         * one that changes how they get sent
+         */
+        uint32_t                             is_holding_requests : 1;
+        uint32_t                             is_streaming : 1;
 };
 
-typedef struct
-{
-        ply_boot_client_t                 *client;
-        char                              *command;
-        char                              *argument;
-        ply_boot_client_response_handler_t handler;
-        ply_boot_client_response_handler_t failed_handler;
-        void                              *user_data;
-} ply_boot_client_request_t;
-
 static void ply_boot_client_cancel_request (ply_boot_client_t         *client,
                                             ply_boot_client_request_t *request);
+static void ply_boot_client_release_held_requests (ply_boot_client_t *client);
 
 ply_boot_client_t *
 ply_boot_client_new (void)
@@ -159,6 +190,11 @@ ply_boot_client_free (ply_boot_client_t *client)
 
         ply_boot_client_cancel_requests (client);
 
+        if (client->batch != NULL) {
+                ply_boot_client_cancel_request (client, client->batch);
+                client->batch = NULL;
+        }
+
         ply_list_free (client->requests_to_send);
         ply_list_free (client->requests_waiting_for_replies);
 
@@ -229,6 +265,17 @@ ply_boot_client_request_free (ply_boot_client_request_t *request)
 {
         if (request == NULL)
                 return;
+
+        if (request->batched_requests != NULL) {
+                ply_list_node_t *node;
+
+                while ((node = ply_list_get_first_node (request->batched_requests)) != NULL) {
+                        ply_boot_client_request_free (ply_list_node_get_data (node));
+                        ply_list_remove_node (request->batched_requests, node);
+                }
+                ply_list_free (request->batched_requests);
+        }
+
         free (request->command);
         if (request->argument != NULL)
                 free (request->argument);
@@ -239,6 +286,18 @@ static void
 ply_boot_client_cancel_request (ply_boot_client_t         *client,
                                 ply_boot_client_request_t *request)
 {
+        if (request->batched_requests != NULL) {
+                ply_list_node_t *node;
+
+                while ((node = ply_list_get_first_node (request->batched_requests)) != NULL) {
+                        ply_boot_client_request_t *batched_request;
+
+                        batched_request = ply_list_node_get_data (node);
+                        ply_list_remove_node (request->batched_requests, node);
+                        ply_boot_client_cancel_request (client, batched_request);
+                }
+        }
+
         if (request->failed_handler != NULL)
                 request->failed_handler (request->user_data, request->client);
 
@@ -246,11 +305,104 @@ ply_boot_client_cancel_request (ply_boot_client_t         *client,
 }
 
 static void
-ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
+ply_boot_client_discard_bytes (ply_boot_client_t *client,
+                               size_t             number_of_bytes)
+{
+        uint8_t bytes[256];
+
+        while (number_of_bytes > 0) {
+                size_t bytes_to_read;
+
+                bytes_to_read = MIN (number_of_bytes, sizeof(bytes));
+
+                if (!ply_read (client->socket_fd, bytes, bytes_to_read))
+                        return;
+
+                number_of_bytes -= bytes_to_read;
+        }
+}
+
+/* Version 2 daemons send an overall ACK or NAK and a count before the
+ * status of each command.  Version 1 daemons just reply to each command
+ * in turn.
+ */
+static bool
+ply_boot_client_process_batch_reply (ply_boot_client_t         *client,
+                                     ply_boot_client_request_t *batch)
+{
+        ply_list_node_t *node;
+        uint8_t *statuses;
+        uint32_t number_of_requests, i;
+        bool all_succeeded;
+
+        number_of_requests = ply_list_get_length (batch->batched_requests);
+        statuses = calloc (MAX (number_of_requests, 1), sizeof(uint8_t));
+
+        if (client->protocol_version >= 2) {
+                uint8_t aggregate_status;
+                uint32_t number_of_statuses;
+
+                if (!ply_read (client->socket_fd, &aggregate_status, sizeof(uint8_t)) ||
+                    !ply_read_uint32 (client->socket_fd, &number_of_statuses)) {
+                        free (statuses);
+                        return false;
+                }
+
+                /* The statuses still have to come off the socket, or they'd
+                 * get taken for the next reply
+                 */
+                if (number_of_statuses != number_of_requests) {
+                        ply_trace ("daemon sent %u statuses for a batch of %u requests",
+                                   number_of_statuses, number_of_requests);
+                        ply_boot_client_discard_bytes (client, number_of_statuses);
+                        free (statuses);
+                        return false;
+                }
+        }
+
+        if (number_of_requests > 0 &&
+            !ply_read (client->socket_fd, statuses, number_of_requests)) {
+                free (statuses);
+                return false;
+        }
+
+        all_succeeded = true;
+        i = 0;
+        while ((node = ply_list_get_first_node (batch->batched_requests)) != NULL) {
+                ply_boot_client_request_t *request;
+
+                request = ply_list_node_get_data (node);
+                ply_list_remove_node (batch->batched_requests, node);
+
+                if (memcmp (&statuses[i], PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK, sizeof(uint8_t)) == 0) {
+                        if (request->handler != NULL)
+                                request->handler (request->user_data, client);
+                } else {
+                        all_succeeded = false;
+                        if (request->failed_handler != NULL)
+                                request->failed_handler (request->user_data, client);
+                }
+
+                ply_boot_client_request_free (request);
+                i++;
+        }
+        free (statuses);
+
+        if (!all_succeeded)
+                return false;
+
+        if (batch->handler != NULL)
+                batch->handler (batch->user_data, client);
+
+        return true;
+}
+
+static void
+ply_boot_client_process_incoming_reply (ply_boot_client_t *client)
 {
         ply_list_node_t *request_node;
         ply_boot_client_request_t *request;
-        bool processed_reply;
+        bool processed_reply, is_stream_request;
         uint8_t byte[2] = "";
         uint32_t size;
 
@@ -268,6 +420,26 @@ ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
         request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
         assert (request != NULL);
 
+        is_stream_request = strcmp (request->command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STREAM) == 0;
+
+        if (request->batched_requests != NULL) {
+                processed_reply = ply_boot_client_process_batch_reply (client, request);
+
+                /* Anything left didn't get a reply */
+                if (!processed_reply) {
+                        ply_list_node_t *node;
+
+                        while ((node = ply_list_get_first_node (request->batched_requests)) != NULL) {
+                                ply_boot_client_request_t *batched_request;
+
+                                batched_request = ply_list_node_get_data (node);
+                                ply_list_remove_node (request->batched_requests, node);
+                                ply_boot_client_cancel_request (client, batched_request);
+                        }
+                }
+                goto out;
+        }
+
         if (!ply_read (client->socket_fd, byte, sizeof(uint8_t)))
                 goto out;
 
@@ -349,6 +521,12 @@ out:
                         request->failed_handler (request->user_data, client);
 
         ply_list_remove_node (client->requests_waiting_for_replies, request_node);
+        ply_boot_client_request_free (request);
+
+        if (is_stream_request) {
+                client->is_streaming = processed_reply;
+                ply_boot_client_release_held_requests (client);
+        }
 
         if (ply_list_get_length (client->requests_waiting_for_replies) == 0) {
                 if (client->daemon_has_reply_watch != NULL) {
@@ -360,6 +538,107 @@ out:
         }
 }
 
+static bool
+ply_boot_client_has_buffered_replies (ply_boot_client_t *client)
+{
+        int number_of_bytes = 0;
+
+        if (ioctl (client->socket_fd, FIONREAD, &number_of_bytes) < 0)
+                return false;
+
+        return number_of_bytes > 0;
+}
+
+static void
+ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
+{
+        /* Pipelined requests tend to get their replies all at once, so
+         * take care of all of them before going back to the event loop
+         */
+        do {
+                ply_boot_client_process_incoming_reply (client);
+        } while (client->socket_fd >= 0 &&
+                 ply_list_get_length (client->requests_waiting_for_replies) > 0 &&
+                 ply_boot_client_has_buffered_replies (client));
+}
+
+static void
+append_uint32 (ply_buffer_t *buffer,
+               uint32_t      value)
+{
+        uint8_t bytes[4];
+
+        bytes[0] = (value >> 0) & 0xFF;
+        bytes[1] = (value >> 8) & 0xFF;
+        bytes[2] = (value >> 16) & 0xFF;
+        bytes[3] = (value >> 24) & 0xFF;
+
+        ply_buffer_append_bytes (buffer, bytes, sizeof(bytes));
+}
+
+static char *
+ply_boot_client_get_batch_string (ply_boot_client_t         *client,
+                                  ply_boot_client_request_t *batch,
+                                  size_t                    *batch_size)
+{
+        ply_buffer_t *buffer;
+        ply_list_node_t *node;
+        char *batch_string;
+
+        buffer = ply_buffer_new ();
+
+        if (client->protocol_version >= 2) {
+                ply_buffer_append_bytes (buffer, PLY_BOOT_PROTOCOL_REQUEST_TYPE_BATCH,
+                                         strlen (PLY_BOOT_PROTOCOL_REQUEST_TYPE_BATCH));
+                append_uint32 (buffer, ply_list_get_length (batch->batched_requests));
+        }
+
+        node = ply_list_get_first_node (batch->batched_requests);
+        while (node != NULL) {
+                ply_boot_client_request_t *request;
+                size_t argument_size;
+                uint8_t argument_size_byte;
+
+                request = ply_list_node_get_data (node);
+
+                argument_size = 0;
+                if (request->argument != NULL)
+                        argument_size = strlen (request->argument) + 1;
+
+                ply_buffer_append_bytes (buffer, request->command, 1);
+
+                if (client->protocol_version >= 2) {
+                        append_uint32 (buffer, argument_size);
+                } else if (argument_size == 0) {
+                        ply_buffer_append_bytes (buffer, "", 1);
+                } else {
+                        /* Old daemons just get the requests one after the
+                         * other, and can't take long arguments
+                         */
+                        if (argument_size > UCHAR_MAX) {
+                                ply_trace ("truncating %zu byte argument for old daemon", argument_size);
+                                argument_size = UCHAR_MAX;
+                                request->argument[argument_size - 1] = '\0';
+                        }
+
+                        argument_size_byte = argument_size;
+                        ply_buffer_append_bytes (buffer, "\002", 1);
+                        ply_buffer_append_bytes (buffer, &argument_size_byte, 1);
+                }
+
+                if (argument_size > 0)
+                        ply_buffer_append_bytes (buffer, request->argument, argument_size);
+
+                node = ply_list_get_next_node (batch->batched_requests, node);
+        }
+
+        *batch_size = ply_buffer_get_size (buffer);
+        batch_string = ply_buffer_steal_bytes (buffer);
+        ply_buffer_free (buffer);
+
+        return batch_string;
+}
+
 static char *
 ply_boot_client_get_request_string (ply_boot_client_t         *client,
                                     ply_boot_client_request_t *request,
@@ -371,6 +650,9 @@ ply_boot_client_get_request_string (ply_boot_client_t         *client,
         assert (request != NULL);
         assert (request_size != NULL);
 
+        if (request->batched_requests != NULL)
+                return ply_boot_client_get_batch_string (client, request, request_size);
+
         assert (request->command != NULL);
 
         if (request->argument == NULL) {
@@ -389,27 +671,123 @@ ply_boot_client_get_request_string (ply_boot_client_t         *client,
         return request_string;
 }
 
+/* Once streaming, nothing comes back from the daemon, so requests are
+ * done as soon as they're sent
+ */
+static void
+ply_boot_client_complete_request (ply_boot_client_t         *client,
+                                  ply_boot_client_request_t *request)
+{
+        if (request->batched_requests != NULL) {
+                ply_list_node_t *node;
+
+                while ((node = ply_list_get_first_node (request->batched_requests)) != NULL) {
+                        ply_boot_client_request_t *batched_request;
+
+                        batched_request = ply_list_node_get_data (node);
+                        ply_list_remove_node (request->batched_requests, node);
+                        ply_boot_client_complete_request (client, batched_request);
+                }
+        }
+
+        if (request->handler != NULL)
+                request->handler (request->user_data, client);
+
+        ply_boot_client_request_free (request);
+}
+
+/* The given requests go out in one write, and the replies come back in
+ * the same order
+ */
 static bool
-ply_boot_client_send_request (ply_boot_client_t         *client,
-                              ply_boot_client_request_t *request)
+ply_boot_client_send_requests (ply_boot_client_t *client,
+                               ply_list_t        *requests)
 {
-        char *request_string;
-        size_t request_size;
+        ply_list_node_t *node;
+        struct iovec *iovecs;
+        char **request_strings;
+        int number_of_requests, i;
+        bool sent_requests;
 
         assert (client != NULL);
-        assert (request != NULL);
+        assert (requests != NULL);
+
+        /* Requests queued before the daemon agreed to stream may need
+         * an answer it can no longer send, so they fail here instead
+         */
+        if (client->is_streaming) {
+                node = ply_list_get_first_node (requests);
+                while (node != NULL) {
+                        ply_boot_client_request_t *request;
+                        ply_list_node_t *next_node;
+
+                        request = ply_list_node_get_data (node);
+                        next_node = ply_list_get_next_node (requests, node);
+
+                        if (request->batched_requests == NULL &&
+                            strchr (PLY_BOOT_PROTOCOL_UNBATCHABLE_REQUEST_TYPES, request->command[0]) != NULL) {
+                                ply_trace ("can't send request '%s' that needs a reply while streaming",
+                                           request->command);
+                                ply_list_remove_node (requests, node);
+                                ply_boot_client_cancel_request (client, request);
+                        }
 
-        request_string = ply_boot_client_get_request_string (client, request,
-                                                             &request_size);
-        if (!ply_write (client->socket_fd, request_string, request_size)) {
-                free (request_string);
-                ply_boot_client_cancel_request (client, request);
-                return false;
+                        node = next_node;
+                }
+
+                if (ply_list_get_length (requests) == 0)
+                        return true;
+        }
+
+        number_of_requests = ply_list_get_length (requests);
+        iovecs = calloc (number_of_requests, sizeof(struct iovec));
+        request_strings = calloc (number_of_requests, sizeof(char *));
+
+        i = 0;
+        node = ply_list_get_first_node (requests);
+        while (node != NULL) {
+                ply_boot_client_request_t *request;
+                size_t request_size;
+
+                request = ply_list_node_get_data (node);
+                request_strings[i] = ply_boot_client_get_request_string (client, request,
+                                                                         &request_size);
+                iovecs[i].iov_base = request_strings[i];
+                iovecs[i].iov_len = request_size;
+                i++;
+
+                node = ply_list_get_next_node (requests, node);
+        }
+
+        sent_requests = ply_write_iovecs (client->socket_fd, iovecs, number_of_requests);
+
+        for (i = 0; i < number_of_requests; i++) {
+                free (request_strings[i]);
+        }
+        free (request_strings);
+        free (iovecs);
+
+        while ((node = ply_list_get_first_node (requests)) != NULL) {
+                ply_boot_client_request_t *request;
+
+                request = ply_list_node_get_data (node);
+                ply_list_remove_node (requests, node);
+
+                if (!sent_requests)
+                        ply_boot_client_cancel_request (client, request);
+                else if (client->is_streaming)
+                        ply_boot_client_complete_request (client, request);
+                else
+                        ply_list_append_data (client->requests_waiting_for_replies, request);
         }
-        free (request_string);
+
+        if (!sent_requests)
+                return false;
+
+        if (ply_list_get_length (client->requests_waiting_for_replies) == 0)
+                return true;
 
         if (client->daemon_has_reply_watch == NULL) {
-                assert (ply_list_get_length (client->requests_waiting_for_replies) == 0);
                 client->daemon_has_reply_watch =
                         ply_event_loop_watch_fd (client->loop, client->socket_fd,
                                                  PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
@@ -420,37 +798,127 @@ ply_boot_client_send_request (ply_boot_client_t         *client,
         return true;
 }
 
+/* Roughly how many bytes the request takes up on the wire */
+static size_t
+ply_boot_client_get_request_size (ply_boot_client_request_t *request)
+{
+        ply_list_node_t *node;
+        size_t request_size;
+
+        if (request->batched_requests == NULL) {
+                if (request->argument == NULL)
+                        return 2;
+
+                return 3 + strlen (request->argument) + 1;
+        }
+
+        request_size = 5;
+        node = ply_list_get_first_node (request->batched_requests);
+        while (node != NULL) {
+                ply_boot_client_request_t *batched_request;
+
+                batched_request = ply_list_node_get_data (node);
+                request_size += ply_boot_client_get_request_size (batched_request) + 2;
+
+                node = ply_list_get_next_node (request->batched_requests, node);
+        }
+
+        return request_size;
+}
+
 static void
 ply_boot_client_process_pending_requests (ply_boot_client_t *client)
 {
         ply_list_node_t *request_node;
-        ply_boot_client_request_t *request;
+        ply_list_t *requests;
+        size_t write_size;
 
         assert (ply_list_get_length (client->requests_to_send) != 0);
         assert (client->daemon_can_take_request_watch != NULL);
 
-        request_node = ply_list_get_first_node (client->requests_to_send);
-        assert (request_node != NULL);
+        requests = ply_list_new ();
+        write_size = 0;
+        while ((request_node = ply_list_get_first_node (client->requests_to_send)) != NULL) {
+                ply_boot_client_request_t *request;
+                size_t request_size;
+
+                request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
+                assert (request != NULL);
+
+                /* The rest go out the next time the daemon can take them */
+                request_size = ply_boot_client_get_request_size (request);
+                if (write_size > 0 && write_size + request_size > PLY_BOOT_CLIENT_MAX_WRITE_SIZE)
+                        break;
+                write_size += request_size;
+
+                /* How a batch gets sent depends on what the daemon says about
+                 * the protocol version, so hold off until it does
+                 */
+                if (request->batched_requests != NULL && client->protocol_version == 0) {
+                        client->is_holding_requests = true;
+                        break;
+                }
 
-        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
-        assert (request != NULL);
+                ply_list_remove_node (client->requests_to_send, request_node);
+                ply_list_append_data (requests, request);
 
-        ply_list_remove_node (client->requests_to_send, request_node);
+                /* Likewise, whether anything after a stream request gets a
+                 * reply depends on whether the daemon agrees to stream
+                 */
+                if (strcmp (request->command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STREAM) == 0) {
+                        client->is_holding_requests = true;
+                        break;
+                }
+        }
 
-        if (ply_boot_client_send_request (client, request))
-                ply_list_append_data (client->requests_waiting_for_replies, request);
+        if (client->is_holding_requests) {
+                ply_event_loop_stop_watching_fd (client->loop,
+                                                 client->daemon_can_take_request_watch);
+                client->daemon_can_take_request_watch = NULL;
+        }
 
-        if (ply_list_get_length (client->requests_to_send) == 0) {
-                if (client->daemon_has_reply_watch != NULL) {
-                        assert (client->loop != NULL);
+        if (ply_list_get_length (requests) > 0)
+                ply_boot_client_send_requests (client, requests);
+        ply_list_free (requests);
 
-                        ply_event_loop_stop_watching_fd (client->loop,
-                                                         client->daemon_can_take_request_watch);
-                        client->daemon_can_take_request_watch = NULL;
-                }
+        if (ply_list_get_length (client->requests_to_send) == 0 &&
+            client->daemon_can_take_request_watch != NULL) {
+                assert (client->loop != NULL);
+
+                ply_event_loop_stop_watching_fd (client->loop,
+                                                 client->daemon_can_take_request_watch);
+                client->daemon_can_take_request_watch = NULL;
         }
 }
 
+static void
+ply_boot_client_watch_for_daemon_can_take_request (ply_boot_client_t *client)
+{
+        if (client->daemon_can_take_request_watch != NULL ||
+            client->is_holding_requests ||
+            client->socket_fd < 0)
+                return;
+
+        client->daemon_can_take_request_watch =
+                ply_event_loop_watch_fd (client->loop, client->socket_fd,
+                                         PLY_EVENT_LOOP_FD_STATUS_CAN_TAKE_DATA,
+                                         (ply_event_handler_t)
+                                         ply_boot_client_process_pending_requests,
+                                         NULL, client);
+}
+
+static void
+ply_boot_client_release_held_requests (ply_boot_client_t *client)
+{
+        if (!client->is_holding_requests)
+                return;
+
+        client->is_holding_requests = false;
+
+        if (ply_list_get_length (client->requests_to_send) > 0)
+                ply_boot_client_watch_for_daemon_can_take_request (client);
+}
+
 static void
 ply_boot_client_queue_request (ply_boot_client_t                 *client,
                                const char                        *request_command,
@@ -462,32 +930,135 @@ ply_boot_client_queue_request (ply_boot_client_t                 *client,
         assert (client != NULL);
         assert (client->loop != NULL);
         assert (request_command != NULL);
-        assert (request_argument == NULL || strlen (request_argument) <= UCHAR_MAX);
 
-        if (client->daemon_can_take_request_watch == NULL &&
-            client->socket_fd >= 0) {
-                assert (ply_list_get_length (client->requests_to_send) == 0);
-                client->daemon_can_take_request_watch =
-                        ply_event_loop_watch_fd (client->loop, client->socket_fd,
-                                                 PLY_EVENT_LOOP_FD_STATUS_CAN_TAKE_DATA,
-                                                 (ply_event_handler_t)
-                                                 ply_boot_client_process_pending_requests,
-                                                 NULL, client);
+        if (client->batch != NULL) {
+                assert (strchr (PLY_BOOT_PROTOCOL_UNBATCHABLE_REQUEST_TYPES, request_command[0]) == NULL);
+        } else {
+                assert (request_argument == NULL || strlen (request_argument) <= UCHAR_MAX);
+                ply_boot_client_watch_for_daemon_can_take_request (client);
         }
 
         if (!client->is_connected) {
                 if (failed_handler != NULL)
                         failed_handler (user_data, client);
+        } else if (client->is_streaming &&
+                   strchr (PLY_BOOT_PROTOCOL_UNBATCHABLE_REQUEST_TYPES, request_command[0]) != NULL) {
+                ply_trace ("can't send request '%s' that needs a reply while streaming", request_command);
+                if (failed_handler != NULL)
+                        failed_handler (user_data, client);
         } else {
                 ply_boot_client_request_t *request;
 
                 request = ply_boot_client_request_new (client, request_command,
                                                        request_argument,
                                                        handler, failed_handler, user_data);
-                ply_list_append_data (client->requests_to_send, request);
+
+                if (client->batch != NULL)
+                        ply_list_append_data (client->batch->batched_requests, request);
+                else
+                        ply_list_append_data (client->requests_to_send, request);
         }
 }
 
+static void
+ply_boot_client_set_protocol_version (ply_boot_client_t *client,
+                                      int                protocol_version)
+{
+        ply_trace ("daemon speaks protocol version %d", protocol_version);
+
+        client->protocol_version = protocol_version;
+        client->is_negotiating_protocol_version = false;
+
+        ply_boot_client_release_held_requests (client);
+}
+
+static void
+on_protocol_version_answer (ply_boot_client_t *client,
+                            const char        *answer)
+{
+        int protocol_version;
+
+        protocol_version = 1;
+        if (answer != NULL)
+                protocol_version = MAX (atoi (answer), 1);
+
+        ply_boot_client_set_protocol_version (client,
+                                              MIN (protocol_version, PLY_BOOT_PROTOCOL_VERSION));
+}
+
+static void
+on_protocol_version_failed (ply_boot_client_t *client)
+{
+        ply_boot_client_set_protocol_version (client, 1);
+}
+
+/* Requests made between ply_boot_client_begin_batch () and
+ * ply_boot_client_end_batch () get sent to the daemon all at once,
+ * and replied to all at once.  Each one still gets its own handler or
+ * failed handler called.  Only requests that get a plain ACK or NAK
+ * back can be batched, so no passwords, questions, keystrokes,
+ * statistics, deactivating or quitting.
+ */
+void
+ply_boot_client_begin_batch (ply_boot_client_t *client)
+{
+        assert (client != NULL);
+        assert (client->batch == NULL);
+
+        client->batch = ply_boot_client_request_new (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_BATCH,
+                                                     NULL, NULL, NULL, NULL);
+        client->batch->batched_requests = ply_list_new ();
+}
+
+/* handler gets called if every request in the batch succeeded, and
+ * failed_handler otherwise
+ */
+void
+ply_boot_client_end_batch (ply_boot_client_t                 *client,
+                           ply_boot_client_response_handler_t handler,
+                           ply_boot_client_response_handler_t failed_handler,
+                           void                              *user_data)
+{
+        ply_boot_client_request_t *batch;
+
+        assert (client != NULL);
+        assert (client->batch != NULL);
+
+        batch = client->batch;
+        client->batch = NULL;
+
+        batch->handler = handler;
+        batch->failed_handler = failed_handler;
+        batch->user_data = user_data;
+
+        if (!client->is_connected) {
+                ply_boot_client_cancel_request (client, batch);
+                return;
+        }
+
+        if (ply_list_get_length (batch->batched_requests) == 0) {
+                if (handler != NULL)
+                        handler (user_data, client);
+                ply_boot_client_request_free (batch);
+                return;
+        }
+
+        if (client->protocol_version == 0 && !client->is_negotiating_protocol_version) {
+                client->is_negotiating_protocol_version = true;
+                ply_boot_client_queue_request (client,
+                                               PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROTOCOL_VERSION,
+                                               NULL,
+                                               (ply_boot_client_response_handler_t)
+                                               on_protocol_version_answer,
+                                               (ply_boot_client_response_handler_t)
+                                               on_protocol_version_failed,
+                                               client);
+        }
+
+        ply_boot_client_watch_for_daemon_can_take_request (client);
+        ply_list_append_data (client->requests_to_send, batch);
+}
+
 void
 ply_boot_client_ping_daemon (ply_boot_client_t                 *client,
                              ply_boot_client_response_handler_t handler,
@@ -758,6 +1329,19 @@ ply_boot_client_ask_daemon_has_active_vt (ply_boot_client_t                 *cli
                                        NULL, handler, failed_handler, user_data);
 }
 
+void
+ply_boot_client_ask_daemon_for_statistics (ply_boot_client_t                 *client,
+                                           ply_boot_client_answer_handler_t   handler,
+                                           ply_boot_client_response_handler_t failed_handler,
+                                           void                              *user_data)
+{
+        assert (client != NULL);
+
+        ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STATISTICS,
+                                       NULL, (ply_boot_client_response_handler_t)
+                                       handler, failed_handler, user_data);
+}
+
 void
 ply_boot_client_tell_daemon_about_error (ply_boot_client_t                 *client,
                                          ply_boot_client_response_handler_t handler,
@@ -768,6 +1352,26 @@ ply_boot_client_tell_daemon_about_error (ply_boot_client_t                 *clie
                                        NULL, handler, failed_handler, user_data);
 }
 
+/* Asks the daemon to stop replying to requests on this connection,
+ * for agents that send a lot of updates and don't care whether each
+ * one worked.  Once handler is called, handlers for later requests get
+ * called as soon as the requests are sent.  Requests that need an
+ * answer fail straight away.  If the daemon is too old to stream,
+ * failed_handler gets called and requests carry on getting replies.
+ */
+void
+ply_boot_client_start_streaming (ply_boot_client_t                 *client,
+                                 ply_boot_client_response_handler_t handler,
+                                 ply_boot_client_response_handler_t failed_handler,
+                                 void                              *user_data)
+{
+        assert (client != NULL);
+        assert (client->batch == NULL);
+
+        ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STREAM,
+                                       NULL, handler, failed_handler, user_data);
+}
+
 void
 ply_boot_client_flush (ply_boot_client_t *client)
 {
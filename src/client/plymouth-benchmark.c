@@ -0,0 +1,680 @@
+/* plymouth-benchmark.c - puts the boot daemon under load and measures it
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Acts like a lot of services starting at once: opens a number of
+ * connections to plymouthd and sends a mix of requests down them,
+ * either as fast as the daemon will take them or at a given rate, then
+ * reports how long replies took and how much CPU time the daemon used.
+ *
+ * It doesn't need a display, so in CI plymouthd can be run with
+ * something like
+ *
+ *   plymouthd --no-daemon --pid-file=/tmp/plymouthd.pid \
+ *             --kernel-command-line="plymouth.ignore-udev"
+ *   plymouth-benchmark --pid-file=/tmp/plymouthd.pid --connections=16 \
+ *                      --mix=update=8,ping=1,message=1,system-update=1,keystroke=1
+ *
+ * "keystroke" requests ask the daemon to ignore a keystroke, since
+ * asking it to watch for one doesn't get a reply until a key is
+ * pressed.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ply-boot-client.h"
+#include "ply-command-parser.h"
+#include "ply-event-loop.h"
+#include "ply-logger.h"
+#include "ply-utils.h"
+
+#define DEFAULT_NUMBER_OF_CONNECTIONS 1
+#define DEFAULT_NUMBER_OF_REQUESTS 10000
+#define DEFAULT_NUMBER_OF_REQUESTS_IN_FLIGHT 64
+#define DEFAULT_MIX "ping"
+
+/* Paced requests go out in bursts no closer together than this */
+#define MINIMUM_SEND_INTERVAL 0.001
+
+typedef enum
+{
+        REQUEST_TYPE_PING = 0,
+        REQUEST_TYPE_UPDATE,
+        REQUEST_TYPE_SHOW_MESSAGE,
+        REQUEST_TYPE_SYSTEM_UPDATE,
+        REQUEST_TYPE_KEYSTROKE,
+        NUMBER_OF_REQUEST_TYPES
+} request_type_t;
+
+static const char *request_type_names[NUMBER_OF_REQUEST_TYPES] =
+{
+        [REQUEST_TYPE_PING]          = "ping",
+        [REQUEST_TYPE_UPDATE]        = "update",
+        [REQUEST_TYPE_SHOW_MESSAGE]  = "message",
+        [REQUEST_TYPE_SYSTEM_UPDATE] = "system-update",
+        [REQUEST_TYPE_KEYSTROKE]     = "keystroke",
+};
+
+typedef struct _state state_t;
+
+typedef struct
+{
+        state_t           *state;
+        ply_boot_client_t *client;
+        int                number_of_requests_in_flight;
+        uint32_t           is_showing_message : 1;
+} connection_t;
+
+typedef struct
+{
+        connection_t *connection;
+        double        send_time;
+} request_t;
+
+struct _state
+{
+        ply_event_loop_t     *loop;
+        ply_command_parser_t *command_parser;
+
+        connection_t         *connections;
+        int                   number_of_connections;
+        int                   next_connection;
+
+        int                   mix[NUMBER_OF_REQUEST_TYPES];
+        int                   total_mix_weight;
+
+        int                   number_of_requests;
+        int                   number_of_requests_in_flight;
+        int                   number_of_requests_sent;
+        int                   number_of_replies;
+        int                   number_of_failures;
+        double                requests_per_second;
+
+        double               *latencies;
+        double                start_time;
+
+        uint32_t              is_sending_requests : 1;
+        uint32_t              send_is_scheduled : 1;
+        uint32_t              is_finished : 1;
+};
+
+static void send_requests (state_t *state);
+
+static bool
+parse_mix (state_t    *state,
+           const char *mix_string)
+{
+        char *mix, *entry, *save_pointer;
+
+        memset (state->mix, 0, sizeof(state->mix));
+        state->total_mix_weight = 0;
+
+        mix = strdup (mix_string);
+        for (entry = strtok_r (mix, ",", &save_pointer);
+             entry != NULL;
+             entry = strtok_r (NULL, ",", &save_pointer)) {
+                char *weight_string;
+                int i, weight;
+
+                weight = 1;
+                weight_string = strchr (entry, '=');
+                if (weight_string != NULL) {
+                        *weight_string = '\0';
+                        weight = atoi (weight_string + 1);
+                }
+
+                for (i = 0; i < NUMBER_OF_REQUEST_TYPES; i++) {
+                        if (strcmp (entry, request_type_names[i]) == 0)
+                                break;
+                }
+
+                if (i == NUMBER_OF_REQUEST_TYPES || weight < 0) {
+                        ply_error ("plymouth-benchmark: don't know how to send '%s'", entry);
+                        free (mix);
+                        return false;
+                }
+
+                state->mix[i] += weight;
+                state->total_mix_weight += weight;
+        }
+        free (mix);
+
+        return state->total_mix_weight > 0;
+}
+
+/* Spreads the request types out evenly in proportion to their weights,
+ * so runs are repeatable
+ */
+static request_type_t
+get_request_type (state_t *state,
+                  int      request_number)
+{
+        int i, position;
+
+        position = request_number % state->total_mix_weight;
+
+        for (i = 0; i < NUMBER_OF_REQUEST_TYPES; i++) {
+                if (position < state->mix[i])
+                        break;
+                position -= state->mix[i];
+        }
+
+        return i;
+}
+
+static connection_t *
+get_next_connection (state_t *state)
+{
+        int i;
+
+        for (i = 0; i < state->number_of_connections; i++) {
+                connection_t *connection;
+
+                connection = &state->connections[state->next_connection];
+                state->next_connection = (state->next_connection + 1) % state->number_of_connections;
+
+                if (connection->number_of_requests_in_flight < state->number_of_requests_in_flight)
+                        return connection;
+        }
+
+        return NULL;
+}
+
+/* Once the run is over, or the daemon has gone away, nothing more gets
+ * sent.  Requests still in flight then fail when their client is freed,
+ * and shouldn't queue new ones on a client that's no longer attached to
+ * the loop.
+ */
+static void
+finish (state_t *state,
+        int      exit_code)
+{
+        if (state->is_finished)
+                return;
+
+        state->is_finished = true;
+        ply_event_loop_exit (state->loop, exit_code);
+}
+
+/* Returns whether the run still needs more requests sent */
+static bool
+finish_request (request_t *request)
+{
+        connection_t *connection;
+        state_t *state;
+
+        connection = request->connection;
+        state = connection->state;
+
+        connection->number_of_requests_in_flight--;
+        free (request);
+
+        if (state->is_finished)
+                return false;
+
+        if (state->number_of_replies + state->number_of_failures == state->number_of_requests) {
+                finish (state, 0);
+                return false;
+        }
+
+        return true;
+}
+
+static void
+on_send_idle (state_t *state)
+{
+        state->send_is_scheduled = false;
+        send_requests (state);
+}
+
+static void
+on_reply (request_t         *request,
+          ply_boot_client_t *client)
+{
+        state_t *state;
+
+        state = request->connection->state;
+
+        if (!state->is_finished) {
+                state->latencies[state->number_of_replies] = ply_get_timestamp () - request->send_time;
+                state->number_of_replies++;
+        }
+
+        if (finish_request (request))
+                send_requests (state);
+}
+
+/* Failed requests don't say anything about how quickly the daemon
+ * answers, so they're counted but left out of the latencies.  They can
+ * fail while the client is cancelling everything on a connection that
+ * went away, so more get sent from an idle handler, by which time the
+ * disconnect has been seen.
+ */
+static void
+on_failure (request_t         *request,
+            ply_boot_client_t *client)
+{
+        state_t *state;
+
+        state = request->connection->state;
+
+        if (!state->is_finished)
+                state->number_of_failures++;
+
+        if (!finish_request (request) || state->send_is_scheduled)
+                return;
+
+        state->send_is_scheduled = true;
+        ply_event_loop_watch_for_idle (state->loop, PLY_EVENT_LOOP_IDLE_PRIORITY_DEFAULT,
+                                       (ply_event_loop_idle_handler_t) on_send_idle,
+                                       state);
+}
+
+static void
+on_disconnect (state_t *state)
+{
+        if (state->is_finished)
+                return;
+
+        ply_error ("plymouth-benchmark: daemon went away");
+        finish (state, 1);
+}
+
+static void
+send_request (connection_t  *connection,
+              request_type_t type)
+{
+        state_t *state;
+        request_t *request;
+        char *argument = NULL;
+
+        state = connection->state;
+
+        request = calloc (1, sizeof(request_t));
+        request->connection = connection;
+        request->send_time = ply_get_timestamp ();
+
+        connection->number_of_requests_in_flight++;
+        state->number_of_requests_sent++;
+
+        switch (type) {
+        case REQUEST_TYPE_PING:
+                ply_boot_client_ping_daemon (connection->client,
+                                             (ply_boot_client_response_handler_t)
+                                             on_reply,
+                                             (ply_boot_client_response_handler_t)
+                                             on_failure, request);
+                break;
+        case REQUEST_TYPE_UPDATE:
+                asprintf (&argument, "benchmark-%d", state->number_of_requests_sent);
+                ply_boot_client_update_daemon (connection->client, argument,
+                                               (ply_boot_client_response_handler_t)
+                                               on_reply,
+                                               (ply_boot_client_response_handler_t)
+                                               on_failure, request);
+                break;
+        case REQUEST_TYPE_SHOW_MESSAGE:
+                /* Take each message down again, so they don't pile up */
+                if (!connection->is_showing_message)
+                        ply_boot_client_tell_daemon_to_display_message (connection->client,
+                                                                        "benchmark message",
+                                                                        (ply_boot_client_response_handler_t)
+                                                                        on_reply,
+                                                                        (ply_boot_client_response_handler_t)
+                                                                        on_failure, request);
+                else
+                        ply_boot_client_tell_daemon_to_hide_message (connection->client,
+                                                                     "benchmark message",
+                                                                     (ply_boot_client_response_handler_t)
+                                                                     on_reply,
+                                                                     (ply_boot_client_response_handler_t)
+                                                                     on_failure, request);
+                connection->is_showing_message = !connection->is_showing_message;
+                break;
+        case REQUEST_TYPE_SYSTEM_UPDATE:
+                asprintf (&argument, "%d", state->number_of_requests_sent % 101);
+                ply_boot_client_system_update (connection->client, argument,
+                                               (ply_boot_client_response_handler_t)
+                                               on_reply,
+                                               (ply_boot_client_response_handler_t)
+                                               on_failure, request);
+                break;
+        case REQUEST_TYPE_KEYSTROKE:
+                ply_boot_client_ask_daemon_to_ignore_keystroke (connection->client, "b",
+                                                                (ply_boot_client_answer_handler_t)
+                                                                on_reply,
+                                                                (ply_boot_client_response_handler_t)
+                                                                on_failure, request);
+                break;
+        case NUMBER_OF_REQUEST_TYPES:
+        default:
+                break;
+        }
+
+        free (argument);
+}
+
+static void
+send_requests (state_t *state)
+{
+        int number_of_requests_due;
+
+        /* Requests on a dead connection fail straight away, which would
+         * otherwise end up back here
+         */
+        if (state->is_sending_requests || state->is_finished)
+                return;
+
+        number_of_requests_due = state->number_of_requests;
+
+        if (state->requests_per_second > 0) {
+                double elapsed_time;
+
+                elapsed_time = ply_get_timestamp () - state->start_time;
+                number_of_requests_due = MIN (number_of_requests_due,
+                                              (int) (elapsed_time * state->requests_per_second) + 1);
+        }
+
+        state->is_sending_requests = true;
+        while (state->number_of_requests_sent < number_of_requests_due) {
+                connection_t *connection;
+
+                connection = get_next_connection (state);
+
+                if (connection == NULL)
+                        break;
+
+                send_request (connection, get_request_type (state, state->number_of_requests_sent));
+        }
+        state->is_sending_requests = false;
+}
+
+static void
+on_send_timeout (state_t *state)
+{
+        send_requests (state);
+
+        if (!state->is_finished &&
+            state->number_of_requests_sent < state->number_of_requests)
+                ply_event_loop_watch_for_timeout (state->loop,
+                                                  MAX (1.0 / state->requests_per_second,
+                                                       MINIMUM_SEND_INTERVAL),
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  on_send_timeout, state);
+}
+
+static int
+compare_latencies (const void *a,
+                   const void *b)
+{
+        double latency_a = *(const double *) a;
+        double latency_b = *(const double *) b;
+
+        if (latency_a < latency_b)
+                return -1;
+        if (latency_a > latency_b)
+                return 1;
+        return 0;
+}
+
+static double
+get_percentile (double *sorted_latencies,
+                int     number_of_latencies,
+                int     percentile)
+{
+        return sorted_latencies[(number_of_latencies - 1) * percentile / 100];
+}
+
+/* Returns the user and system time pid has used, in seconds, or -1 */
+static double
+get_process_cpu_time (pid_t pid)
+{
+        char *path = NULL;
+        char contents[1024];
+        char *fields;
+        unsigned long user_ticks, system_ticks;
+        ssize_t bytes_read;
+        int fd;
+
+        asprintf (&path, "/proc/%ld/stat", (long) pid);
+        fd = open (path, O_RDONLY | O_CLOEXEC);
+        free (path);
+
+        if (fd < 0)
+                return -1;
+
+        bytes_read = read (fd, contents, sizeof(contents) - 1);
+        close (fd);
+
+        if (bytes_read <= 0)
+                return -1;
+        contents[bytes_read] = '\0';
+
+        /* The command name can have spaces in, so skip past it */
+        fields = strrchr (contents, ')');
+        if (fields == NULL)
+                return -1;
+
+        if (sscanf (fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                    &user_ticks, &system_ticks) != 2)
+                return -1;
+
+        return (double) (user_ticks + system_ticks) / sysconf (_SC_CLK_TCK);
+}
+
+static pid_t
+read_pid_file (const char *pid_file)
+{
+        FILE *fp;
+        long pid;
+
+        fp = fopen (pid_file, "re");
+        if (fp == NULL)
+                return 0;
+
+        if (fscanf (fp, "%ld", &pid) != 1)
+                pid = 0;
+        fclose (fp);
+
+        return (pid_t) pid;
+}
+
+static void
+print_report (state_t *state,
+              double   elapsed_time,
+              double   daemon_cpu_time)
+{
+        int i;
+
+        printf ("%d requests over %d connections, %d in flight on each, in %.3fs: %.0f replies/s, %d failed\n",
+                state->number_of_replies + state->number_of_failures,
+                state->number_of_connections,
+                state->number_of_requests_in_flight, elapsed_time,
+                state->number_of_replies / elapsed_time,
+                state->number_of_failures);
+
+        printf ("mix:");
+        for (i = 0; i < NUMBER_OF_REQUEST_TYPES; i++) {
+                if (state->mix[i] > 0)
+                        printf (" %s=%d", request_type_names[i], state->mix[i]);
+        }
+        printf ("\n");
+
+        if (state->number_of_replies > 0) {
+                qsort (state->latencies, state->number_of_replies, sizeof(double),
+                       compare_latencies);
+
+                printf ("latency: p50 %.3fms, p99 %.3fms, max %.3fms\n",
+                        get_percentile (state->latencies, state->number_of_replies, 50) * 1000.0,
+                        get_percentile (state->latencies, state->number_of_replies, 99) * 1000.0,
+                        state->latencies[state->number_of_replies - 1] * 1000.0);
+        }
+
+        if (daemon_cpu_time >= 0)
+                printf ("daemon CPU time: %.3fs (%.1f%% of one CPU)\n",
+                        daemon_cpu_time, 100.0 * daemon_cpu_time / elapsed_time);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+        state_t state = { 0 };
+        bool should_help, should_be_verbose;
+        int number_of_connections, number_of_requests, number_of_requests_in_flight;
+        int requests_per_second, daemon_pid;
+        char *mix, *pid_file;
+        double elapsed_time, daemon_start_cpu_time, daemon_cpu_time;
+        int exit_code, i;
+
+        signal (SIGPIPE, SIG_IGN);
+
+        state.loop = ply_event_loop_new ();
+        state.command_parser = ply_command_parser_new ("plymouth-benchmark",
+                                                       "Put the boot daemon under load and measure how it copes");
+
+        ply_command_parser_add_options (state.command_parser,
+                                        "help", "This help message", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "debug", "Enable verbose debug logging", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "connections", "Number of connections to open", PLY_COMMAND_OPTION_TYPE_INTEGER,
+                                        "requests", "Number of requests to send in all", PLY_COMMAND_OPTION_TYPE_INTEGER,
+                                        "in-flight", "Number of requests to keep waiting on replies on each connection", PLY_COMMAND_OPTION_TYPE_INTEGER,
+                                        "rate", "Requests to send a second, or 0 for as fast as possible", PLY_COMMAND_OPTION_TYPE_INTEGER,
+                                        "mix", "Requests to send, like update=4,ping=1 (ping, update, message, system-update, keystroke)", PLY_COMMAND_OPTION_TYPE_STRING,
+                                        "daemon-pid", "Process id of the daemon, to measure its CPU time", PLY_COMMAND_OPTION_TYPE_INTEGER,
+                                        "pid-file", "File the daemon wrote its process id to", PLY_COMMAND_OPTION_TYPE_STRING,
+                                        NULL);
+
+        if (!ply_command_parser_parse_arguments (state.command_parser, state.loop, argv, argc)) {
+                char *help_string;
+
+                help_string = ply_command_parser_get_help_string (state.command_parser);
+
+                ply_error ("%s", help_string);
+
+                free (help_string);
+                return 1;
+        }
+
+        number_of_connections = 0;
+        number_of_requests = 0;
+        number_of_requests_in_flight = 0;
+        requests_per_second = 0;
+        daemon_pid = 0;
+        mix = NULL;
+        pid_file = NULL;
+        ply_command_parser_get_options (state.command_parser,
+                                        "help", &should_help,
+                                        "debug", &should_be_verbose,
+                                        "connections", &number_of_connections,
+                                        "requests", &number_of_requests,
+                                        "in-flight", &number_of_requests_in_flight,
+                                        "rate", &requests_per_second,
+                                        "mix", &mix,
+                                        "daemon-pid", &daemon_pid,
+                                        "pid-file", &pid_file,
+                                        NULL);
+
+        if (should_help) {
+                char *help_string;
+
+                help_string = ply_command_parser_get_help_string (state.command_parser);
+                printf ("%s", help_string);
+                free (help_string);
+                return 0;
+        }
+
+        if (should_be_verbose && !ply_is_tracing ())
+                ply_toggle_tracing ();
+
+        if (!parse_mix (&state, mix != NULL ? mix : DEFAULT_MIX)) {
+                ply_error ("plymouth-benchmark: mix '%s' has nothing to send", mix);
+                return 1;
+        }
+
+        state.number_of_connections = number_of_connections > 0 ? number_of_connections : DEFAULT_NUMBER_OF_CONNECTIONS;
+        state.number_of_requests = number_of_requests > 0 ? number_of_requests : DEFAULT_NUMBER_OF_REQUESTS;
+        state.number_of_requests_in_flight = number_of_requests_in_flight > 0 ? number_of_requests_in_flight : DEFAULT_NUMBER_OF_REQUESTS_IN_FLIGHT;
+        state.requests_per_second = MAX (requests_per_second, 0);
+        state.latencies = calloc (state.number_of_requests, sizeof(double));
+
+        if (daemon_pid <= 0 && pid_file != NULL)
+                daemon_pid = read_pid_file (pid_file);
+
+        state.connections = calloc (state.number_of_connections, sizeof(connection_t));
+        for (i = 0; i < state.number_of_connections; i++) {
+                connection_t *connection = &state.connections[i];
+
+                connection->state = &state;
+                connection->client = ply_boot_client_new ();
+
+                if (!ply_boot_client_connect (connection->client,
+                                              (ply_boot_client_disconnect_handler_t)
+                                              on_disconnect, &state)) {
+                        ply_error ("plymouth-benchmark: could not connect to daemon: %m");
+                        return 1;
+                }
+
+                ply_boot_client_attach_to_event_loop (connection->client, state.loop);
+        }
+
+        daemon_start_cpu_time = daemon_pid > 0 ? get_process_cpu_time (daemon_pid) : -1;
+        state.start_time = ply_get_timestamp ();
+
+        if (state.requests_per_second > 0)
+                on_send_timeout (&state);
+        else
+                send_requests (&state);
+
+        exit_code = ply_event_loop_run (state.loop);
+        state.is_finished = true;
+
+        elapsed_time = ply_get_timestamp () - state.start_time;
+
+        daemon_cpu_time = -1;
+        if (daemon_start_cpu_time >= 0) {
+                daemon_cpu_time = get_process_cpu_time (daemon_pid);
+
+                if (daemon_cpu_time >= 0)
+                        daemon_cpu_time -= daemon_start_cpu_time;
+        }
+
+        print_report (&state, elapsed_time, daemon_cpu_time);
+
+        for (i = 0; i < state.number_of_connections; i++) {
+                ply_boot_client_free (state.connections[i].client);
+        }
+        free (state.connections);
+        free (state.latencies);
+        free (mix);
+        free (pid_file);
+        ply_command_parser_free (state.command_parser);
+        ply_event_loop_free (state.loop);
+
+        return exit_code;
+}
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -28,11 +28,13 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 #include "ply-boot-client.h"
+#include "ply-buffer.h"
 #include "ply-command-parser.h"
 #include "ply-event-loop.h"
 #include "ply-logger.h"
@@ -50,6 +52,11 @@ typedef struct
         ply_boot_client_t    *client;
         ply_command_parser_t *command_parser;
         char                  kernel_command_line[PLY_MAX_COMMAND_LINE_SIZE];
+
+        ply_buffer_t         *stream_buffer;
+        ply_fd_watch_t       *stream_watch;
+        int                   number_of_pending_stream_requests;
+        uint32_t              stream_had_failures : 1;
 } state_t;
 
 typedef struct
@@ -186,6 +193,259 @@ on_success (state_t *state)
         ply_event_loop_exit (state->loop, 0);
 }
 
+static void
+maybe_finish_stream (state_t *state)
+{
+        if (state->stream_watch != NULL || state->number_of_pending_stream_requests > 0)
+                return;
+
+        ply_event_loop_exit (state->loop, state->stream_had_failures ? 1 : 0);
+}
+
+static void
+on_stream_request_done (state_t *state)
+{
+        state->number_of_pending_stream_requests--;
+        maybe_finish_stream (state);
+}
+
+static void
+on_stream_request_failed (state_t *state)
+{
+        state->stream_had_failures = true;
+        on_stream_request_done (state);
+}
+
+static void
+on_stream_refused (state_t *state)
+{
+        ply_trace ("daemon can't stream, so waiting for replies instead");
+}
+
+/* Each line is a command name, then optionally a space and its
+ * argument, like "update udev" or "display-message Checking disks"
+ */
+static void
+send_stream_command (state_t *state,
+                     char    *line)
+{
+        char *command, *argument;
+
+        command = line;
+        while (*command == ' ' || *command == '\t') {
+                command++;
+        }
+
+        if (command[0] == '\0' || command[0] == '#')
+                return;
+
+        argument = strchr (command, ' ');
+        if (argument != NULL) {
+                *argument = '\0';
+                argument++;
+
+                if (strlen (argument) > UCHAR_MAX) {
+                        ply_trace ("truncating argument to %s", command);
+                        argument[UCHAR_MAX] = '\0';
+                }
+        }
+
+        state->number_of_pending_stream_requests++;
+
+        if (strcmp (command, "update") == 0) {
+                ply_boot_client_update_daemon (state->client, argument != NULL ? argument : "",
+                                               (ply_boot_client_response_handler_t)
+                                               on_stream_request_done,
+                                               (ply_boot_client_response_handler_t)
+                                               on_stream_request_failed, state);
+        } else if (strcmp (command, "system-update") == 0 && argument != NULL) {
+                ply_boot_client_system_update (state->client, argument,
+                                               (ply_boot_client_response_handler_t)
+                                               on_stream_request_done,
+                                               (ply_boot_client_response_handler_t)
+                                               on_stream_request_failed, state);
+        } else if (strcmp (command, "change-mode") == 0 && argument != NULL) {
+                ply_boot_client_change_mode (state->client, argument,
+                                             (ply_boot_client_response_handler_t)
+                                             on_stream_request_done,
+                                             (ply_boot_client_response_handler_t)
+                                             on_stream_request_failed, state);
+        } else if (strcmp (command, "display-message") == 0 && argument != NULL) {
+                ply_boot_client_tell_daemon_to_display_message (state->client, argument,
+                                                                (ply_boot_client_response_handler_t)
+                                                                on_stream_request_done,
+                                                                (ply_boot_client_response_handler_t)
+                                                                on_stream_request_failed, state);
+        } else if (strcmp (command, "hide-message") == 0 && argument != NULL) {
+                ply_boot_client_tell_daemon_to_hide_message (state->client, argument,
+                                                             (ply_boot_client_response_handler_t)
+                                                             on_stream_request_done,
+                                                             (ply_boot_client_response_handler_t)
+                                                             on_stream_request_failed, state);
+        } else if (strcmp (command, "pause-progress") == 0) {
+                ply_boot_client_tell_daemon_to_progress_pause (state->client,
+                                                               (ply_boot_client_response_handler_t)
+                                                               on_stream_request_done,
+                                                               (ply_boot_client_response_handler_t)
+                                                               on_stream_request_failed, state);
+        } else if (strcmp (command, "unpause-progress") == 0) {
+                ply_boot_client_tell_daemon_to_progress_unpause (state->client,
+                                                                 (ply_boot_client_response_handler_t)
+                                                                 on_stream_request_done,
+                                                                 (ply_boot_client_response_handler_t)
+                                                                 on_stream_request_failed, state);
+        } else if (strcmp (command, "show-splash") == 0) {
+                ply_boot_client_tell_daemon_to_show_splash (state->client,
+                                                            (ply_boot_client_response_handler_t)
+                                                            on_stream_request_done,
+                                                            (ply_boot_client_response_handler_t)
+                                                            on_stream_request_failed, state);
+        } else if (strcmp (command, "hide-splash") == 0) {
+                ply_boot_client_tell_daemon_to_hide_splash (state->client,
+                                                            (ply_boot_client_response_handler_t)
+                                                            on_stream_request_done,
+                                                            (ply_boot_client_response_handler_t)
+                                                            on_stream_request_failed, state);
+        } else if (strcmp (command, "sysinit") == 0) {
+                ply_boot_client_tell_daemon_system_is_initialized (state->client,
+                                                                   (ply_boot_client_response_handler_t)
+                                                                   on_stream_request_done,
+                                                                   (ply_boot_client_response_handler_t)
+                                                                   on_stream_request_failed, state);
+        } else {
+                ply_error ("plymouth: can't stream '%s'", command);
+                state->number_of_pending_stream_requests--;
+                state->stream_had_failures = true;
+        }
+}
+
+static void
+send_stream_commands (state_t *state,
+                      bool     is_at_end)
+{
+        const char *bytes;
+        size_t size, start, end;
+
+        bytes = ply_buffer_get_bytes (state->stream_buffer);
+        size = ply_buffer_get_size (state->stream_buffer);
+
+        start = 0;
+        for (end = 0; end < size; end++) {
+                char *line;
+
+                if (bytes[end] != '\n')
+                        continue;
+
+                line = strndup (bytes + start, end - start);
+                send_stream_command (state, line);
+                free (line);
+
+                start = end + 1;
+        }
+
+        if (is_at_end && start < size) {
+                char *line;
+
+                line = strndup (bytes + start, size - start);
+                send_stream_command (state, line);
+                free (line);
+
+                start = size;
+        }
+
+        ply_buffer_remove_bytes (state->stream_buffer, start);
+}
+
+static bool
+read_stream (state_t *state)
+{
+        char bytes[4096];
+        ssize_t bytes_read;
+
+        bytes_read = read (STDIN_FILENO, bytes, sizeof(bytes));
+
+        if (bytes_read < 0 && (errno == EINTR || errno == EAGAIN))
+                return true;
+
+        if (bytes_read <= 0)
+                return false;
+
+        ply_buffer_append_bytes (state->stream_buffer, bytes, bytes_read);
+        return true;
+}
+
+static void
+on_stream_data (state_t *state)
+{
+        if (read_stream (state)) {
+                send_stream_commands (state, false);
+                return;
+        }
+
+        ply_event_loop_stop_watching_fd (state->loop, state->stream_watch);
+        state->stream_watch = NULL;
+
+        send_stream_commands (state, true);
+        maybe_finish_stream (state);
+}
+
+static void
+finish_reading_stream (state_t *state)
+{
+        while (read_stream (state)) {
+                send_stream_commands (state, false);
+        }
+
+        send_stream_commands (state, true);
+        maybe_finish_stream (state);
+}
+
+static void
+on_stream_hangup (state_t *state)
+{
+        state->stream_watch = NULL;
+        finish_reading_stream (state);
+}
+
+static void
+start_stream (state_t *state)
+{
+        struct stat file_info;
+
+        state->stream_buffer = ply_buffer_new ();
+
+        ply_boot_client_start_streaming (state->client,
+                                         NULL,
+                                         (ply_boot_client_response_handler_t)
+                                         on_stream_refused,
+                                         state);
+
+        /* Regular files can't be watched, but can't block either */
+        if (fstat (STDIN_FILENO, &file_info) == 0 && S_ISREG (file_info.st_mode)) {
+                finish_reading_stream (state);
+                return;
+        }
+
+        state->stream_watch = ply_event_loop_watch_fd (state->loop, STDIN_FILENO,
+                                                       PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                                       (ply_event_handler_t)
+                                                       on_stream_data,
+                                                       (ply_event_handler_t)
+                                                       on_stream_hangup,
+                                                       state);
+}
+
+static void
+on_statistics_answer (state_t           *state,
+                      const char        *statistics,
+                      ply_boot_client_t *client)
+{
+        if (statistics != NULL)
+                printf ("%s", statistics);
+
+        ply_event_loop_exit (state->loop, 0);
+}
+
 static void
 on_password_answer_failure (password_answer_state_t *answer_state,
                             ply_boot_client_t       *client)
@@ -878,7 +1138,7 @@ main (int    argc,
       char **argv)
 {
         state_t state = { 0 };
-        bool should_help, should_quit, should_ping, should_check_for_active_vt, should_sysinit, should_ask_for_password, should_show_splash, should_hide_splash, should_wait, should_be_verbose, report_error, should_get_plugin_path;
+        bool should_help, should_quit, should_ping, should_check_for_active_vt, should_show_statistics, should_sysinit, should_ask_for_password, should_show_splash, should_hide_splash, should_wait, should_be_verbose, report_error, should_get_plugin_path, should_stream;
         bool is_connected;
         char *status, *chroot_dir, *ignore_keystroke;
         int exit_code;
@@ -899,6 +1159,7 @@ main (int    argc,
                                         "quit", "Tell boot daemon to quit", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "ping", "Check of boot daemon is running", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "has-active-vt", "Check if boot daemon has an active vt", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "stats", "Show frame timing statistics from the boot daemon", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "sysinit", "Tell boot daemon root filesystem is mounted read-write", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "show-splash", "Show splash screen", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "hide-splash", "Hide splash screen", PLY_COMMAND_OPTION_TYPE_FLAG,
@@ -907,6 +1168,7 @@ main (int    argc,
                                         "update", "Tell boot daemon an update about boot progress", PLY_COMMAND_OPTION_TYPE_STRING,
                                         "details", "Tell boot daemon there were errors during boot", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "wait", "Wait for boot daemon to quit", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "stream", "Send commands read from standard input without waiting for replies", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         NULL);
 
         ply_command_parser_add_command (state.command_parser,
@@ -1075,6 +1337,7 @@ main (int    argc,
                                         "quit", &should_quit,
                                         "ping", &should_ping,
                                         "has-active-vt", &should_check_for_active_vt,
+                                        "stats", &should_show_statistics,
                                         "sysinit", &should_sysinit,
                                         "show-splash", &should_show_splash,
                                         "hide-splash", &should_hide_splash,
@@ -1083,6 +1346,7 @@ main (int    argc,
                                         "update", &status,
                                         "wait", &should_wait,
                                         "details", &report_error,
+                                        "stream", &should_stream,
                                         NULL);
 
         if (should_help || argc < 2) {
@@ -1136,7 +1400,9 @@ main (int    argc,
 
         ply_boot_client_attach_to_event_loop (state.client, state.loop);
 
-        if (should_show_splash) {
+        if (should_stream) {
+                start_stream (&state);
+        } else if (should_show_splash) {
                 ply_boot_client_tell_daemon_to_show_splash (state.client,
                                                             (ply_boot_client_response_handler_t)
                                                             on_success,
@@ -1167,6 +1433,12 @@ main (int    argc,
                                                           on_success,
                                                           (ply_boot_client_response_handler_t)
                                                           on_failure, &state);
+        } else if (should_show_statistics) {
+                ply_boot_client_ask_daemon_for_statistics (state.client,
+                                                           (ply_boot_client_answer_handler_t)
+                                                           on_statistics_answer,
+                                                           (ply_boot_client_response_handler_t)
+                                                           on_failure, &state);
         } else if (status != NULL) {
                 ply_boot_client_update_daemon (state.client, status,
                                                (ply_boot_client_response_handler_t)
@@ -1215,6 +1487,7 @@ main (int    argc,
 
         exit_code = ply_event_loop_run (state.loop);
 
+        ply_buffer_free (state.stream_buffer);
         ply_boot_client_free (state.client);
 
         ply_event_loop_free (state.loop);
@@ -451,10 +451,14 @@ ply_boot_splash_update_progress (ply_boot_splash_t *splash)
                                                             time,
                                                             percentage);
 
-        ply_event_loop_watch_for_timeout (splash->loop,
-                                          1.0 / UPDATES_PER_SECOND,
-                                          (ply_event_loop_timeout_handler_t)
-                                          ply_boot_splash_update_progress, splash);
+        /* Nobody can tell if the progress moves a frame late, so let it
+         * ride along with whatever else wakes the loop up
+         */
+        ply_event_loop_watch_for_timeout_with_slack (splash->loop,
+                                                     1.0 / UPDATES_PER_SECOND,
+                                                     1.0 / UPDATES_PER_SECOND,
+                                                     (ply_event_loop_timeout_handler_t)
+                                                     ply_boot_splash_update_progress, splash);
 }
 
 void
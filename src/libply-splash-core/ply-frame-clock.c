@@ -0,0 +1,591 @@
+/* ply-frame-clock.c - shared clock for driving animations
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-frame-clock.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ply-event-loop.h"
+#include "ply-frame-statistics.h"
+#include "ply-list.h"
+#include "ply-logger.h"
+#include "ply-utils.h"
+
+/* Every animated widget used to arm its own timeout at its own
+ * frame rate.  With several widgets on several heads that meant many
+ * wakeups per nominal frame, each with a slightly different idea of
+ * what time it was.  The frame clock replaces those timers with a
+ * single one.  Each tick hands all subscribers the same timestamp,
+ * and subscribers that asked for a lower rate than the fastest one
+ * are simply skipped on ticks they don't need.
+ *
+ * For now ticks come from an event loop timeout, but all dispatch goes
+ * through ply_frame_clock_tick () so a renderer vblank can drive the
+ * clock instead.
+ *
+ * The clock also governs how fast it runs.  Displays report how many
+ * pixels they damage, and the clock times how long each frame takes to
+ * dispatch.  When several frames in a row damage nothing, the tick
+ * interval is stretched, and it snaps back as soon as something draws
+ * again.  If a CPU budget is set, the interval is also stretched so
+ * that the average frame cost stays within that share of one core.
+ *
+ * Ticks are allowed to run a little late so they can share wakeups
+ * with other timers.  When saving power, the clock runs at a fraction
+ * of the requested rate and gives the event loop more room still.
+ */
+
+#ifndef PLY_FRAME_CLOCK_MINIMUM_SLEEP_TIME
+#define PLY_FRAME_CLOCK_MINIMUM_SLEEP_TIME 0.005
+#endif
+
+#ifndef PLY_FRAME_CLOCK_IDLE_FRAMES_BEFORE_BACKOFF
+#define PLY_FRAME_CLOCK_IDLE_FRAMES_BEFORE_BACKOFF 4
+#endif
+
+#ifndef PLY_FRAME_CLOCK_MAXIMUM_IDLE_SCALE
+#define PLY_FRAME_CLOCK_MAXIMUM_IDLE_SCALE 8
+#endif
+
+/* Fractions of the tick interval a tick may be delayed by */
+#ifndef PLY_FRAME_CLOCK_SLACK
+#define PLY_FRAME_CLOCK_SLACK 0.1
+#endif
+
+#ifndef PLY_FRAME_CLOCK_POWER_SAVING_SLACK
+#define PLY_FRAME_CLOCK_POWER_SAVING_SLACK 0.5
+#endif
+
+#ifndef PLY_FRAME_CLOCK_POWER_SAVING_SCALE
+#define PLY_FRAME_CLOCK_POWER_SAVING_SCALE 2
+#endif
+
+typedef struct
+{
+        ply_frame_clock_handler_t handler;
+        void                     *user_data;
+
+        double                    interval;
+        double                    next_frame_time;
+
+        uint32_t                  is_removed : 1;
+} ply_frame_clock_closure_t;
+
+struct _ply_frame_clock
+{
+        ply_event_loop_t *loop;
+        ply_list_t       *closures;
+
+        double            frame_time;
+        double            scheduled_frame_time;
+        double            last_frame_end_time;
+        double            interval;
+        double            governed_interval;
+
+        double            cpu_budget;
+        double            average_frame_cost;
+        unsigned long     damage;
+        int               idle_frames;
+        int               idle_scale;
+        int               previous_idle_scale;
+
+        uint32_t          is_ticking : 1;
+        uint32_t          is_over_budget : 1;
+        uint32_t          is_dispatching : 1;
+        uint32_t          needs_sweep : 1;
+        uint32_t          is_saving_power : 1;
+};
+
+static void on_timeout (ply_frame_clock_t *clock);
+
+static void
+detach_from_event_loop (ply_frame_clock_t *clock)
+{
+        assert (clock != NULL);
+
+        clock->loop = NULL;
+        clock->is_ticking = false;
+}
+
+ply_frame_clock_t *
+ply_frame_clock_new (ply_event_loop_t *loop)
+{
+        ply_frame_clock_t *clock;
+
+        assert (loop != NULL);
+
+        clock = calloc (1, sizeof(ply_frame_clock_t));
+        clock->loop = loop;
+        clock->closures = ply_list_new ();
+        clock->frame_time = ply_get_timestamp ();
+        clock->interval = 0.0;
+        clock->governed_interval = 0.0;
+        clock->cpu_budget = 0.0;
+        clock->idle_scale = 1;
+        clock->previous_idle_scale = 1;
+        clock->is_ticking = false;
+        clock->is_over_budget = false;
+
+        ply_event_loop_watch_for_exit (loop,
+                                       (ply_event_loop_exit_handler_t)
+                                       detach_from_event_loop,
+                                       clock);
+
+        return clock;
+}
+
+ply_frame_clock_t *
+ply_frame_clock_get_default (void)
+{
+        static ply_frame_clock_t *clock = NULL;
+
+        if (clock == NULL)
+                clock = ply_frame_clock_new (ply_event_loop_get_default ());
+
+        return clock;
+}
+
+static void
+ply_frame_clock_stop_ticking (ply_frame_clock_t *clock)
+{
+        if (!clock->is_ticking)
+                return;
+
+        if (clock->loop != NULL)
+                ply_event_loop_stop_watching_for_timeout (clock->loop,
+                                                          (ply_event_loop_timeout_handler_t)
+                                                          on_timeout, clock);
+        clock->is_ticking = false;
+}
+
+void
+ply_frame_clock_free (ply_frame_clock_t *clock)
+{
+        ply_list_node_t *node;
+
+        if (clock == NULL)
+                return;
+
+        ply_frame_clock_stop_ticking (clock);
+
+        if (clock->loop != NULL)
+                ply_event_loop_stop_watching_for_exit (clock->loop,
+                                                       (ply_event_loop_exit_handler_t)
+                                                       detach_from_event_loop,
+                                                       clock);
+
+        node = ply_list_get_first_node (clock->closures);
+        while (node != NULL) {
+                ply_list_node_t *next_node;
+                ply_frame_clock_closure_t *closure;
+
+                closure = (ply_frame_clock_closure_t *) ply_list_node_get_data (node);
+                next_node = ply_list_get_next_node (clock->closures, node);
+
+                free (closure);
+                ply_list_remove_node (clock->closures, node);
+
+                node = next_node;
+        }
+        ply_list_free (clock->closures);
+
+        free (clock);
+}
+
+static void
+ply_frame_clock_update_governed_interval (ply_frame_clock_t *clock)
+{
+        double interval, budgeted_interval;
+        bool is_over_budget;
+
+        interval = clock->interval * clock->idle_scale;
+
+        if (clock->is_saving_power)
+                interval *= PLY_FRAME_CLOCK_POWER_SAVING_SCALE;
+
+        is_over_budget = false;
+        if (clock->cpu_budget > 0.0) {
+                budgeted_interval = clock->average_frame_cost / clock->cpu_budget;
+
+                if (budgeted_interval > interval) {
+                        interval = budgeted_interval;
+                        is_over_budget = true;
+                }
+        }
+
+        if (is_over_budget != clock->is_over_budget) {
+                if (is_over_budget)
+                        ply_trace ("frames cost %.2fms on average, throttling to %.1f frames per second to stay in CPU budget",
+                                   clock->average_frame_cost * 1000.0, 1.0 / interval);
+                else
+                        ply_trace ("frames are back within CPU budget");
+        }
+
+        if (clock->idle_scale != clock->previous_idle_scale) {
+                if (clock->idle_scale > 1)
+                        ply_trace ("nothing drawn for a while, slowing frame clock down by a factor of %d",
+                                   clock->idle_scale);
+                else
+                        ply_trace ("frame clock back to full speed");
+        }
+
+        clock->governed_interval = interval;
+        clock->is_over_budget = is_over_budget;
+        clock->previous_idle_scale = clock->idle_scale;
+}
+
+static void
+ply_frame_clock_update_governor (ply_frame_clock_t *clock,
+                                 double             frame_cost)
+{
+        clock->average_frame_cost = .75 * clock->average_frame_cost + .25 * frame_cost;
+
+        if (clock->damage > 0) {
+                clock->idle_frames = 0;
+                clock->idle_scale = 1;
+        } else {
+                clock->idle_frames++;
+
+                if (clock->idle_frames >= PLY_FRAME_CLOCK_IDLE_FRAMES_BEFORE_BACKOFF) {
+                        clock->idle_frames = 0;
+                        clock->idle_scale = MIN (clock->idle_scale * 2,
+                                                 PLY_FRAME_CLOCK_MAXIMUM_IDLE_SCALE);
+                }
+        }
+        clock->damage = 0;
+
+        ply_frame_clock_update_governed_interval (clock);
+}
+
+static void
+ply_frame_clock_update_interval (ply_frame_clock_t *clock)
+{
+        ply_list_node_t *node;
+
+        clock->interval = 0.0;
+
+        node = ply_list_get_first_node (clock->closures);
+        while (node != NULL) {
+                ply_frame_clock_closure_t *closure;
+
+                closure = (ply_frame_clock_closure_t *) ply_list_node_get_data (node);
+
+                if (!closure->is_removed) {
+                        if (clock->interval <= 0.0)
+                                clock->interval = closure->interval;
+                        else
+                                clock->interval = MIN (clock->interval, closure->interval);
+                }
+
+                node = ply_list_get_next_node (clock->closures, node);
+        }
+
+        ply_frame_clock_update_governed_interval (clock);
+}
+
+static void
+ply_frame_clock_sweep_closures (ply_frame_clock_t *clock)
+{
+        ply_list_node_t *node;
+
+        node = ply_list_get_first_node (clock->closures);
+        while (node != NULL) {
+                ply_list_node_t *next_node;
+                ply_frame_clock_closure_t *closure;
+
+                closure = (ply_frame_clock_closure_t *) ply_list_node_get_data (node);
+                next_node = ply_list_get_next_node (clock->closures, node);
+
+                if (closure->is_removed) {
+                        free (closure);
+                        ply_list_remove_node (clock->closures, node);
+                }
+
+                node = next_node;
+        }
+
+        clock->needs_sweep = false;
+}
+
+static void
+ply_frame_clock_schedule_next_tick (ply_frame_clock_t *clock)
+{
+        double sleep_time, slack;
+
+        if (clock->loop == NULL || clock->is_ticking)
+                return;
+
+        if (ply_list_get_length (clock->closures) == 0)
+                return;
+
+        sleep_time = MAX (clock->frame_time + clock->governed_interval - ply_get_timestamp (),
+                          PLY_FRAME_CLOCK_MINIMUM_SLEEP_TIME);
+
+        clock->scheduled_frame_time = ply_get_timestamp () + sleep_time;
+
+        if (clock->is_saving_power)
+                slack = clock->governed_interval * PLY_FRAME_CLOCK_POWER_SAVING_SLACK;
+        else
+                slack = clock->governed_interval * PLY_FRAME_CLOCK_SLACK;
+
+        ply_event_loop_watch_for_timeout_with_slack (clock->loop,
+                                                     sleep_time,
+                                                     slack,
+                                                     (ply_event_loop_timeout_handler_t)
+                                                     on_timeout, clock);
+        clock->is_ticking = true;
+}
+
+static void
+ply_frame_clock_tick (ply_frame_clock_t *clock,
+                      double             frame_time)
+{
+        ply_frame_statistics_t *statistics;
+        ply_list_node_t *node, *last_node;
+        double frame_end_time, frame_cost;
+
+        statistics = ply_frame_statistics_get_default ();
+
+        if (clock->last_frame_end_time > 0.0)
+                ply_frame_statistics_add_sample (statistics,
+                                                 PLY_FRAME_STATISTICS_STAGE_IDLE,
+                                                 frame_time - clock->last_frame_end_time);
+
+        clock->frame_time = frame_time;
+
+        /* Only dispatch to closures that existed when the frame started.
+         * Anything added from a handler waits for the next tick.
+         */
+        last_node = ply_list_get_last_node (clock->closures);
+
+        clock->is_dispatching = true;
+        node = ply_list_get_first_node (clock->closures);
+        while (node != NULL) {
+                ply_frame_clock_closure_t *closure;
+
+                closure = (ply_frame_clock_closure_t *) ply_list_node_get_data (node);
+
+                /* Allow half a tick of slop, otherwise a slow subscriber
+                 * could land just after a fast tick and get pushed to
+                 * the one after.
+                 */
+                if (!closure->is_removed &&
+                    closure->next_frame_time <= frame_time + clock->interval / 2.0) {
+                        closure->next_frame_time += closure->interval;
+
+                        if (closure->next_frame_time <= frame_time)
+                                closure->next_frame_time = frame_time + closure->interval;
+
+                        closure->handler (closure->user_data, frame_time, clock);
+                }
+
+                if (node == last_node)
+                        break;
+
+                node = ply_list_get_next_node (clock->closures, node);
+        }
+        clock->is_dispatching = false;
+
+        frame_end_time = ply_get_timestamp ();
+        frame_cost = frame_end_time - frame_time;
+
+        ply_frame_statistics_add_frame (statistics);
+
+        /* The frame is late if it wasn't finished by the time the next
+         * one should have started.
+         */
+        if (clock->scheduled_frame_time > 0.0 &&
+            frame_end_time > clock->scheduled_frame_time + clock->governed_interval)
+                ply_frame_statistics_add_missed_deadline (statistics);
+
+        clock->last_frame_end_time = frame_end_time;
+
+        if (clock->needs_sweep) {
+                ply_frame_clock_sweep_closures (clock);
+                ply_frame_clock_update_interval (clock);
+        }
+
+        ply_frame_clock_update_governor (clock, frame_cost);
+
+        ply_frame_clock_schedule_next_tick (clock);
+}
+
+static void
+on_timeout (ply_frame_clock_t *clock)
+{
+        clock->is_ticking = false;
+
+        ply_frame_clock_tick (clock, ply_get_timestamp ());
+}
+
+void
+ply_frame_clock_add_handler (ply_frame_clock_t        *clock,
+                             double                    frames_per_second,
+                             ply_frame_clock_handler_t handler,
+                             void                     *user_data)
+{
+        ply_frame_clock_closure_t *closure;
+
+        assert (clock != NULL);
+        assert (handler != NULL);
+        assert (frames_per_second > 0.0);
+
+        closure = calloc (1, sizeof(ply_frame_clock_closure_t));
+        closure->handler = handler;
+        closure->user_data = user_data;
+        closure->interval = 1.0 / frames_per_second;
+
+        if (!clock->is_ticking && !clock->is_dispatching) {
+                clock->frame_time = ply_get_timestamp ();
+
+                /* Time spent with nothing animating isn't idle time
+                 * between frames, so don't count it as such.
+                 */
+                clock->scheduled_frame_time = 0.0;
+                clock->last_frame_end_time = 0.0;
+        }
+
+        closure->next_frame_time = clock->frame_time + closure->interval;
+
+        /* A new subscriber is about to start drawing, so don't make it
+         * wait out an idle backoff.
+         */
+        clock->idle_frames = 0;
+        clock->idle_scale = 1;
+
+        ply_list_append_data (clock->closures, closure);
+        ply_frame_clock_update_interval (clock);
+
+        if (!clock->is_dispatching)
+                ply_frame_clock_schedule_next_tick (clock);
+}
+
+void
+ply_frame_clock_remove_handler (ply_frame_clock_t        *clock,
+                                ply_frame_clock_handler_t handler,
+                                void                     *user_data)
+{
+        ply_list_node_t *node;
+
+        assert (clock != NULL);
+
+        node = ply_list_get_first_node (clock->closures);
+        while (node != NULL) {
+                ply_frame_clock_closure_t *closure;
+
+                closure = (ply_frame_clock_closure_t *) ply_list_node_get_data (node);
+
+                if (!closure->is_removed &&
+                    closure->handler == handler &&
+                    closure->user_data == user_data) {
+                        /* Handlers are allowed to remove themselves (or each
+                         * other) mid-frame, so defer the actual free until
+                         * dispatch is done.
+                         */
+                        closure->is_removed = true;
+                        clock->needs_sweep = true;
+                        break;
+                }
+
+                node = ply_list_get_next_node (clock->closures, node);
+        }
+
+        if (clock->is_dispatching)
+                return;
+
+        ply_frame_clock_sweep_closures (clock);
+        ply_frame_clock_update_interval (clock);
+
+        if (ply_list_get_length (clock->closures) == 0)
+                ply_frame_clock_stop_ticking (clock);
+}
+
+void
+ply_frame_clock_report_damage (ply_frame_clock_t *clock,
+                               unsigned long      area)
+{
+        assert (clock != NULL);
+
+        if (area == 0)
+                return;
+
+        clock->damage += area;
+
+        if (clock->is_dispatching || clock->idle_scale == 1)
+                return;
+
+        /* Something drew between frames while we were idling, so get
+         * back up to speed now rather than at the next (slow) tick.
+         */
+        clock->idle_frames = 0;
+        clock->idle_scale = 1;
+        ply_frame_clock_update_governed_interval (clock);
+
+        if (clock->is_ticking) {
+                ply_frame_clock_stop_ticking (clock);
+                ply_frame_clock_schedule_next_tick (clock);
+        }
+}
+
+void
+ply_frame_clock_set_cpu_budget (ply_frame_clock_t *clock,
+                                double             cpu_budget)
+{
+        assert (clock != NULL);
+
+        clock->cpu_budget = MAX (cpu_budget, 0.0);
+
+        if (clock->cpu_budget > 0.0)
+                ply_trace ("limiting animations to %.1f%% of one CPU", clock->cpu_budget * 100.0);
+
+        ply_frame_clock_update_governed_interval (clock);
+}
+
+void
+ply_frame_clock_set_power_saving (ply_frame_clock_t *clock,
+                                  bool               is_saving_power)
+{
+        assert (clock != NULL);
+
+        if (clock->is_saving_power == is_saving_power)
+                return;
+
+        clock->is_saving_power = is_saving_power;
+
+        if (is_saving_power)
+                ply_trace ("saving power, running animations at 1/%d of their frame rate",
+                           PLY_FRAME_CLOCK_POWER_SAVING_SCALE);
+
+        ply_frame_clock_update_governed_interval (clock);
+}
+
+double
+ply_frame_clock_get_frame_time (ply_frame_clock_t *clock)
+{
+        assert (clock != NULL);
+
+        return clock->frame_time;
+}
+
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
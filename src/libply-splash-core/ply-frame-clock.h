@@ -0,0 +1,59 @@
+/* ply-frame-clock.h - shared clock for driving animations
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_FRAME_CLOCK_H
+#define PLY_FRAME_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "ply-event-loop.h"
+
+typedef struct _ply_frame_clock ply_frame_clock_t;
+
+typedef void (*ply_frame_clock_handler_t) (void              *user_data,
+                                           double             frame_time,
+                                           ply_frame_clock_t *clock);
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_frame_clock_t *ply_frame_clock_new (ply_event_loop_t *loop);
+void ply_frame_clock_free (ply_frame_clock_t *clock);
+ply_frame_clock_t *ply_frame_clock_get_default (void);
+
+void ply_frame_clock_add_handler (ply_frame_clock_t        *clock,
+                                  double                    frames_per_second,
+                                  ply_frame_clock_handler_t handler,
+                                  void                     *user_data);
+void ply_frame_clock_remove_handler (ply_frame_clock_t        *clock,
+                                     ply_frame_clock_handler_t handler,
+                                     void                     *user_data);
+
+void ply_frame_clock_report_damage (ply_frame_clock_t *clock,
+                                    unsigned long      area);
+void ply_frame_clock_set_cpu_budget (ply_frame_clock_t *clock,
+                                     double             cpu_budget);
+void ply_frame_clock_set_power_saving (ply_frame_clock_t *clock,
+                                       bool               is_saving_power);
+
+double ply_frame_clock_get_frame_time (ply_frame_clock_t *clock);
+#endif
+
+#endif /* PLY_FRAME_CLOCK_H */
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
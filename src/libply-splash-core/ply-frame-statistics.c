@@ -0,0 +1,226 @@
+/* ply-frame-statistics.c - frame timing counters
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-frame-statistics.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ply-buffer.h"
+#include "ply-utils.h"
+
+/* Counters for where frame time goes.  Recording a sample is just a
+ * few additions and a bit scan, so it is cheap enough to leave on all
+ * the time.  Each stage also keeps a histogram with power-of-two
+ * microsecond buckets, which is enough to tell an occasional slow
+ * frame from a theme that is slow across the board.
+ *
+ *  - draw is all of ply_pixel_display_draw_area ()
+ *  - composite is the splash plugin's draw handler
+ *  - flush is the renderer pushing the shadow buffer to the screen
+ *  - idle is how long the frame clock slept between ticks
+ */
+
+#define PLY_FRAME_STATISTICS_NUMBER_OF_BUCKETS 24
+
+typedef struct
+{
+        unsigned long count;
+        uint64_t      total_time;
+        uint64_t      maximum_time;
+        unsigned long buckets[PLY_FRAME_STATISTICS_NUMBER_OF_BUCKETS];
+} ply_frame_statistics_stage_counters_t;
+
+struct _ply_frame_statistics
+{
+        ply_frame_statistics_stage_counters_t stages[PLY_FRAME_STATISTICS_NUMBER_OF_STAGES];
+
+        unsigned long                         frames;
+        unsigned long                         missed_deadlines;
+        uint64_t                              damage;
+};
+
+static const char *stage_names[PLY_FRAME_STATISTICS_NUMBER_OF_STAGES] =
+{
+        [PLY_FRAME_STATISTICS_STAGE_DRAW] = "draw",
+        [PLY_FRAME_STATISTICS_STAGE_COMPOSITE] = "composite",
+        [PLY_FRAME_STATISTICS_STAGE_FLUSH] = "flush",
+        [PLY_FRAME_STATISTICS_STAGE_IDLE] = "idle",
+};
+
+ply_frame_statistics_t *
+ply_frame_statistics_new (void)
+{
+        ply_frame_statistics_t *statistics;
+
+        statistics = calloc (1, sizeof(ply_frame_statistics_t));
+
+        return statistics;
+}
+
+void
+ply_frame_statistics_free (ply_frame_statistics_t *statistics)
+{
+        if (statistics == NULL)
+                return;
+
+        free (statistics);
+}
+
+ply_frame_statistics_t *
+ply_frame_statistics_get_default (void)
+{
+        static ply_frame_statistics_t *statistics = NULL;
+
+        if (statistics == NULL)
+                statistics = ply_frame_statistics_new ();
+
+        return statistics;
+}
+
+static int
+get_bucket_for_time (uint64_t microseconds)
+{
+        int bucket;
+
+        bucket = 0;
+        while (microseconds > 1 && bucket < PLY_FRAME_STATISTICS_NUMBER_OF_BUCKETS - 1) {
+                microseconds >>= 1;
+                bucket++;
+        }
+
+        return bucket;
+}
+
+void
+ply_frame_statistics_add_sample (ply_frame_statistics_t      *statistics,
+                                 ply_frame_statistics_stage_t stage,
+                                 double                       seconds)
+{
+        ply_frame_statistics_stage_counters_t *counters;
+        uint64_t microseconds;
+
+        assert (statistics != NULL);
+        assert (stage < PLY_FRAME_STATISTICS_NUMBER_OF_STAGES);
+
+        if (seconds < 0.0)
+                seconds = 0.0;
+
+        microseconds = (uint64_t) (seconds * 1000000.0);
+
+        counters = &statistics->stages[stage];
+        counters->count++;
+        counters->total_time += microseconds;
+        counters->maximum_time = MAX (counters->maximum_time, microseconds);
+        counters->buckets[get_bucket_for_time (microseconds)]++;
+}
+
+void
+ply_frame_statistics_add_frame (ply_frame_statistics_t *statistics)
+{
+        assert (statistics != NULL);
+
+        statistics->frames++;
+}
+
+void
+ply_frame_statistics_add_damage (ply_frame_statistics_t *statistics,
+                                 unsigned long           area)
+{
+        assert (statistics != NULL);
+
+        statistics->damage += area;
+}
+
+void
+ply_frame_statistics_add_missed_deadline (ply_frame_statistics_t *statistics)
+{
+        assert (statistics != NULL);
+
+        statistics->missed_deadlines++;
+}
+
+void
+ply_frame_statistics_reset (ply_frame_statistics_t *statistics)
+{
+        assert (statistics != NULL);
+
+        memset (statistics, 0, sizeof(ply_frame_statistics_t));
+}
+
+char *
+ply_frame_statistics_to_string (ply_frame_statistics_t *statistics)
+{
+        ply_buffer_t *buffer;
+        char *string;
+        int i, j;
+
+        assert (statistics != NULL);
+
+        buffer = ply_buffer_new ();
+
+        ply_buffer_append (buffer, "frames: %lu\n", statistics->frames);
+        ply_buffer_append (buffer, "missed deadlines: %lu\n", statistics->missed_deadlines);
+        ply_buffer_append (buffer, "damaged pixels: %llu\n",
+                           (unsigned long long) statistics->damage);
+
+        for (i = 0; i < PLY_FRAME_STATISTICS_NUMBER_OF_STAGES; i++) {
+                ply_frame_statistics_stage_counters_t *counters;
+                bool is_first_bucket;
+
+                counters = &statistics->stages[i];
+
+                if (counters->count == 0) {
+                        ply_buffer_append (buffer, "%s: no samples\n", stage_names[i]);
+                        continue;
+                }
+
+                ply_buffer_append (buffer,
+                                   "%s: %lu samples, %llu us total, %llu us average, %llu us max\n",
+                                   stage_names[i], counters->count,
+                                   (unsigned long long) counters->total_time,
+                                   (unsigned long long) (counters->total_time / counters->count),
+                                   (unsigned long long) counters->maximum_time);
+
+                ply_buffer_append (buffer, "%s histogram:", stage_names[i]);
+                is_first_bucket = true;
+                for (j = 0; j < PLY_FRAME_STATISTICS_NUMBER_OF_BUCKETS; j++) {
+                        if (counters->buckets[j] == 0)
+                                continue;
+
+                        ply_buffer_append (buffer, "%s <%lluus=%lu",
+                                           is_first_bucket ? "" : ",",
+                                           2ULL << j, counters->buckets[j]);
+                        is_first_bucket = false;
+                }
+                ply_buffer_append (buffer, "\n");
+        }
+
+        string = ply_buffer_steal_bytes (buffer);
+        ply_buffer_free (buffer);
+
+        return string;
+}
+
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -0,0 +1,56 @@
+/* ply-frame-statistics.h - frame timing counters
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_FRAME_STATISTICS_H
+#define PLY_FRAME_STATISTICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+typedef struct _ply_frame_statistics ply_frame_statistics_t;
+
+typedef enum
+{
+        PLY_FRAME_STATISTICS_STAGE_DRAW = 0,
+        PLY_FRAME_STATISTICS_STAGE_COMPOSITE,
+        PLY_FRAME_STATISTICS_STAGE_FLUSH,
+        PLY_FRAME_STATISTICS_STAGE_IDLE,
+        PLY_FRAME_STATISTICS_NUMBER_OF_STAGES
+} ply_frame_statistics_stage_t;
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_frame_statistics_t *ply_frame_statistics_new (void);
+void ply_frame_statistics_free (ply_frame_statistics_t *statistics);
+ply_frame_statistics_t *ply_frame_statistics_get_default (void);
+
+void ply_frame_statistics_add_sample (ply_frame_statistics_t      *statistics,
+                                      ply_frame_statistics_stage_t stage,
+                                      double                       seconds);
+void ply_frame_statistics_add_frame (ply_frame_statistics_t *statistics);
+void ply_frame_statistics_add_damage (ply_frame_statistics_t *statistics,
+                                      unsigned long           area);
+void ply_frame_statistics_add_missed_deadline (ply_frame_statistics_t *statistics);
+
+void ply_frame_statistics_reset (ply_frame_statistics_t *statistics);
+char *ply_frame_statistics_to_string (ply_frame_statistics_t *statistics);
+#endif
+
+#endif /* PLY_FRAME_STATISTICS_H */
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
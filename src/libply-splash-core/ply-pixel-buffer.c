@@ -47,7 +47,9 @@ struct _ply_pixel_buffer
         ply_list_t     *clip_areas;
 
         ply_region_t   *updated_areas;
+        int             reference_count;
         uint32_t        is_opaque : 1;
+        uint32_t        bytes_are_borrowed : 1;
 };
 
 static inline void ply_pixel_buffer_blend_value_at_pixel (ply_pixel_buffer_t *buffer,
@@ -248,6 +250,7 @@ ply_pixel_buffer_new (unsigned long width,
 
         buffer = calloc (1, sizeof(ply_pixel_buffer_t));
 
+        buffer->reference_count = 1;
         buffer->updated_areas = ply_region_new ();
         buffer->bytes = (uint32_t *) calloc (height, width * sizeof(uint32_t));
         buffer->area.width = width;
@@ -260,6 +263,34 @@ ply_pixel_buffer_new (unsigned long width,
         return buffer;
 }
 
+/* Wraps pixel data that's owned by someone else, like a mapped image
+ * pack.  The data has to stay around for as long as the buffer does.
+ */
+ply_pixel_buffer_t *
+ply_pixel_buffer_new_with_data (unsigned long width,
+                                unsigned long height,
+                                uint32_t     *bytes)
+{
+        ply_pixel_buffer_t *buffer;
+
+        assert (bytes != NULL);
+
+        buffer = calloc (1, sizeof(ply_pixel_buffer_t));
+
+        buffer->reference_count = 1;
+        buffer->updated_areas = ply_region_new ();
+        buffer->bytes = bytes;
+        buffer->bytes_are_borrowed = true;
+        buffer->area.width = width;
+        buffer->area.height = height;
+
+        buffer->clip_areas = ply_list_new ();
+        ply_pixel_buffer_push_clip_area (buffer, &buffer->area);
+        buffer->is_opaque = false;
+
+        return buffer;
+}
+
 static void
 free_clip_areas (ply_pixel_buffer_t *buffer)
 {
@@ -271,14 +302,40 @@ free_clip_areas (ply_pixel_buffer_t *buffer)
         buffer->clip_areas = NULL;
 }
 
+/* Lets several owners share one buffer, for instance through the image
+ * cache.  Each of them calls ply_pixel_buffer_free () when done, and the
+ * buffer goes away with the last one.  A shared buffer shouldn't be drawn
+ * into, since everyone else sees the change too.
+ */
+ply_pixel_buffer_t *
+ply_pixel_buffer_ref (ply_pixel_buffer_t *buffer)
+{
+        assert (buffer != NULL);
+        assert (buffer->reference_count > 0);
+
+        buffer->reference_count++;
+
+        return buffer;
+}
+
 void
 ply_pixel_buffer_free (ply_pixel_buffer_t *buffer)
 {
         if (buffer == NULL)
                 return;
 
+        assert (buffer->reference_count > 0);
+
+        buffer->reference_count--;
+
+        if (buffer->reference_count > 0)
+                return;
+
         free_clip_areas (buffer);
-        free (buffer->bytes);
+
+        if (!buffer->bytes_are_borrowed)
+                free (buffer->bytes);
+
         ply_region_free (buffer->updated_areas);
         free (buffer);
 }
@@ -657,13 +714,19 @@ ply_pixel_buffer_blend_area (ply_pixel_buffer_t *canvas,
         }
 }
 
-void
-ply_pixel_buffer_fill_with_buffer_at_opacity_with_clip (ply_pixel_buffer_t *canvas,
-                                                        ply_pixel_buffer_t *source,
-                                                        int                 x_offset,
-                                                        int                 y_offset,
-                                                        ply_rectangle_t    *clip_area,
-                                                        float               opacity)
+/* Draws the part of source inside source_area with its top left corner
+ * at x_offset, y_offset.  Rows are stepped through with the source's
+ * own width, so source_area can be any piece of a bigger buffer, like
+ * one frame out of an atlas.
+ */
+static void
+ply_pixel_buffer_fill_with_buffer_area_at_opacity_with_clip (ply_pixel_buffer_t *canvas,
+                                                             ply_pixel_buffer_t *source,
+                                                             ply_rectangle_t    *source_area,
+                                                             int                 x_offset,
+                                                             int                 y_offset,
+                                                             ply_rectangle_t    *clip_area,
+                                                             float               opacity)
 {
         ply_rectangle_t cropped_area;
         unsigned long x;
@@ -671,11 +734,13 @@ ply_pixel_buffer_fill_with_buffer_at_opacity_with_clip (ply_pixel_buffer_t *canv
 
         assert (canvas != NULL);
         assert (source != NULL);
+        assert (source_area->x + source_area->width <= source->area.width);
+        assert (source_area->y + source_area->height <= source->area.height);
 
         cropped_area.x = x_offset;
         cropped_area.y = y_offset;
-        cropped_area.width = source->area.width;
-        cropped_area.height = source->area.height;
+        cropped_area.width = source_area->width;
+        cropped_area.height = source_area->height;
 
         ply_pixel_buffer_crop_area_to_clip_area (canvas, &cropped_area, &cropped_area);
 
@@ -685,8 +750,8 @@ ply_pixel_buffer_fill_with_buffer_at_opacity_with_clip (ply_pixel_buffer_t *canv
         if (cropped_area.width == 0 || cropped_area.height == 0)
                 return;
 
-        x = cropped_area.x - x_offset;
-        y = cropped_area.y - y_offset;
+        x = source_area->x + cropped_area.x - x_offset;
+        y = source_area->y + cropped_area.y - y_offset;
 
         if (opacity == 1.0 && ply_pixel_buffer_is_opaque (source))
                 ply_pixel_buffer_copy_area (canvas, source, x, y, &cropped_area);
@@ -697,6 +762,25 @@ ply_pixel_buffer_fill_with_buffer_at_opacity_with_clip (ply_pixel_buffer_t *canv
         ply_region_add_rectangle (canvas->updated_areas, &cropped_area);
 }
 
+void
+ply_pixel_buffer_fill_with_buffer_at_opacity_with_clip (ply_pixel_buffer_t *canvas,
+                                                        ply_pixel_buffer_t *source,
+                                                        int                 x_offset,
+                                                        int                 y_offset,
+                                                        ply_rectangle_t    *clip_area,
+                                                        float               opacity)
+{
+        assert (source != NULL);
+
+        ply_pixel_buffer_fill_with_buffer_area_at_opacity_with_clip (canvas,
+                                                                     source,
+                                                                     &source->area,
+                                                                     x_offset,
+                                                                     y_offset,
+                                                                     clip_area,
+                                                                     opacity);
+}
+
 void
 ply_pixel_buffer_fill_with_buffer_at_opacity (ply_pixel_buffer_t *canvas,
                                               ply_pixel_buffer_t *source,
@@ -741,6 +825,22 @@ ply_pixel_buffer_fill_with_buffer (ply_pixel_buffer_t *canvas,
                                                                 1.0);
 }
 
+void
+ply_pixel_buffer_fill_with_buffer_area (ply_pixel_buffer_t *canvas,
+                                        ply_pixel_buffer_t *source,
+                                        ply_rectangle_t    *source_area,
+                                        int                 x_offset,
+                                        int                 y_offset)
+{
+        ply_pixel_buffer_fill_with_buffer_area_at_opacity_with_clip (canvas,
+                                                                     source,
+                                                                     source_area,
+                                                                     x_offset,
+                                                                     y_offset,
+                                                                     NULL,
+                                                                     1.0);
+}
+
 uint32_t *
 ply_pixel_buffer_get_argb32_data (ply_pixel_buffer_t *buffer)
 {
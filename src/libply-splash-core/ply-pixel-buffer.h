@@ -40,6 +40,10 @@ typedef struct _ply_pixel_buffer ply_pixel_buffer_t;
 #ifndef PLY_HIDE_FUNCTION_DECLARATIONS
 ply_pixel_buffer_t *ply_pixel_buffer_new (unsigned long width,
                                           unsigned long height);
+ply_pixel_buffer_t *ply_pixel_buffer_new_with_data (unsigned long width,
+                                                    unsigned long height,
+                                                    uint32_t     *bytes);
+ply_pixel_buffer_t *ply_pixel_buffer_ref (ply_pixel_buffer_t *buffer);
 void ply_pixel_buffer_free (ply_pixel_buffer_t *buffer);
 void ply_pixel_buffer_get_size (ply_pixel_buffer_t *buffer,
                                 ply_rectangle_t    *size);
@@ -111,6 +115,11 @@ void ply_pixel_buffer_fill_with_buffer (ply_pixel_buffer_t *canvas,
                                         ply_pixel_buffer_t *source,
                                         int                 x_offset,
                                         int                 y_offset);
+void ply_pixel_buffer_fill_with_buffer_area (ply_pixel_buffer_t *canvas,
+                                             ply_pixel_buffer_t *source,
+                                             ply_rectangle_t    *source_area,
+                                             int                 x_offset,
+                                             int                 y_offset);
 
 
 void ply_pixel_buffer_push_clip_area (ply_pixel_buffer_t *buffer,
@@ -36,6 +36,8 @@
 #include <unistd.h>
 
 #include "ply-event-loop.h"
+#include "ply-frame-clock.h"
+#include "ply-frame-statistics.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-pixel-buffer.h"
@@ -96,10 +98,16 @@ ply_pixel_display_get_height (ply_pixel_display_t *display)
 static void
 ply_pixel_display_flush (ply_pixel_display_t *display)
 {
+        double start_time;
+
         if (display->pause_count > 0)
                 return;
 
+        start_time = ply_get_timestamp ();
         ply_renderer_flush_head (display->renderer, display->head);
+        ply_frame_statistics_add_sample (ply_frame_statistics_get_default (),
+                                         PLY_FRAME_STATISTICS_STAGE_FLUSH,
+                                         ply_get_timestamp () - start_time);
 }
 
 void
@@ -127,26 +135,47 @@ ply_pixel_display_draw_area (ply_pixel_display_t *display,
                              int                  width,
                              int                  height)
 {
+        ply_frame_statistics_t *statistics;
         ply_pixel_buffer_t *pixel_buffer;
+        double start_time;
+
+        statistics = ply_frame_statistics_get_default ();
+        start_time = ply_get_timestamp ();
 
         pixel_buffer = ply_renderer_get_buffer_for_head (display->renderer,
                                                          display->head);
 
         if (display->draw_handler != NULL) {
                 ply_rectangle_t clip_area;
+                double composite_start_time;
 
                 clip_area.x = x;
                 clip_area.y = y;
                 clip_area.width = width;
                 clip_area.height = height;
                 ply_pixel_buffer_push_clip_area (pixel_buffer, &clip_area);
+                composite_start_time = ply_get_timestamp ();
                 display->draw_handler (display->draw_handler_user_data,
                                        pixel_buffer,
                                        x, y, width, height, display);
+                ply_frame_statistics_add_sample (statistics,
+                                                 PLY_FRAME_STATISTICS_STAGE_COMPOSITE,
+                                                 ply_get_timestamp () - composite_start_time);
                 ply_pixel_buffer_pop_clip_area (pixel_buffer);
         }
 
+        if (width > 0 && height > 0) {
+                ply_frame_clock_report_damage (ply_frame_clock_get_default (),
+                                               (unsigned long) width * height);
+                ply_frame_statistics_add_damage (statistics,
+                                                 (unsigned long) width * height);
+        }
+
         ply_pixel_display_flush (display);
+
+        ply_frame_statistics_add_sample (statistics,
+                                         PLY_FRAME_STATISTICS_STAGE_DRAW,
+                                         ply_get_timestamp () - start_time);
 }
 
 void
@@ -22,7 +22,6 @@
 #include "config.h"
 
 #include <assert.h>
-#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
@@ -42,9 +41,9 @@
 
 #include "ply-animation.h"
 #include "ply-event-loop.h"
-#include "ply-array.h"
+#include "ply-frame-clock.h"
+#include "ply-frame-sequence.h"
 #include "ply-logger.h"
-#include "ply-image.h"
 #include "ply-pixel-buffer.h"
 #include "ply-utils.h"
 
@@ -56,25 +55,38 @@
 
 struct _ply_animation
 {
-        ply_array_t         *frames;
-        ply_event_loop_t    *loop;
-        char                *image_dir;
-        char                *frames_prefix;
-
-        ply_pixel_display_t *display;
-        ply_trigger_t       *stop_trigger;
-
-        int                  frame_number;
-        long                 x, y;
-        long                 width, height;
-        double               start_time, previous_time, now;
-        uint32_t             is_stopped : 1;
-        uint32_t             stop_requested : 1;
+        ply_frame_sequence_t *frames;
+        ply_frame_clock_t    *clock;
+
+        ply_pixel_display_t  *display;
+        ply_trigger_t        *stop_trigger;
+
+        int                   frame_number;
+        int                   drawn_frame_number;
+        long                  x, y;
+        double                start_time, previous_time, now;
+        uint32_t              is_stopped : 1;
+        uint32_t              stop_requested : 1;
 };
 
 static void ply_animation_stop_now (ply_animation_t *animation);
 
 
+/* A frame that wasn't ready in time got decoded, so show it
+ */
+static void
+on_frame_ready (ply_animation_t      *animation,
+                ply_frame_sequence_t *sequence)
+{
+        if (animation->is_stopped || animation->display == NULL)
+                return;
+
+        ply_pixel_display_draw_area (animation->display,
+                                     animation->x, animation->y,
+                                     ply_frame_sequence_get_width (sequence),
+                                     ply_frame_sequence_get_height (sequence));
+}
+
 ply_animation_t *
 ply_animation_new (const char *image_dir,
                    const char *frames_prefix)
@@ -86,31 +98,17 @@ ply_animation_new (const char *image_dir,
 
         animation = calloc (1, sizeof(ply_animation_t));
 
-        animation->frames = ply_array_new (PLY_ARRAY_ELEMENT_TYPE_POINTER);
-        animation->frames_prefix = strdup (frames_prefix);
-        animation->image_dir = strdup (image_dir);
+        animation->frames = ply_frame_sequence_new (image_dir, frames_prefix);
+        ply_frame_sequence_set_frame_ready_handler (animation->frames,
+                                                    (ply_frame_sequence_frame_ready_handler_t)
+                                                    on_frame_ready, animation);
         animation->frame_number = 0;
         animation->is_stopped = true;
         animation->stop_requested = false;
-        animation->width = 0;
-        animation->height = 0;
 
         return animation;
 }
 
-static void
-ply_animation_remove_frames (ply_animation_t *animation)
-{
-        int i;
-        ply_pixel_buffer_t **frames;
-
-        frames = (ply_pixel_buffer_t **) ply_array_steal_pointer_elements (animation->frames);
-        for (i = 0; frames[i] != NULL; i++) {
-                ply_pixel_buffer_free (frames[i]);
-        }
-        free (frames);
-}
-
 void
 ply_animation_free (ply_animation_t *animation)
 {
@@ -120,11 +118,7 @@ ply_animation_free (ply_animation_t *animation)
         if (!animation->is_stopped)
                 ply_animation_stop_now (animation);
 
-        ply_animation_remove_frames (animation);
-        ply_array_free (animation->frames);
-
-        free (animation->frames_prefix);
-        free (animation->image_dir);
+        ply_frame_sequence_free (animation->frames);
         free (animation);
 }
 
@@ -133,11 +127,10 @@ animate_at_time (ply_animation_t *animation,
                  double           time)
 {
         int number_of_frames;
-        ply_pixel_buffer_t *const *frames;
-        ply_rectangle_t frame_area;
+        ply_rectangle_t changed_area;
         bool should_continue;
 
-        number_of_frames = ply_array_get_size (animation->frames);
+        number_of_frames = ply_frame_sequence_get_number_of_frames (animation->frames);
 
         if (number_of_frames == 0)
                 return false;
@@ -149,18 +142,31 @@ animate_at_time (ply_animation_t *animation,
                 return false;
         }
 
+        /* The animation only plays once, so rather than skip ahead,
+         * hold the current frame until the next one has been decoded.
+         */
+        if (animation->frame_number >= ply_frame_sequence_get_number_of_loaded_frames (animation->frames))
+                return true;
+
         if (animation->stop_requested) {
                 ply_trace ("stopping animation in the middle of sequence");
                 should_continue = false;
         }
 
-        frames = (ply_pixel_buffer_t *const *) ply_array_get_pointer_elements (animation->frames);
-        ply_pixel_buffer_get_size (frames[animation->frame_number], &frame_area);
-
-        ply_pixel_display_draw_area (animation->display,
-                                     animation->x, animation->y,
-                                     frame_area.width,
-                                     frame_area.height);
+        /* Only redraw the part that's different from what's showing
+         */
+        ply_frame_sequence_get_changed_area (animation->frames,
+                                             animation->drawn_frame_number,
+                                             animation->frame_number,
+                                             &changed_area);
+        animation->drawn_frame_number = animation->frame_number;
+
+        if (changed_area.width != 0 && changed_area.height != 0)
+                ply_pixel_display_draw_area (animation->display,
+                                             animation->x + changed_area.x,
+                                             animation->y + changed_area.y,
+                                             changed_area.width,
+                                             changed_area.height);
 
         animation->frame_number++;
 
@@ -168,136 +174,47 @@ animate_at_time (ply_animation_t *animation,
 }
 
 static void
-on_timeout (ply_animation_t *animation)
+on_frame (ply_animation_t   *animation,
+          double             frame_time,
+          ply_frame_clock_t *clock)
 {
-        double sleep_time;
         bool should_continue;
 
         animation->previous_time = animation->now;
-        animation->now = ply_get_timestamp ();
+        animation->now = frame_time;
 
         should_continue = animate_at_time (animation,
                                            animation->now - animation->start_time);
 
-        sleep_time = 1.0 / FRAMES_PER_SECOND;
-        sleep_time = MAX (sleep_time - (ply_get_timestamp () - animation->now),
-                          0.005);
-
         if (!should_continue) {
+                ply_frame_clock_remove_handler (animation->clock,
+                                                (ply_frame_clock_handler_t)
+                                                on_frame, animation);
+
                 if (animation->stop_trigger != NULL) {
                         ply_trace ("firing off stop trigger");
                         ply_trigger_pull (animation->stop_trigger, NULL);
                         animation->stop_trigger = NULL;
                 }
-        } else {
-                ply_event_loop_watch_for_timeout (animation->loop,
-                                                  sleep_time,
-                                                  (ply_event_loop_timeout_handler_t)
-                                                  on_timeout, animation);
         }
 }
 
-static bool
-ply_animation_add_frame (ply_animation_t *animation,
-                         const char      *filename)
-{
-        ply_image_t *image;
-        ply_pixel_buffer_t *frame;
-
-        image = ply_image_new (filename);
-
-        if (!ply_image_load (image)) {
-                ply_image_free (image);
-                return false;
-        }
-
-        frame = ply_image_convert_to_pixel_buffer (image);
-
-        ply_array_add_pointer_element (animation->frames, frame);
-
-        animation->width = MAX (animation->width, (long) ply_pixel_buffer_get_width (frame));
-        animation->height = MAX (animation->height, (long) ply_pixel_buffer_get_height (frame));
-
-        return true;
-}
-
-static bool
-ply_animation_add_frames (ply_animation_t *animation)
+void
+ply_animation_set_frame_cache_size (ply_animation_t *animation,
+                                    size_t           cache_size)
 {
-        struct dirent **entries;
-        int number_of_entries;
-        int number_of_frames;
-        int i;
-        bool load_finished;
-
-        entries = NULL;
-
-        number_of_entries = scandir (animation->image_dir, &entries, NULL, versionsort);
-
-        if (number_of_entries <= 0)
-                return false;
-
-        load_finished = false;
-        for (i = 0; i < number_of_entries; i++) {
-                if (strncmp (entries[i]->d_name,
-                             animation->frames_prefix,
-                             strlen (animation->frames_prefix)) == 0
-                    && (strlen (entries[i]->d_name) > 4)
-                    && strcmp (entries[i]->d_name + strlen (entries[i]->d_name) - 4, ".png") == 0) {
-                        char *filename;
-
-                        filename = NULL;
-                        asprintf (&filename, "%s/%s", animation->image_dir, entries[i]->d_name);
-
-                        if (!ply_animation_add_frame (animation, filename))
-                                goto out;
-
-                        free (filename);
-                }
-
-                free (entries[i]);
-                entries[i] = NULL;
-        }
-
-        number_of_frames = ply_array_get_size (animation->frames);
-        if (number_of_frames == 0) {
-                ply_trace ("%s directory had no files starting with %s\n",
-                           animation->image_dir, animation->frames_prefix);
-                goto out;
-        } else {
-                ply_trace ("animation has %d frames\n", number_of_frames);
-        }
-
-        load_finished = true;
-
-out:
-        if (!load_finished) {
-                ply_animation_remove_frames (animation);
-
-                while (i < number_of_entries) {
-                        free (entries[i]);
-                        i++;
-                }
-        }
-        free (entries);
-
-        return (ply_array_get_size (animation->frames) > 0);
+        ply_frame_sequence_set_cache_size (animation->frames, cache_size);
 }
 
 bool
 ply_animation_load (ply_animation_t *animation)
 {
-        if (ply_array_get_size (animation->frames) != 0) {
-                ply_animation_remove_frames (animation);
+        if (ply_frame_sequence_get_number_of_frames (animation->frames) != 0)
                 ply_trace ("reloading animation with new set of frames");
-        } else {
+        else
                 ply_trace ("loading frames for animation");
-        }
-
-        if (!ply_animation_add_frames (animation))
-                return false;
 
-        return true;
+        return ply_frame_sequence_load (animation->frames);
 }
 
 bool
@@ -314,21 +231,22 @@ ply_animation_start (ply_animation_t     *animation,
 
         ply_trace ("starting animation");
 
-        animation->loop = ply_event_loop_get_default ();
+        animation->clock = ply_frame_clock_get_default ();
         animation->display = display;
         animation->stop_trigger = stop_trigger;
         animation->is_stopped = false;
         animation->stop_requested = false;
+        animation->drawn_frame_number = -1;
 
         animation->x = x;
         animation->y = y;
 
         animation->start_time = ply_get_timestamp ();
 
-        ply_event_loop_watch_for_timeout (animation->loop,
-                                          1.0 / FRAMES_PER_SECOND,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, animation);
+        ply_frame_clock_add_handler (animation->clock,
+                                     FRAMES_PER_SECOND,
+                                     (ply_frame_clock_handler_t)
+                                     on_frame, animation);
 
         return true;
 }
@@ -340,11 +258,11 @@ ply_animation_stop_now (ply_animation_t *animation)
 
         ply_trace ("stopping animation now");
 
-        if (animation->loop != NULL) {
-                ply_event_loop_stop_watching_for_timeout (animation->loop,
-                                                          (ply_event_loop_timeout_handler_t)
-                                                          on_timeout, animation);
-                animation->loop = NULL;
+        if (animation->clock != NULL) {
+                ply_frame_clock_remove_handler (animation->clock,
+                                                (ply_frame_clock_handler_t)
+                                                on_frame, animation);
+                animation->clock = NULL;
         }
 
         animation->display = NULL;
@@ -376,32 +294,25 @@ ply_animation_draw_area (ply_animation_t    *animation,
                          unsigned long       width,
                          unsigned long       height)
 {
-        ply_pixel_buffer_t *const *frames;
-        int number_of_frames;
-        int frame_index;
-
         if (animation->is_stopped)
                 return;
 
-        number_of_frames = ply_array_get_size (animation->frames);
-        frame_index = MIN (animation->frame_number, number_of_frames - 1);
-
-        frames = (ply_pixel_buffer_t *const *) ply_array_get_pointer_elements (animation->frames);
-        ply_pixel_buffer_fill_with_buffer (buffer,
-                                           frames[frame_index],
-                                           animation->x, animation->y);
+        ply_frame_sequence_draw_frame (animation->frames,
+                                       animation->frame_number,
+                                       buffer,
+                                       animation->x, animation->y);
 }
 
 long
 ply_animation_get_width (ply_animation_t *animation)
 {
-        return animation->width;
+        return ply_frame_sequence_get_width (animation->frames);
 }
 
 long
 ply_animation_get_height (ply_animation_t *animation)
 {
-        return animation->height;
+        return ply_frame_sequence_get_height (animation->frames);
 }
 
 /* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -37,6 +37,8 @@ ply_animation_t *ply_animation_new (const char *image_dir,
                                     const char *frames_prefix);
 void ply_animation_free (ply_animation_t *animation);
 
+void ply_animation_set_frame_cache_size (ply_animation_t *animation,
+                                         size_t           cache_size);
 bool ply_animation_load (ply_animation_t *animation);
 bool ply_animation_start (ply_animation_t     *animation,
                           ply_pixel_display_t *display,
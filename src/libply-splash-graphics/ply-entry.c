@@ -45,7 +45,7 @@
 #include "ply-array.h"
 #include "ply-label.h"
 #include "ply-logger.h"
-#include "ply-image.h"
+#include "ply-image-cache.h"
 #include "ply-pixel-buffer.h"
 #include "ply-pixel-display.h"
 #include "ply-utils.h"
@@ -62,8 +62,10 @@ struct _ply_entry
 
         ply_pixel_display_t *display;
         ply_rectangle_t      area;
-        ply_image_t         *text_field_image;
-        ply_image_t         *bullet_image;
+        char                *text_field_image_path;
+        char                *bullet_image_path;
+        ply_pixel_buffer_t  *text_field_buffer;
+        ply_pixel_buffer_t  *bullet_buffer;
         ply_label_t         *label;
 
         char                *text;
@@ -78,21 +80,13 @@ ply_entry_t *
 ply_entry_new (const char *image_dir)
 {
         ply_entry_t *entry;
-        char *image_path;
 
         assert (image_dir != NULL);
 
         entry = calloc (1, sizeof(ply_entry_t));
 
-        image_path = NULL;
-        asprintf (&image_path, "%s/entry.png", image_dir);
-        entry->text_field_image = ply_image_new (image_path);
-        free (image_path);
-
-        image_path = NULL;
-        asprintf (&image_path, "%s/bullet.png", image_dir);
-        entry->bullet_image = ply_image_new (image_path);
-        free (image_path);
+        asprintf (&entry->text_field_image_path, "%s/entry.png", image_dir);
+        asprintf (&entry->bullet_image_path, "%s/bullet.png", image_dir);
         entry->label = ply_label_new ();
         ply_label_set_color (entry->label, 0, 0, 0, 1);
 
@@ -110,8 +104,10 @@ ply_entry_free (ply_entry_t *entry)
 {
         if (entry == NULL)
                 return;
-        ply_image_free (entry->text_field_image);
-        ply_image_free (entry->bullet_image);
+        ply_pixel_buffer_free (entry->text_field_buffer);
+        ply_pixel_buffer_free (entry->bullet_buffer);
+        free (entry->text_field_image_path);
+        free (entry->bullet_image_path);
         ply_label_free (entry->label);
         free (entry->text);
 
@@ -123,8 +119,8 @@ get_max_number_of_visible_bullets (ply_entry_t *entry)
 {
         long bullet_width, text_field_width;
 
-        bullet_width = ply_image_get_width (entry->bullet_image);
-        text_field_width = ply_image_get_width (entry->text_field_image);
+        bullet_width = ply_pixel_buffer_get_width (entry->bullet_buffer);
+        text_field_width = ply_pixel_buffer_get_width (entry->text_field_buffer);
 
         return (int) (text_field_width / bullet_width) - ((text_field_width % bullet_width) < (bullet_width / 2) ? 1 : 0);
 }
@@ -132,14 +128,27 @@ get_max_number_of_visible_bullets (ply_entry_t *entry)
 bool
 ply_entry_load (ply_entry_t *entry)
 {
-        if (!ply_image_load (entry->text_field_image))
+        ply_image_cache_t *cache;
+
+        /* Every view has its own entry, but they all show the same
+         * images, so share one decoded copy of each
+         */
+        cache = ply_image_cache_get_default ();
+
+        if (entry->text_field_buffer == NULL)
+                entry->text_field_buffer = ply_image_cache_get_buffer (cache, entry->text_field_image_path, 0, 0, 0.0);
+
+        if (entry->text_field_buffer == NULL)
                 return false;
 
-        if (!ply_image_load (entry->bullet_image))
+        if (entry->bullet_buffer == NULL)
+                entry->bullet_buffer = ply_image_cache_get_buffer (cache, entry->bullet_image_path, 0, 0, 0.0);
+
+        if (entry->bullet_buffer == NULL)
                 return false;
 
-        entry->area.width = ply_image_get_width (entry->text_field_image);
-        entry->area.height = ply_image_get_height (entry->text_field_image);
+        entry->area.width = ply_pixel_buffer_get_width (entry->text_field_buffer);
+        entry->area.height = ply_pixel_buffer_get_height (entry->text_field_buffer);
 
         entry->max_number_of_visible_bullets = get_max_number_of_visible_bullets (entry);
 
@@ -172,7 +181,7 @@ ply_entry_draw_area (ply_entry_t        *entry,
         if (entry->is_hidden)
                 return;
 
-        text_field_buffer = ply_image_get_buffer (entry->text_field_image);
+        text_field_buffer = entry->text_field_buffer;
 
         ply_pixel_buffer_fill_with_buffer (pixel_buffer,
                                            text_field_buffer,
@@ -180,7 +189,7 @@ ply_entry_draw_area (ply_entry_t        *entry,
                                            entry->area.y);
 
         if (entry->is_password) {
-                bullet_buffer = ply_image_get_buffer (entry->bullet_image);
+                bullet_buffer = entry->bullet_buffer;
                 ply_pixel_buffer_get_size (bullet_buffer, &bullet_area);
 
                 if (entry->number_of_bullets <= entry->max_number_of_visible_bullets) {
@@ -0,0 +1,904 @@
+/* ply-frame-sequence.c - numbered animation frames loaded from a directory
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-frame-sequence.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ply-array.h"
+#include "ply-image.h"
+#include "ply-list.h"
+#include "ply-logger.h"
+#include "ply-pixel-buffer.h"
+#include "ply-utils.h"
+#include "ply-worker-pool.h"
+
+/* The frames of an animation are files named <prefix>NNNN.png, played
+ * in version sort order.
+ *
+ * Every frame is decoded on the worker pool.  Loading only waits for
+ * the first frame, so the animation can start showing right away, and
+ * the rest stream in while the splash is already up.  Until a frame is
+ * ready, asking for it gives back the last frame that is.  The size of
+ * the animation comes from the png headers (or the image pack) of all
+ * the frames, so it's known up front and doesn't change under a splash
+ * that has already been laid out around it.
+ *
+ * Keeping every decoded frame around for the whole boot can take a lot
+ * of memory for big animations on big screens, so a sequence can be
+ * given a cache size instead.  Then frames are only decoded when they
+ * are asked for, the least recently used ones are thrown away once the
+ * cache is full, and the next few frames after the one being shown are
+ * decoded ahead of time on the worker pool so playback doesn't have to
+ * wait for them.  If a frame still isn't ready when it's wanted, the
+ * last frame shown stands in for it and the frame ready handler is
+ * called once it has been decoded, so it can be drawn then.
+ *
+ * Without a cache, once every frame has been decoded they're all copied
+ * into one atlas, a single buffer with the frames stacked on top of each
+ * other, and the separately decoded images are freed.  Frames are then
+ * drawn straight out of their piece of the atlas.  Frames that came from
+ * an image pack already live in one mapped file, so copying them would
+ * only take more memory, and they're left where they are.
+ *
+ * As frames come in, each one is also compared with the frame before it
+ * to find the box around the pixels that changed, so playback only has
+ * to redraw and flush that part of the animation.
+ */
+
+#ifndef PLY_FRAME_SEQUENCE_PREFETCH_FRAMES
+#define PLY_FRAME_SEQUENCE_PREFETCH_FRAMES 4
+#endif
+
+typedef struct
+{
+        ply_frame_sequence_t *sequence;
+        char                 *filename;
+        ply_image_t          *image;
+        ply_list_node_t      *cache_node;
+        ply_rectangle_t       area;
+        ply_rectangle_t       changed_area;
+
+        uint32_t              is_loaded : 1;
+        uint32_t              is_pending : 1;
+        uint32_t              is_broken : 1;
+        uint32_t              is_wanted : 1;
+        uint32_t              has_changed_area : 1;
+} ply_frame_sequence_frame_t;
+
+struct _ply_frame_sequence
+{
+        char                                     *image_dir;
+        char                                     *frames_prefix;
+
+        ply_array_t                              *frames;
+        int                                       number_of_frames;
+        int                                       number_of_loaded_frames;
+
+        long                                      width, height;
+
+        ply_pixel_buffer_t                       *atlas;
+
+        ply_list_t                               *cache;
+        size_t                                    cache_size;
+        size_t                                    cached_bytes;
+
+        ply_frame_sequence_frame_ready_handler_t  frame_ready_handler;
+        void                                     *frame_ready_handler_user_data;
+};
+
+ply_frame_sequence_t *
+ply_frame_sequence_new (const char *image_dir,
+                        const char *frames_prefix)
+{
+        ply_frame_sequence_t *sequence;
+
+        assert (image_dir != NULL);
+        assert (frames_prefix != NULL);
+
+        sequence = calloc (1, sizeof(ply_frame_sequence_t));
+        sequence->image_dir = strdup (image_dir);
+        sequence->frames_prefix = strdup (frames_prefix);
+        sequence->frames = ply_array_new (PLY_ARRAY_ELEMENT_TYPE_POINTER);
+        sequence->cache = ply_list_new ();
+
+        return sequence;
+}
+
+/* A cache size of 0 (the default) means decode everything up front and
+ * keep it.  Takes effect the next time the sequence is loaded.
+ */
+void
+ply_frame_sequence_set_cache_size (ply_frame_sequence_t *sequence,
+                                   size_t                cache_size)
+{
+        assert (sequence != NULL);
+
+        sequence->cache_size = cache_size;
+}
+
+/* Only used with a frame cache, see above
+ */
+void
+ply_frame_sequence_set_frame_ready_handler (ply_frame_sequence_t                    *sequence,
+                                            ply_frame_sequence_frame_ready_handler_t handler,
+                                            void                                    *user_data)
+{
+        assert (sequence != NULL);
+
+        sequence->frame_ready_handler = handler;
+        sequence->frame_ready_handler_user_data = user_data;
+}
+
+static size_t
+get_frame_size_in_bytes (ply_frame_sequence_frame_t *frame)
+{
+        ply_pixel_buffer_t *buffer;
+
+        buffer = ply_image_get_buffer (frame->image);
+
+        return ply_pixel_buffer_get_width (buffer) * ply_pixel_buffer_get_height (buffer) * sizeof(uint32_t);
+}
+
+static void
+ply_frame_sequence_drop_frame (ply_frame_sequence_t       *sequence,
+                               ply_frame_sequence_frame_t *frame)
+{
+        if (frame->cache_node != NULL) {
+                sequence->cached_bytes -= get_frame_size_in_bytes (frame);
+                ply_list_remove_node (sequence->cache, frame->cache_node);
+                frame->cache_node = NULL;
+        }
+
+        ply_image_free (frame->image);
+        frame->image = NULL;
+        frame->is_loaded = false;
+        frame->is_pending = false;
+        frame->is_broken = false;
+        frame->is_wanted = false;
+}
+
+static void
+ply_frame_sequence_trim_cache (ply_frame_sequence_t *sequence)
+{
+        /* Always keep at least the most recently used frame, since it's
+         * probably on screen.
+         */
+        while (sequence->cached_bytes > sequence->cache_size &&
+               ply_list_get_length (sequence->cache) > 1) {
+                ply_list_node_t *node;
+                ply_frame_sequence_frame_t *frame;
+
+                node = ply_list_get_last_node (sequence->cache);
+                frame = (ply_frame_sequence_frame_t *) ply_list_node_get_data (node);
+
+                ply_frame_sequence_drop_frame (sequence, frame);
+        }
+}
+
+static void
+ply_frame_sequence_touch_frame (ply_frame_sequence_t       *sequence,
+                                ply_frame_sequence_frame_t *frame)
+{
+        if (frame->cache_node != NULL)
+                ply_list_remove_node (sequence->cache, frame->cache_node);
+        else
+                sequence->cached_bytes += get_frame_size_in_bytes (frame);
+
+        frame->cache_node = ply_list_prepend_data (sequence->cache, frame);
+}
+
+/* Frames that were only read ahead go to the back of the cache, so they
+ * don't push out frames that are being shown, and are the first to go
+ * if they never are
+ */
+static void
+ply_frame_sequence_add_prefetched_frame (ply_frame_sequence_t       *sequence,
+                                         ply_frame_sequence_frame_t *frame)
+{
+        assert (frame->cache_node == NULL);
+
+        sequence->cached_bytes += get_frame_size_in_bytes (frame);
+        frame->cache_node = ply_list_append_data (sequence->cache, frame);
+}
+
+void
+ply_frame_sequence_unload (ply_frame_sequence_t *sequence)
+{
+        ply_frame_sequence_frame_t **frames;
+        int i;
+
+        assert (sequence != NULL);
+
+        frames = (ply_frame_sequence_frame_t **) ply_array_steal_pointer_elements (sequence->frames);
+        for (i = 0; frames[i] != NULL; i++) {
+                ply_frame_sequence_drop_frame (sequence, frames[i]);
+                free (frames[i]->filename);
+                free (frames[i]);
+        }
+        free (frames);
+        assert (ply_list_get_length (sequence->cache) == 0);
+
+        ply_pixel_buffer_free (sequence->atlas);
+        sequence->atlas = NULL;
+
+        sequence->number_of_frames = 0;
+        sequence->number_of_loaded_frames = 0;
+        sequence->width = 0;
+        sequence->height = 0;
+}
+
+void
+ply_frame_sequence_free (ply_frame_sequence_t *sequence)
+{
+        if (sequence == NULL)
+                return;
+
+        ply_frame_sequence_unload (sequence);
+        ply_array_free (sequence->frames);
+        ply_list_free (sequence->cache);
+
+        free (sequence->frames_prefix);
+        free (sequence->image_dir);
+        free (sequence);
+}
+
+static void
+ply_frame_sequence_build_atlas (ply_frame_sequence_t *sequence)
+{
+        ply_frame_sequence_frame_t *const *frames;
+        unsigned long atlas_width, atlas_height;
+        uint32_t *atlas_bytes;
+        bool is_opaque;
+        int i;
+
+        frames = (ply_frame_sequence_frame_t *const *) ply_array_get_pointer_elements (sequence->frames);
+
+        atlas_width = 0;
+        atlas_height = 0;
+        is_opaque = true;
+        for (i = 0; i < sequence->number_of_frames; i++) {
+                ply_pixel_buffer_t *buffer;
+
+                buffer = ply_image_get_buffer (frames[i]->image);
+                atlas_width = MAX (atlas_width, ply_pixel_buffer_get_width (buffer));
+                atlas_height += ply_pixel_buffer_get_height (buffer);
+
+                if (!ply_pixel_buffer_is_opaque (buffer))
+                        is_opaque = false;
+        }
+
+        sequence->atlas = ply_pixel_buffer_new (atlas_width, atlas_height);
+        atlas_bytes = ply_pixel_buffer_get_argb32_data (sequence->atlas);
+
+        atlas_height = 0;
+        for (i = 0; i < sequence->number_of_frames; i++) {
+                ply_pixel_buffer_t *buffer;
+                uint32_t *bytes;
+                unsigned long row;
+
+                buffer = ply_image_get_buffer (frames[i]->image);
+                bytes = ply_pixel_buffer_get_argb32_data (buffer);
+
+                frames[i]->area.x = 0;
+                frames[i]->area.y = atlas_height;
+                frames[i]->area.width = ply_pixel_buffer_get_width (buffer);
+                frames[i]->area.height = ply_pixel_buffer_get_height (buffer);
+
+                for (row = 0; row < frames[i]->area.height; row++) {
+                        memcpy (atlas_bytes + (atlas_height + row) * atlas_width,
+                                bytes + row * frames[i]->area.width,
+                                frames[i]->area.width * sizeof(uint32_t));
+                }
+                atlas_height += frames[i]->area.height;
+
+                ply_image_free (frames[i]->image);
+                frames[i]->image = NULL;
+        }
+
+        /* Narrower frames leave transparent gaps, so the atlas can only be
+         * opaque if it has none of those.
+         */
+        for (i = 0; is_opaque && i < sequence->number_of_frames; i++) {
+                if (frames[i]->area.width != atlas_width)
+                        is_opaque = false;
+        }
+        ply_pixel_buffer_set_opaque (sequence->atlas, is_opaque);
+
+        ply_trace ("packed %d frames of %s/%s into a %lux%lu atlas",
+                   sequence->number_of_frames, sequence->image_dir,
+                   sequence->frames_prefix, atlas_width, atlas_height);
+}
+
+/* Finds the box around the pixels that differ between two frames
+ */
+static void
+compute_changed_area (ply_pixel_buffer_t *previous_buffer,
+                      ply_pixel_buffer_t *buffer,
+                      ply_rectangle_t    *changed_area)
+{
+        unsigned long width, height;
+        unsigned long left, right, top, bottom;
+        unsigned long x, y;
+        uint32_t *previous_bytes, *bytes;
+
+        width = ply_pixel_buffer_get_width (buffer);
+        height = ply_pixel_buffer_get_height (buffer);
+
+        changed_area->x = 0;
+        changed_area->y = 0;
+
+        if (width != ply_pixel_buffer_get_width (previous_buffer) ||
+            height != ply_pixel_buffer_get_height (previous_buffer)) {
+                changed_area->width = MAX (width, ply_pixel_buffer_get_width (previous_buffer));
+                changed_area->height = MAX (height, ply_pixel_buffer_get_height (previous_buffer));
+                return;
+        }
+
+        previous_bytes = ply_pixel_buffer_get_argb32_data (previous_buffer);
+        bytes = ply_pixel_buffer_get_argb32_data (buffer);
+
+        left = width;
+        right = 0;
+        top = height;
+        bottom = 0;
+        for (y = 0; y < height; y++) {
+                uint32_t *previous_row = previous_bytes + y * width;
+                uint32_t *row = bytes + y * width;
+
+                if (memcmp (previous_row, row, width * sizeof(uint32_t)) == 0)
+                        continue;
+
+                top = MIN (top, y);
+                bottom = y + 1;
+
+                x = 0;
+                while (x < left && previous_row[x] == row[x]) {
+                        x++;
+                }
+                left = x;
+
+                x = width;
+                while (x > right && previous_row[x - 1] == row[x - 1]) {
+                        x--;
+                }
+                right = x;
+        }
+
+        if (top >= bottom) {
+                changed_area->width = 0;
+                changed_area->height = 0;
+                return;
+        }
+
+        changed_area->x = left;
+        changed_area->y = top;
+        changed_area->width = right - left;
+        changed_area->height = bottom - top;
+}
+
+static void
+ply_frame_sequence_compare_frames (ply_frame_sequence_t       *sequence,
+                                   ply_frame_sequence_frame_t *previous_frame,
+                                   ply_frame_sequence_frame_t *frame)
+{
+        compute_changed_area (ply_image_get_buffer (previous_frame->image),
+                              ply_image_get_buffer (frame->image),
+                              &frame->changed_area);
+        frame->has_changed_area = true;
+}
+
+static bool
+ply_frame_sequence_has_frames_from_pack (ply_frame_sequence_t *sequence)
+{
+        ply_frame_sequence_frame_t *const *frames;
+        int i;
+
+        frames = (ply_frame_sequence_frame_t *const *) ply_array_get_pointer_elements (sequence->frames);
+
+        for (i = 0; i < sequence->number_of_frames; i++) {
+                if (ply_image_is_from_pack (frames[i]->image))
+                        return true;
+        }
+
+        return false;
+}
+
+static void
+ply_frame_sequence_update_loaded_frames (ply_frame_sequence_t *sequence)
+{
+        ply_frame_sequence_frame_t *const *frames;
+
+        frames = (ply_frame_sequence_frame_t *const *) ply_array_get_pointer_elements (sequence->frames);
+
+        /* Frames can finish out of order, but only hand out a frame once
+         * every frame before it is ready too.
+         */
+        while (sequence->number_of_loaded_frames < sequence->number_of_frames) {
+                ply_frame_sequence_frame_t *frame;
+
+                frame = frames[sequence->number_of_loaded_frames];
+
+                if (frame->is_pending)
+                        break;
+
+                if (!frame->is_loaded) {
+                        ply_trace ("could not load frame %d of %s/%s, stopping animation there",
+                                   sequence->number_of_loaded_frames,
+                                   sequence->image_dir, sequence->frames_prefix);
+                        sequence->number_of_frames = sequence->number_of_loaded_frames;
+                        break;
+                }
+
+                if (sequence->number_of_loaded_frames > 0)
+                        ply_frame_sequence_compare_frames (sequence,
+                                                           frames[sequence->number_of_loaded_frames - 1],
+                                                           frame);
+
+                sequence->number_of_loaded_frames++;
+        }
+
+        if (sequence->number_of_frames > 1 &&
+            sequence->number_of_loaded_frames == sequence->number_of_frames &&
+            !frames[0]->has_changed_area) {
+                /* For animations that loop back around
+                 */
+                ply_frame_sequence_compare_frames (sequence,
+                                                   frames[sequence->number_of_frames - 1],
+                                                   frames[0]);
+
+                if (!ply_frame_sequence_has_frames_from_pack (sequence))
+                        ply_frame_sequence_build_atlas (sequence);
+                else
+                        ply_trace ("frames of %s/%s came from an image pack, drawing them from there",
+                                   sequence->image_dir, sequence->frames_prefix);
+        }
+}
+
+static void
+on_frame_loaded (ply_frame_sequence_frame_t *frame,
+                 bool                        was_loaded,
+                 ply_image_t                *image)
+{
+        ply_frame_sequence_t *sequence = frame->sequence;
+
+        frame->is_pending = false;
+        frame->is_loaded = was_loaded;
+
+        if (sequence->cache_size == 0) {
+                ply_frame_sequence_update_loaded_frames (sequence);
+                return;
+        }
+
+        if (!was_loaded) {
+                ply_trace ("could not load %s, skipping it", frame->filename);
+                ply_image_free (frame->image);
+                frame->image = NULL;
+                frame->is_broken = true;
+                frame->is_wanted = false;
+                return;
+        }
+
+        if (!frame->is_wanted) {
+                ply_frame_sequence_add_prefetched_frame (sequence, frame);
+                ply_frame_sequence_trim_cache (sequence);
+                return;
+        }
+
+        frame->is_wanted = false;
+        ply_frame_sequence_touch_frame (sequence, frame);
+        ply_frame_sequence_trim_cache (sequence);
+
+        if (sequence->frame_ready_handler != NULL)
+                sequence->frame_ready_handler (sequence->frame_ready_handler_user_data,
+                                               sequence);
+}
+
+static void
+ply_frame_sequence_queue_frame (ply_frame_sequence_t       *sequence,
+                                ply_frame_sequence_frame_t *frame,
+                                ply_worker_pool_priority_t  priority)
+{
+        assert (frame->image == NULL);
+
+        frame->image = ply_image_new (frame->filename);
+        frame->is_pending = true;
+
+        ply_image_load_in_background (frame->image, priority,
+                                      (ply_image_load_handler_t)
+                                      on_frame_loaded,
+                                      frame);
+}
+
+static void
+ply_frame_sequence_add_frame (ply_frame_sequence_t *sequence,
+                              char                 *filename)
+{
+        ply_frame_sequence_frame_t *frame;
+        ply_worker_pool_priority_t priority;
+        long width, height;
+
+        frame = calloc (1, sizeof(ply_frame_sequence_frame_t));
+        frame->sequence = sequence;
+        frame->filename = filename;
+
+        if (ply_image_get_size_from_file (filename, &width, &height)) {
+                sequence->width = MAX (sequence->width, width);
+                sequence->height = MAX (sequence->height, height);
+        }
+
+        ply_array_add_pointer_element (sequence->frames, frame);
+        sequence->number_of_frames++;
+
+        /* With a cache, frames are only decoded once they're needed
+         */
+        if (sequence->cache_size != 0)
+                return;
+
+        if (sequence->number_of_frames == 1)
+                priority = PLY_WORKER_POOL_PRIORITY_HIGH;
+        else
+                priority = PLY_WORKER_POOL_PRIORITY_NORMAL;
+
+        ply_frame_sequence_queue_frame (sequence, frame, priority);
+}
+
+bool
+ply_frame_sequence_load (ply_frame_sequence_t *sequence)
+{
+        ply_frame_sequence_frame_t *const *frames;
+        ply_rectangle_t first_frame_size;
+        struct dirent **entries;
+        int number_of_entries;
+        int i;
+
+        assert (sequence != NULL);
+
+        if (ply_array_get_size (sequence->frames) != 0)
+                ply_frame_sequence_unload (sequence);
+
+        entries = NULL;
+
+        number_of_entries = scandir (sequence->image_dir, &entries, NULL, versionsort);
+
+        if (number_of_entries <= 0)
+                return false;
+
+        for (i = 0; i < number_of_entries; i++) {
+                if (strncmp (entries[i]->d_name,
+                             sequence->frames_prefix,
+                             strlen (sequence->frames_prefix)) == 0
+                    && (strlen (entries[i]->d_name) > 4)
+                    && strcmp (entries[i]->d_name + strlen (entries[i]->d_name) - 4, ".png") == 0) {
+                        char *filename;
+
+                        filename = NULL;
+                        asprintf (&filename, "%s/%s", sequence->image_dir, entries[i]->d_name);
+                        ply_frame_sequence_add_frame (sequence, filename);
+                }
+
+                free (entries[i]);
+        }
+        free (entries);
+
+        if (sequence->number_of_frames == 0) {
+                ply_trace ("%s directory had no files starting with %s",
+                           sequence->image_dir, sequence->frames_prefix);
+                return false;
+        }
+
+        ply_trace ("%s/%s has %d frames, waiting for the first one",
+                   sequence->image_dir, sequence->frames_prefix,
+                   sequence->number_of_frames);
+
+        frames = (ply_frame_sequence_frame_t *const *) ply_array_get_pointer_elements (sequence->frames);
+
+        if (sequence->cache_size != 0) {
+                ply_frame_sequence_queue_frame (sequence, frames[0], PLY_WORKER_POOL_PRIORITY_HIGH);
+                ply_image_wait_for_load (frames[0]->image);
+
+                if (!frames[0]->is_loaded) {
+                        ply_frame_sequence_unload (sequence);
+                        return false;
+                }
+
+                /* Every frame can be had on demand from here on
+                 */
+                sequence->number_of_loaded_frames = sequence->number_of_frames;
+        } else {
+                ply_image_wait_for_load (frames[0]->image);
+
+                if (sequence->number_of_loaded_frames == 0) {
+                        ply_frame_sequence_unload (sequence);
+                        return false;
+                }
+        }
+
+        /* In case the size couldn't be had from the png headers
+         */
+        if (ply_frame_sequence_get_frame_size (sequence, 0, &first_frame_size)) {
+                sequence->width = MAX (sequence->width, (long) first_frame_size.width);
+                sequence->height = MAX (sequence->height, (long) first_frame_size.height);
+        }
+
+        return true;
+}
+
+int
+ply_frame_sequence_get_number_of_frames (ply_frame_sequence_t *sequence)
+{
+        assert (sequence != NULL);
+
+        return sequence->number_of_frames;
+}
+
+int
+ply_frame_sequence_get_number_of_loaded_frames (ply_frame_sequence_t *sequence)
+{
+        assert (sequence != NULL);
+
+        return sequence->number_of_loaded_frames;
+}
+
+static void
+ply_frame_sequence_prefetch_frames (ply_frame_sequence_t              *sequence,
+                                    ply_frame_sequence_frame_t *const *frames,
+                                    int                                frame_number)
+{
+        size_t frame_size;
+        long number_of_frames_to_prefetch;
+        long i;
+
+        /* Don't read further ahead than the cache can hold, or the
+         * frames will just push each other out again before they're
+         * shown.
+         */
+        frame_size = sequence->width * sequence->height * sizeof(uint32_t);
+        number_of_frames_to_prefetch = PLY_FRAME_SEQUENCE_PREFETCH_FRAMES;
+        if (frame_size > 0)
+                number_of_frames_to_prefetch = MIN (number_of_frames_to_prefetch,
+                                                    (long) (sequence->cache_size / frame_size) - 1);
+        number_of_frames_to_prefetch = MIN (number_of_frames_to_prefetch,
+                                            sequence->number_of_frames - 1);
+
+        for (i = 1; i <= number_of_frames_to_prefetch; i++) {
+                ply_frame_sequence_frame_t *frame;
+
+                frame = frames[(frame_number + i) % sequence->number_of_frames];
+
+                if (frame->is_loaded || frame->is_pending || frame->is_broken)
+                        continue;
+
+                ply_frame_sequence_queue_frame (sequence, frame, PLY_WORKER_POOL_PRIORITY_NORMAL);
+        }
+}
+
+static ply_pixel_buffer_t *
+ply_frame_sequence_get_cached_frame (ply_frame_sequence_t              *sequence,
+                                     ply_frame_sequence_frame_t *const *frames,
+                                     int                                frame_number)
+{
+        ply_frame_sequence_frame_t *frame;
+
+        frame = frames[frame_number];
+
+        /* Decoding here would hold up the whole event loop, so ask for
+         * the frame to be drawn again once it's ready instead
+         */
+        if (!frame->is_loaded && !frame->is_broken) {
+                if (!frame->is_pending)
+                        ply_frame_sequence_queue_frame (sequence, frame, PLY_WORKER_POOL_PRIORITY_HIGH);
+
+                frame->is_wanted = true;
+        }
+
+        if (!frame->is_loaded) {
+                ply_list_node_t *node;
+
+                /* Keep showing whatever was shown last
+                 */
+                node = ply_list_get_first_node (sequence->cache);
+
+                if (node == NULL)
+                        return NULL;
+
+                frame = (ply_frame_sequence_frame_t *) ply_list_node_get_data (node);
+        }
+
+        ply_frame_sequence_touch_frame (sequence, frame);
+        ply_frame_sequence_prefetch_frames (sequence, frames, frame_number);
+
+        return ply_image_get_buffer (frame->image);
+}
+
+static ply_pixel_buffer_t *
+ply_frame_sequence_get_frame_buffer (ply_frame_sequence_t *sequence,
+                                     int                   frame_number)
+{
+        ply_frame_sequence_frame_t *const *frames;
+
+        frames = (ply_frame_sequence_frame_t *const *) ply_array_get_pointer_elements (sequence->frames);
+
+        if (sequence->cache_size != 0)
+                return ply_frame_sequence_get_cached_frame (sequence, frames, frame_number);
+
+        return ply_image_get_buffer (frames[frame_number]->image);
+}
+
+bool
+ply_frame_sequence_get_frame_size (ply_frame_sequence_t *sequence,
+                                   int                   frame_number,
+                                   ply_rectangle_t      *size)
+{
+        ply_pixel_buffer_t *buffer;
+
+        assert (sequence != NULL);
+        assert (size != NULL);
+
+        if (sequence->number_of_loaded_frames == 0)
+                return false;
+
+        frame_number = CLAMP (frame_number, 0, sequence->number_of_loaded_frames - 1);
+
+        if (sequence->atlas != NULL) {
+                ply_frame_sequence_frame_t *const *frames;
+
+                frames = (ply_frame_sequence_frame_t *const *) ply_array_get_pointer_elements (sequence->frames);
+                size->x = 0;
+                size->y = 0;
+                size->width = frames[frame_number]->area.width;
+                size->height = frames[frame_number]->area.height;
+                return true;
+        }
+
+        buffer = ply_frame_sequence_get_frame_buffer (sequence, frame_number);
+
+        if (buffer == NULL)
+                return false;
+
+        ply_pixel_buffer_get_size (buffer, size);
+        return true;
+}
+
+void
+ply_frame_sequence_draw_frame (ply_frame_sequence_t *sequence,
+                               int                   frame_number,
+                               ply_pixel_buffer_t   *canvas,
+                               long                  x,
+                               long                  y)
+{
+        ply_pixel_buffer_t *buffer;
+
+        assert (sequence != NULL);
+
+        if (sequence->number_of_loaded_frames == 0)
+                return;
+
+        frame_number = CLAMP (frame_number, 0, sequence->number_of_loaded_frames - 1);
+
+        if (sequence->atlas != NULL) {
+                ply_frame_sequence_frame_t *const *frames;
+
+                frames = (ply_frame_sequence_frame_t *const *) ply_array_get_pointer_elements (sequence->frames);
+                ply_pixel_buffer_fill_with_buffer_area (canvas, sequence->atlas,
+                                                        &frames[frame_number]->area,
+                                                        x, y);
+                return;
+        }
+
+        buffer = ply_frame_sequence_get_frame_buffer (sequence, frame_number);
+
+        if (buffer != NULL)
+                ply_pixel_buffer_fill_with_buffer (canvas, buffer, x, y);
+}
+
+/* Gives back the part of the animation, relative to its top left
+ * corner, that has to be redrawn to go from showing one frame to showing
+ * another.  from_frame_number can be -1 if nothing is showing yet.
+ */
+void
+ply_frame_sequence_get_changed_area (ply_frame_sequence_t *sequence,
+                                     int                   from_frame_number,
+                                     int                   to_frame_number,
+                                     ply_rectangle_t      *changed_area)
+{
+        ply_frame_sequence_frame_t *const *frames;
+        long left, right, top, bottom;
+        int frame_number;
+
+        assert (sequence != NULL);
+        assert (changed_area != NULL);
+
+        changed_area->x = 0;
+        changed_area->y = 0;
+        changed_area->width = sequence->width;
+        changed_area->height = sequence->height;
+
+        if (sequence->number_of_loaded_frames == 0)
+                return;
+
+        to_frame_number = CLAMP (to_frame_number, 0, sequence->number_of_loaded_frames - 1);
+
+        if (from_frame_number < 0 || from_frame_number >= sequence->number_of_loaded_frames)
+                return;
+
+        frames = (ply_frame_sequence_frame_t *const *) ply_array_get_pointer_elements (sequence->frames);
+
+        left = sequence->width;
+        right = 0;
+        top = sequence->height;
+        bottom = 0;
+        for (frame_number = from_frame_number; frame_number != to_frame_number; ) {
+                ply_frame_sequence_frame_t *frame;
+
+                frame_number = (frame_number + 1) % sequence->number_of_frames;
+
+                if (frame_number >= sequence->number_of_loaded_frames)
+                        return;
+
+                frame = frames[frame_number];
+
+                if (!frame->has_changed_area)
+                        return;
+
+                if (frame->changed_area.width == 0 || frame->changed_area.height == 0)
+                        continue;
+
+                left = MIN (left, frame->changed_area.x);
+                right = MAX (right, (long) (frame->changed_area.x + frame->changed_area.width));
+                top = MIN (top, frame->changed_area.y);
+                bottom = MAX (bottom, (long) (frame->changed_area.y + frame->changed_area.height));
+        }
+
+        if (left >= right || top >= bottom) {
+                changed_area->width = 0;
+                changed_area->height = 0;
+                return;
+        }
+
+        changed_area->x = left;
+        changed_area->y = top;
+        changed_area->width = right - left;
+        changed_area->height = bottom - top;
+}
+
+long
+ply_frame_sequence_get_width (ply_frame_sequence_t *sequence)
+{
+        assert (sequence != NULL);
+
+        return sequence->width;
+}
+
+long
+ply_frame_sequence_get_height (ply_frame_sequence_t *sequence)
+{
+        assert (sequence != NULL);
+
+        return sequence->height;
+}
+
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -0,0 +1,68 @@
+/* ply-frame-sequence.h - numbered animation frames loaded from a directory
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_FRAME_SEQUENCE_H
+#define PLY_FRAME_SEQUENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "ply-pixel-buffer.h"
+
+typedef struct _ply_frame_sequence ply_frame_sequence_t;
+
+typedef void (*ply_frame_sequence_frame_ready_handler_t) (void                 *user_data,
+                                                          ply_frame_sequence_t *sequence);
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_frame_sequence_t *ply_frame_sequence_new (const char *image_dir,
+                                              const char *frames_prefix);
+void ply_frame_sequence_free (ply_frame_sequence_t *sequence);
+void ply_frame_sequence_set_cache_size (ply_frame_sequence_t *sequence,
+                                        size_t                cache_size);
+void ply_frame_sequence_set_frame_ready_handler (ply_frame_sequence_t                    *sequence,
+                                                 ply_frame_sequence_frame_ready_handler_t handler,
+                                                 void                                    *user_data);
+
+bool ply_frame_sequence_load (ply_frame_sequence_t *sequence);
+void ply_frame_sequence_unload (ply_frame_sequence_t *sequence);
+
+int ply_frame_sequence_get_number_of_frames (ply_frame_sequence_t *sequence);
+int ply_frame_sequence_get_number_of_loaded_frames (ply_frame_sequence_t *sequence);
+bool ply_frame_sequence_get_frame_size (ply_frame_sequence_t *sequence,
+                                        int                   frame_number,
+                                        ply_rectangle_t      *size);
+void ply_frame_sequence_draw_frame (ply_frame_sequence_t *sequence,
+                                    int                   frame_number,
+                                    ply_pixel_buffer_t   *canvas,
+                                    long                  x,
+                                    long                  y);
+
+void ply_frame_sequence_get_changed_area (ply_frame_sequence_t *sequence,
+                                          int                   from_frame_number,
+                                          int                   to_frame_number,
+                                          ply_rectangle_t      *changed_area);
+
+long ply_frame_sequence_get_width (ply_frame_sequence_t *sequence);
+long ply_frame_sequence_get_height (ply_frame_sequence_t *sequence);
+#endif
+
+#endif /* PLY_FRAME_SEQUENCE_H */
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -0,0 +1,356 @@
+/* ply-image-cache.c - decoded images shared across a splash
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-image-cache.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ply-hashtable.h"
+#include "ply-image.h"
+#include "ply-list.h"
+#include "ply-logger.h"
+#include "ply-pixel-buffer.h"
+#include "ply-utils.h"
+
+/* Splashes tend to load the same few images over and over: every view
+ * gets its own entry with its own copy of entry.png and bullet.png, and
+ * scripts often call Image () from inside their refresh callbacks.  The
+ * cache hands out shared references to one decoded copy instead,
+ * along with scaled and rotated versions of it.
+ *
+ * Buffers from the cache are shared, so they must not be drawn into.
+ *
+ * Entries are kept in least recently used order and the oldest ones
+ * are dropped once the cache holds more than PLY_IMAGE_CACHE_SIZE bytes
+ * of pixels, so a script spinning an image through every possible angle
+ * can't make it grow forever.  Dropping an entry only drops the cache's
+ * reference; anyone still using the buffer keeps it.
+ *
+ * The cache is only meant to be used from the event loop thread.
+ */
+
+#ifndef PLY_IMAGE_CACHE_SIZE
+#define PLY_IMAGE_CACHE_SIZE (32 * 1024 * 1024)
+#endif
+
+typedef struct
+{
+        char               *key;
+        char               *filename;
+        long                width, height;
+        double              rotation;
+
+        ply_pixel_buffer_t *buffer;
+        size_t              size;
+        ply_list_node_t    *node;
+} ply_image_cache_entry_t;
+
+struct _ply_image_cache
+{
+        ply_hashtable_t *entries;
+        ply_hashtable_t *entries_by_buffer;
+        ply_list_t      *recently_used_entries;
+        size_t           size;
+
+        unsigned long    number_of_hits;
+        unsigned long    number_of_misses;
+};
+
+static ply_image_cache_t *default_cache = NULL;
+
+ply_image_cache_t *
+ply_image_cache_new (void)
+{
+        ply_image_cache_t *cache;
+
+        cache = calloc (1, sizeof(ply_image_cache_t));
+        cache->entries = ply_hashtable_new (ply_hashtable_string_hash,
+                                            ply_hashtable_string_compare);
+        cache->entries_by_buffer = ply_hashtable_new (ply_hashtable_direct_hash,
+                                                      ply_hashtable_direct_compare);
+        cache->recently_used_entries = ply_list_new ();
+
+        return cache;
+}
+
+ply_image_cache_t *
+ply_image_cache_get_default (void)
+{
+        if (default_cache == NULL)
+                default_cache = ply_image_cache_new ();
+
+        return default_cache;
+}
+
+static void
+ply_image_cache_remove_entry (ply_image_cache_t       *cache,
+                              ply_image_cache_entry_t *entry)
+{
+        ply_hashtable_remove (cache->entries, entry->key);
+
+        if (entry->buffer != NULL)
+                ply_hashtable_remove (cache->entries_by_buffer, entry->buffer);
+
+        ply_list_remove_node (cache->recently_used_entries, entry->node);
+        cache->size -= entry->size;
+
+        ply_pixel_buffer_free (entry->buffer);
+        free (entry->filename);
+        free (entry->key);
+        free (entry);
+}
+
+void
+ply_image_cache_clear (ply_image_cache_t *cache)
+{
+        ply_list_node_t *node;
+
+        assert (cache != NULL);
+
+        ply_trace ("dropping %d cached images after %lu hits and %lu misses",
+                   ply_list_get_length (cache->recently_used_entries),
+                   cache->number_of_hits, cache->number_of_misses);
+
+        while ((node = ply_list_get_first_node (cache->recently_used_entries)) != NULL) {
+                ply_image_cache_remove_entry (cache, ply_list_node_get_data (node));
+        }
+}
+
+void
+ply_image_cache_free (ply_image_cache_t *cache)
+{
+        if (cache == NULL)
+                return;
+
+        ply_image_cache_clear (cache);
+
+        ply_list_free (cache->recently_used_entries);
+        ply_hashtable_free (cache->entries_by_buffer);
+        ply_hashtable_free (cache->entries);
+
+        if (cache == default_cache)
+                default_cache = NULL;
+
+        free (cache);
+}
+
+static void
+ply_image_cache_trim (ply_image_cache_t *cache)
+{
+        /* The entry just added is at the front and always stays
+         */
+        while (cache->size > PLY_IMAGE_CACHE_SIZE &&
+               ply_list_get_length (cache->recently_used_entries) > 1) {
+                ply_list_node_t *node;
+
+                node = ply_list_get_last_node (cache->recently_used_entries);
+                ply_image_cache_remove_entry (cache, ply_list_node_get_data (node));
+        }
+}
+
+static ply_pixel_buffer_t *
+load_buffer (ply_image_cache_t *cache,
+             const char        *filename,
+             long               width,
+             long               height,
+             double             rotation)
+{
+        ply_pixel_buffer_t *original_buffer, *buffer;
+        ply_image_t *image;
+
+        if (width == 0 && height == 0 && rotation == 0.0) {
+                image = ply_image_new (filename);
+
+                if (!ply_image_load (image)) {
+                        ply_image_free (image);
+                        return NULL;
+                }
+
+                return ply_image_convert_to_pixel_buffer (image);
+        }
+
+        if (rotation != 0.0)
+                original_buffer = ply_image_cache_get_buffer (cache, filename, width, height, 0.0);
+        else
+                original_buffer = ply_image_cache_get_buffer (cache, filename, 0, 0, 0.0);
+
+        if (original_buffer == NULL)
+                return NULL;
+
+        if (rotation != 0.0) {
+                buffer = ply_pixel_buffer_rotate (original_buffer,
+                                                  ply_pixel_buffer_get_width (original_buffer) / 2,
+                                                  ply_pixel_buffer_get_height (original_buffer) / 2,
+                                                  rotation);
+        } else {
+                buffer = ply_pixel_buffer_resize (original_buffer,
+                                                  width != 0 ? width : (long) ply_pixel_buffer_get_width (original_buffer),
+                                                  height != 0 ? height : (long) ply_pixel_buffer_get_height (original_buffer));
+        }
+
+        ply_pixel_buffer_free (original_buffer);
+
+        return buffer;
+}
+
+/* Returns a reference to the image in filename, scaled to width by
+ * height and then rotated by rotation radians around its center.  A
+ * width or height of 0 keeps the image's own, and a rotation of 0
+ * leaves it upright.  The reference is dropped with
+ * ply_pixel_buffer_free ().  Images that can't be loaded give NULL,
+ * and that's remembered too.
+ */
+ply_pixel_buffer_t *
+ply_image_cache_get_buffer (ply_image_cache_t *cache,
+                            const char        *filename,
+                            long               width,
+                            long               height,
+                            double             rotation)
+{
+        ply_image_cache_entry_t *entry;
+        char *key;
+
+        assert (cache != NULL);
+        assert (filename != NULL);
+
+        width = MAX (width, 0);
+        height = MAX (height, 0);
+
+        key = NULL;
+        asprintf (&key, "%s\n%ldx%ld\n%.6f", filename, width, height, rotation);
+
+        entry = ply_hashtable_lookup (cache->entries, key);
+
+        if (entry != NULL) {
+                free (key);
+                cache->number_of_hits++;
+
+                ply_list_remove_node (cache->recently_used_entries, entry->node);
+                entry->node = ply_list_prepend_data (cache->recently_used_entries, entry);
+
+                if (entry->buffer == NULL)
+                        return NULL;
+
+                return ply_pixel_buffer_ref (entry->buffer);
+        }
+
+        cache->number_of_misses++;
+
+        entry = calloc (1, sizeof(ply_image_cache_entry_t));
+        entry->key = key;
+        entry->filename = strdup (filename);
+        entry->width = width;
+        entry->height = height;
+        entry->rotation = rotation;
+        entry->buffer = load_buffer (cache, filename, width, height, rotation);
+
+        if (entry->buffer != NULL) {
+                entry->size = ply_pixel_buffer_get_width (entry->buffer) *
+                              ply_pixel_buffer_get_height (entry->buffer) *
+                              sizeof(uint32_t);
+                ply_hashtable_insert (cache->entries_by_buffer, entry->buffer, entry);
+        }
+
+        ply_hashtable_insert (cache->entries, entry->key, entry);
+        entry->node = ply_list_prepend_data (cache->recently_used_entries, entry);
+        cache->size += entry->size;
+
+        ply_image_cache_trim (cache);
+
+        if (entry->buffer == NULL)
+                return NULL;
+
+        return ply_pixel_buffer_ref (entry->buffer);
+}
+
+/* Like ply_pixel_buffer_resize (), but if buffer came from the cache
+ * the result is looked up in, and added to, the cache too.  Either way
+ * the caller gets a reference it has to free.
+ */
+ply_pixel_buffer_t *
+ply_image_cache_resize_buffer (ply_image_cache_t  *cache,
+                               ply_pixel_buffer_t *buffer,
+                               long                width,
+                               long                height)
+{
+        ply_image_cache_entry_t *entry;
+
+        assert (cache != NULL);
+        assert (buffer != NULL);
+
+        entry = ply_hashtable_lookup (cache->entries_by_buffer, buffer);
+
+        /* Scaling happens before rotating in the cache, so a rotated
+         * image can't be scaled from its original.
+         */
+        if (entry == NULL || entry->rotation != 0.0 || width <= 0 || height <= 0)
+                return ply_pixel_buffer_resize (buffer, width, height);
+
+        return ply_image_cache_get_buffer (cache, entry->filename, width, height, 0.0);
+}
+
+/* Like ply_pixel_buffer_rotate () around the center of buffer, going
+ * through the cache when buffer came from it.
+ */
+ply_pixel_buffer_t *
+ply_image_cache_rotate_buffer (ply_image_cache_t  *cache,
+                               ply_pixel_buffer_t *buffer,
+                               double              rotation)
+{
+        ply_image_cache_entry_t *entry;
+
+        assert (cache != NULL);
+        assert (buffer != NULL);
+
+        entry = ply_hashtable_lookup (cache->entries_by_buffer, buffer);
+
+        if (entry == NULL || entry->rotation != 0.0)
+                return ply_pixel_buffer_rotate (buffer,
+                                                ply_pixel_buffer_get_width (buffer) / 2,
+                                                ply_pixel_buffer_get_height (buffer) / 2,
+                                                rotation);
+
+        return ply_image_cache_get_buffer (cache, entry->filename,
+                                           entry->width, entry->height,
+                                           rotation);
+}
+
+unsigned long
+ply_image_cache_get_number_of_hits (ply_image_cache_t *cache)
+{
+        assert (cache != NULL);
+
+        return cache->number_of_hits;
+}
+
+unsigned long
+ply_image_cache_get_number_of_misses (ply_image_cache_t *cache)
+{
+        assert (cache != NULL);
+
+        return cache->number_of_misses;
+}
+
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -0,0 +1,55 @@
+/* ply-image-cache.h - decoded images shared across a splash
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_IMAGE_CACHE_H
+#define PLY_IMAGE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "ply-pixel-buffer.h"
+
+typedef struct _ply_image_cache ply_image_cache_t;
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_image_cache_t *ply_image_cache_new (void);
+void ply_image_cache_free (ply_image_cache_t *cache);
+ply_image_cache_t *ply_image_cache_get_default (void);
+
+ply_pixel_buffer_t *ply_image_cache_get_buffer (ply_image_cache_t *cache,
+                                                const char        *filename,
+                                                long               width,
+                                                long               height,
+                                                double             rotation);
+ply_pixel_buffer_t *ply_image_cache_resize_buffer (ply_image_cache_t  *cache,
+                                                   ply_pixel_buffer_t *buffer,
+                                                   long                width,
+                                                   long                height);
+ply_pixel_buffer_t *ply_image_cache_rotate_buffer (ply_image_cache_t  *cache,
+                                                   ply_pixel_buffer_t *buffer,
+                                                   double              rotation);
+void ply_image_cache_clear (ply_image_cache_t *cache);
+
+unsigned long ply_image_cache_get_number_of_hits (ply_image_cache_t *cache);
+unsigned long ply_image_cache_get_number_of_misses (ply_image_cache_t *cache);
+#endif
+
+#endif /* PLY_IMAGE_CACHE_H */
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -0,0 +1,608 @@
+/* ply-image-pack.c - precompiled theme images that can be mapped in
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-image-pack.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ply-hashtable.h"
+#include "ply-image.h"
+#include "ply-logger.h"
+#include "ply-pixel-buffer.h"
+#include "ply-utils.h"
+
+/* An image pack holds the images of a theme already decoded to
+ * premultiplied ARGB32, the same format ply_image_load () produces, so
+ * that at boot the pixel buffers can point straight into the mapped
+ * file instead of running every png through libpng.
+ *
+ * The pack is written by plymouth-build-image-pack when the initrd is
+ * put together, on the machine that's going to read it, so everything
+ * is stored in native byte order.  The byte order mark and the version
+ * in the header catch packs that were made somewhere else or by an
+ * older plymouth.
+ *
+ * Each entry remembers the size and modification time of the png it
+ * was made from.  If the png has changed since, the entry is ignored
+ * and the png gets loaded as usual.  Only whole seconds of the
+ * modification time are kept, since that's all the cpio archive the
+ * initrd is made of holds on to.
+ *
+ * Packs are opened and read from ply_image_load (), which can run on
+ * worker threads, so nothing on the reading side traces.  Background
+ * loads say whether the pack was used once they're back on the main
+ * thread.
+ *
+ * Layout:
+ *
+ *   header
+ *   entries, sorted by name
+ *   names, nul terminated
+ *   for each image, aligned to PLY_IMAGE_PACK_ALIGNMENT:
+ *     width * height pixels
+ */
+
+#define PLY_IMAGE_PACK_MAGIC "PLYPACK"
+#define PLY_IMAGE_PACK_BYTE_ORDER_MARK 0x01020304
+#define PLY_IMAGE_PACK_VERSION 3
+#define PLY_IMAGE_PACK_ALIGNMENT 64
+
+typedef enum
+{
+        PLY_IMAGE_PACK_ENTRY_FLAG_OPAQUE = 1 << 0,
+} ply_image_pack_entry_flag_t;
+
+typedef struct
+{
+        char     magic[8];
+        uint32_t byte_order_mark;
+        uint32_t version;
+        uint32_t number_of_entries;
+        uint32_t reserved;
+} ply_image_pack_header_t;
+
+typedef struct
+{
+        uint64_t name_offset;
+        uint64_t data_offset;
+        uint64_t source_size;
+        int64_t  source_modification_time;
+        uint32_t width;
+        uint32_t height;
+        uint32_t flags;
+        uint32_t reserved;
+} ply_image_pack_entry_t;
+
+struct _ply_image_pack
+{
+        char                          *filename;
+        uint8_t                       *map_address;
+        size_t                         map_size;
+
+        const ply_image_pack_header_t *header;
+        const ply_image_pack_entry_t  *entries;
+};
+
+static pthread_mutex_t packs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ply_hashtable_t *packs = NULL;
+
+static bool
+ply_image_pack_validate (ply_image_pack_t *pack)
+{
+        const ply_image_pack_header_t *header;
+        size_t entries_size;
+
+        if (pack->map_size < sizeof(ply_image_pack_header_t))
+                return false;
+
+        header = (const ply_image_pack_header_t *) pack->map_address;
+
+        if (memcmp (header->magic, PLY_IMAGE_PACK_MAGIC, sizeof(PLY_IMAGE_PACK_MAGIC)) != 0)
+                return false;
+
+        if (header->byte_order_mark != PLY_IMAGE_PACK_BYTE_ORDER_MARK)
+                return false;
+
+        if (header->version != PLY_IMAGE_PACK_VERSION)
+                return false;
+
+        entries_size = (size_t) header->number_of_entries * sizeof(ply_image_pack_entry_t);
+
+        if (entries_size / sizeof(ply_image_pack_entry_t) != header->number_of_entries ||
+            pack->map_size - sizeof(ply_image_pack_header_t) < entries_size)
+                return false;
+
+        pack->header = header;
+        pack->entries = (const ply_image_pack_entry_t *) (header + 1);
+
+        return true;
+}
+
+ply_image_pack_t *
+ply_image_pack_open (const char *filename)
+{
+        ply_image_pack_t *pack;
+        struct stat file_info;
+        void *map_address;
+        int fd;
+
+        assert (filename != NULL);
+
+        fd = open (filename, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+                return NULL;
+
+        if (fstat (fd, &file_info) < 0 || file_info.st_size <= 0) {
+                close (fd);
+                return NULL;
+        }
+
+        /* Mapped privately and writable because some plugins scribble on
+         * their images.  The pages stay shared with the page cache unless
+         * that happens.
+         */
+        map_address = mmap (NULL, file_info.st_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE, fd, 0);
+        close (fd);
+
+        if (map_address == MAP_FAILED)
+                return NULL;
+
+        pack = calloc (1, sizeof(ply_image_pack_t));
+        pack->filename = strdup (filename);
+        pack->map_address = map_address;
+        pack->map_size = file_info.st_size;
+
+        if (!ply_image_pack_validate (pack)) {
+                ply_image_pack_close (pack);
+                return NULL;
+        }
+
+        return pack;
+}
+
+void
+ply_image_pack_close (ply_image_pack_t *pack)
+{
+        if (pack == NULL)
+                return;
+
+        munmap (pack->map_address, pack->map_size);
+        free (pack->filename);
+        free (pack);
+}
+
+/* Packs found here are kept mapped for as long as the process runs,
+ * since the pixel buffers handed out point into them.  Directories
+ * without a usable pack are remembered too, so they're only looked at
+ * once.
+ */
+ply_image_pack_t *
+ply_image_pack_get_for_directory (const char *directory)
+{
+        ply_image_pack_t *pack;
+        void *key, *data;
+        char *filename;
+
+        assert (directory != NULL);
+
+        pthread_mutex_lock (&packs_mutex);
+
+        if (packs == NULL)
+                packs = ply_hashtable_new (ply_hashtable_string_hash,
+                                           ply_hashtable_string_compare);
+
+        if (ply_hashtable_lookup_full (packs, (void *) directory, &key, &data)) {
+                pthread_mutex_unlock (&packs_mutex);
+                return data;
+        }
+
+        filename = NULL;
+        asprintf (&filename, "%s/%s", directory, PLY_IMAGE_PACK_FILENAME);
+        pack = ply_image_pack_open (filename);
+        free (filename);
+
+        ply_hashtable_insert (packs, strdup (directory), pack);
+
+        pthread_mutex_unlock (&packs_mutex);
+
+        return pack;
+}
+
+static const char *
+ply_image_pack_get_entry_name (ply_image_pack_t             *pack,
+                               const ply_image_pack_entry_t *entry)
+{
+        if (entry->name_offset >= pack->map_size)
+                return NULL;
+
+        if (memchr (pack->map_address + entry->name_offset, '\0',
+                    pack->map_size - entry->name_offset) == NULL)
+                return NULL;
+
+        return (const char *) pack->map_address + entry->name_offset;
+}
+
+static const ply_image_pack_entry_t *
+ply_image_pack_find_entry (ply_image_pack_t *pack,
+                           const char       *name)
+{
+        long low, high;
+
+        low = 0;
+        high = (long) pack->header->number_of_entries - 1;
+
+        while (low <= high) {
+                const ply_image_pack_entry_t *entry;
+                const char *entry_name;
+                long middle;
+                int result;
+
+                middle = low + (high - low) / 2;
+                entry = &pack->entries[middle];
+
+                entry_name = ply_image_pack_get_entry_name (pack, entry);
+
+                if (entry_name == NULL)
+                        return NULL;
+
+                result = strcmp (name, entry_name);
+
+                if (result == 0)
+                        return entry;
+
+                if (result < 0)
+                        high = middle - 1;
+                else
+                        low = middle + 1;
+        }
+
+        return NULL;
+}
+
+static bool
+ply_image_pack_entry_is_valid (ply_image_pack_t             *pack,
+                               const ply_image_pack_entry_t *entry)
+{
+        uint64_t data_size;
+
+        if (entry->width == 0 || entry->height == 0)
+                return false;
+
+        data_size = (uint64_t) entry->width * entry->height * sizeof(uint32_t);
+
+        if (entry->data_offset % sizeof(uint32_t) != 0 ||
+            entry->data_offset > pack->map_size ||
+            data_size > pack->map_size - entry->data_offset)
+                return false;
+
+        return true;
+}
+
+static bool
+ply_image_pack_entry_is_stale (const ply_image_pack_entry_t *entry,
+                               const char                   *filename)
+{
+        struct stat file_info;
+
+        /* The pack can stand in for pngs that didn't get installed
+         */
+        if (stat (filename, &file_info) < 0)
+                return errno != ENOENT;
+
+        if ((uint64_t) file_info.st_size != entry->source_size)
+                return true;
+
+        if ((int64_t) file_info.st_mtim.tv_sec != entry->source_modification_time)
+                return true;
+
+        return false;
+}
+
+static const ply_image_pack_entry_t *
+ply_image_pack_lookup (ply_image_pack_t *pack,
+                       const char       *filename)
+{
+        const ply_image_pack_entry_t *entry;
+        const char *name;
+
+        name = strrchr (filename, '/');
+
+        if (name != NULL)
+                name++;
+        else
+                name = filename;
+
+        entry = ply_image_pack_find_entry (pack, name);
+
+        if (entry == NULL)
+                return NULL;
+
+        if (!ply_image_pack_entry_is_valid (pack, entry))
+                return NULL;
+
+        if (ply_image_pack_entry_is_stale (entry, filename))
+                return NULL;
+
+        return entry;
+}
+
+/* Returns a pixel buffer for the png at filename, if the pack has an up
+ * to date copy of it.  The buffer doesn't own its pixels, they live in
+ * the pack.
+ */
+ply_pixel_buffer_t *
+ply_image_pack_get_buffer (ply_image_pack_t *pack,
+                           const char       *filename)
+{
+        const ply_image_pack_entry_t *entry;
+        ply_pixel_buffer_t *buffer;
+
+        assert (pack != NULL);
+        assert (filename != NULL);
+
+        entry = ply_image_pack_lookup (pack, filename);
+
+        if (entry == NULL)
+                return NULL;
+
+        buffer = ply_pixel_buffer_new_with_data (entry->width, entry->height,
+                                                 (uint32_t *) (pack->map_address + entry->data_offset));
+
+        if (entry->flags & PLY_IMAGE_PACK_ENTRY_FLAG_OPAQUE)
+                ply_pixel_buffer_set_opaque (buffer, true);
+
+        return buffer;
+}
+
+bool
+ply_image_pack_get_size (ply_image_pack_t *pack,
+                         const char       *filename,
+                         long             *width,
+                         long             *height)
+{
+        const ply_image_pack_entry_t *entry;
+
+        assert (pack != NULL);
+        assert (filename != NULL);
+
+        entry = ply_image_pack_lookup (pack, filename);
+
+        if (entry == NULL)
+                return false;
+
+        *width = entry->width;
+        *height = entry->height;
+
+        return true;
+}
+
+typedef struct
+{
+        const char            *name;
+        ply_image_t           *image;
+        ply_image_pack_entry_t entry;
+} ply_image_pack_writer_image_t;
+
+static int
+compare_images (const void *element_a,
+                const void *element_b)
+{
+        const ply_image_pack_writer_image_t *image_a = element_a;
+        const ply_image_pack_writer_image_t *image_b = element_b;
+
+        return strcmp (image_a->name, image_b->name);
+}
+
+static uint64_t
+align_offset (uint64_t offset)
+{
+        return (offset + PLY_IMAGE_PACK_ALIGNMENT - 1) & ~((uint64_t) PLY_IMAGE_PACK_ALIGNMENT - 1);
+}
+
+static uint32_t
+compute_flags (ply_image_t *image)
+{
+        uint32_t *bytes;
+        long number_of_pixels;
+        long i;
+
+        bytes = ply_image_get_data (image);
+        number_of_pixels = ply_image_get_width (image) * ply_image_get_height (image);
+
+        for (i = 0; i < number_of_pixels; i++) {
+                if ((bytes[i] >> 24) != 0xff)
+                        return 0;
+        }
+
+        return PLY_IMAGE_PACK_ENTRY_FLAG_OPAQUE;
+}
+
+static bool
+write_padding (int      fd,
+               uint64_t from,
+               uint64_t to)
+{
+        static const uint8_t zeroes[PLY_IMAGE_PACK_ALIGNMENT];
+
+        assert (to - from <= PLY_IMAGE_PACK_ALIGNMENT);
+
+        return ply_write (fd, zeroes, to - from);
+}
+
+/* Decodes the given pngs and writes them out as a pack.  Images that
+ * can't be loaded are left out, and will be looked for as pngs at boot.
+ * The pack is written to a temporary file first and moved into place,
+ * so a running plymouthd with the old pack mapped isn't disturbed.
+ */
+bool
+ply_image_pack_write (const char        *filename,
+                      const char *const *image_filenames)
+{
+        ply_image_pack_writer_image_t *images;
+        ply_image_pack_header_t header;
+        char *temporary_filename;
+        uint64_t offset;
+        size_t number_of_images, i, j;
+        bool was_written;
+        int fd;
+
+        assert (filename != NULL);
+        assert (image_filenames != NULL);
+
+        number_of_images = 0;
+        while (image_filenames[number_of_images] != NULL) {
+                number_of_images++;
+        }
+
+        images = calloc (number_of_images + 1, sizeof(ply_image_pack_writer_image_t));
+
+        for (i = 0, j = 0; i < number_of_images; i++) {
+                struct stat file_info;
+                const char *name;
+
+                if (stat (image_filenames[i], &file_info) < 0) {
+                        ply_trace ("could not stat %s: %m", image_filenames[i]);
+                        continue;
+                }
+
+                images[j].image = ply_image_new (image_filenames[i]);
+
+                if (!ply_image_load (images[j].image)) {
+                        ply_trace ("could not load %s, leaving it out", image_filenames[i]);
+                        ply_image_free (images[j].image);
+                        images[j].image = NULL;
+                        continue;
+                }
+
+                name = strrchr (image_filenames[i], '/');
+                images[j].name = name != NULL ? name + 1 : image_filenames[i];
+                images[j].entry.source_size = file_info.st_size;
+                images[j].entry.source_modification_time = file_info.st_mtim.tv_sec;
+                images[j].entry.width = ply_image_get_width (images[j].image);
+                images[j].entry.height = ply_image_get_height (images[j].image);
+                images[j].entry.flags = compute_flags (images[j].image);
+                j++;
+        }
+        number_of_images = j;
+
+        qsort (images, number_of_images, sizeof(ply_image_pack_writer_image_t), compare_images);
+
+        offset = sizeof(ply_image_pack_header_t) + number_of_images * sizeof(ply_image_pack_entry_t);
+
+        for (i = 0; i < number_of_images; i++) {
+                images[i].entry.name_offset = offset;
+                offset += strlen (images[i].name) + 1;
+        }
+
+        for (i = 0; i < number_of_images; i++) {
+                offset = align_offset (offset);
+                images[i].entry.data_offset = offset;
+                offset += (uint64_t) images[i].entry.width * images[i].entry.height * sizeof(uint32_t);
+        }
+
+        memset (&header, 0, sizeof(header));
+        memcpy (header.magic, PLY_IMAGE_PACK_MAGIC, sizeof(PLY_IMAGE_PACK_MAGIC));
+        header.byte_order_mark = PLY_IMAGE_PACK_BYTE_ORDER_MARK;
+        header.version = PLY_IMAGE_PACK_VERSION;
+        header.number_of_entries = number_of_images;
+
+        temporary_filename = NULL;
+        asprintf (&temporary_filename, "%s.XXXXXX", filename);
+        fd = mkostemp (temporary_filename, O_CLOEXEC);
+
+        was_written = false;
+        if (fd < 0) {
+                ply_trace ("could not create %s: %m", temporary_filename);
+                goto out;
+        }
+
+        if (fchmod (fd, 0644) < 0)
+                goto out;
+
+        if (!ply_write (fd, &header, sizeof(header)))
+                goto out;
+
+        for (i = 0; i < number_of_images; i++) {
+                if (!ply_write (fd, &images[i].entry, sizeof(ply_image_pack_entry_t)))
+                        goto out;
+        }
+
+        offset = sizeof(ply_image_pack_header_t) + number_of_images * sizeof(ply_image_pack_entry_t);
+        for (i = 0; i < number_of_images; i++) {
+                size_t length = strlen (images[i].name) + 1;
+
+                if (!ply_write (fd, images[i].name, length))
+                        goto out;
+                offset += length;
+        }
+
+        for (i = 0; i < number_of_images; i++) {
+                size_t data_size;
+
+                if (!write_padding (fd, offset, images[i].entry.data_offset))
+                        goto out;
+
+                data_size = (size_t) images[i].entry.width * images[i].entry.height * sizeof(uint32_t);
+
+                if (!ply_write (fd, ply_image_get_data (images[i].image), data_size))
+                        goto out;
+
+                offset = images[i].entry.data_offset + data_size;
+        }
+
+        if (fsync (fd) < 0 || rename (temporary_filename, filename) < 0) {
+                ply_trace ("could not write %s: %m", filename);
+                goto out;
+        }
+
+        was_written = true;
+
+out:
+        if (fd >= 0) {
+                close (fd);
+
+                if (!was_written)
+                        unlink (temporary_filename);
+        }
+        free (temporary_filename);
+
+        for (i = 0; i < number_of_images; i++) {
+                ply_image_free (images[i].image);
+        }
+        free (images);
+
+        return was_written;
+}
+
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -0,0 +1,50 @@
+/* ply-image-pack.h - precompiled theme images that can be mapped in
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_IMAGE_PACK_H
+#define PLY_IMAGE_PACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "ply-pixel-buffer.h"
+
+#define PLY_IMAGE_PACK_FILENAME "images.pack"
+
+typedef struct _ply_image_pack ply_image_pack_t;
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_image_pack_t *ply_image_pack_open (const char *filename);
+void ply_image_pack_close (ply_image_pack_t *pack);
+ply_image_pack_t *ply_image_pack_get_for_directory (const char *directory);
+
+ply_pixel_buffer_t *ply_image_pack_get_buffer (ply_image_pack_t *pack,
+                                               const char       *filename);
+bool ply_image_pack_get_size (ply_image_pack_t *pack,
+                              const char       *filename,
+                              long             *width,
+                              long             *height);
+
+bool ply_image_pack_write (const char        *filename,
+                           const char *const *image_filenames);
+#endif
+
+#endif /* PLY_IMAGE_PACK_H */
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -0,0 +1,192 @@
+/* ply-image-test.c - checks how png pixels get premultiplied
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Writes a 256x256 png with every channel value at every alpha, loads
+ * it with ply_image_load, and checks each premultiplied channel is
+ * within 1 of what the floating point code that came before the
+ * integer math gave.
+ */
+#include "config.h"
+
+#include <png.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ply-image.h"
+#include "ply-utils.h"
+
+#define IMAGE_SIZE 256
+
+/* Past this many, mismatches are only counted */
+#define MAX_MISMATCHES_TO_PRINT 16
+
+/* The values in the three color channels of the pixel at x, each of
+ * which goes through all 256 values along a row
+ */
+static void
+get_channel_values (int     x,
+                    uint8_t values[3])
+{
+        values[0] = x;
+        values[1] = 0xff - x;
+        values[2] = x ^ 0x55;
+}
+
+static uint8_t
+premultiply_with_floating_point (uint8_t value,
+                                 uint8_t alpha)
+{
+        if (alpha == 0xff)
+                return value;
+
+        return (uint8_t) CLAMP (((value / 255.0) * (alpha / 255.0)) * 255.0, 0, 255.0);
+}
+
+/* Each row has one alpha value, going from 0 at the top to 255 at the
+ * bottom
+ */
+static bool
+write_test_image (const char *filename)
+{
+        png_struct *png;
+        png_info *info;
+        png_byte row[IMAGE_SIZE * 4];
+        FILE *fp;
+        int x, y;
+
+        fp = fopen (filename, "wb");
+        if (fp == NULL)
+                return false;
+
+        png = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        info = png_create_info_struct (png);
+
+        if (setjmp (png_jmpbuf (png))) {
+                png_destroy_write_struct (&png, &info);
+                fclose (fp);
+                return false;
+        }
+
+        png_init_io (png, fp);
+        png_set_IHDR (png, info, IMAGE_SIZE, IMAGE_SIZE, 8, PNG_COLOR_TYPE_RGBA,
+                      PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                      PNG_FILTER_TYPE_DEFAULT);
+        png_write_info (png, info);
+
+        for (y = 0; y < IMAGE_SIZE; y++) {
+                for (x = 0; x < IMAGE_SIZE; x++) {
+                        get_channel_values (x, row + x * 4);
+                        row[x * 4 + 3] = y;
+                }
+                png_write_row (png, row);
+        }
+
+        png_write_end (png, info);
+        png_destroy_write_struct (&png, &info);
+        fclose (fp);
+
+        return true;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+        char filename[] = "/tmp/ply-image-test-XXXXXX";
+        ply_image_t *image;
+        uint32_t *data;
+        int fd, x, y, i;
+        int number_of_mismatches, number_of_rounding_differences;
+
+        fd = mkstemp (filename);
+        if (fd < 0) {
+                perror ("could not create test image");
+                return 1;
+        }
+        close (fd);
+
+        if (!write_test_image (filename)) {
+                fprintf (stderr, "could not write test image\n");
+                unlink (filename);
+                return 1;
+        }
+
+        image = ply_image_new (filename);
+
+        if (!ply_image_load (image) ||
+            ply_image_get_width (image) != IMAGE_SIZE ||
+            ply_image_get_height (image) != IMAGE_SIZE) {
+                fprintf (stderr, "could not load test image\n");
+                ply_image_free (image);
+                unlink (filename);
+                return 1;
+        }
+        unlink (filename);
+
+        data = ply_image_get_data (image);
+        number_of_mismatches = 0;
+        number_of_rounding_differences = 0;
+        for (y = 0; y < IMAGE_SIZE; y++) {
+                for (x = 0; x < IMAGE_SIZE; x++) {
+                        uint32_t pixel_value;
+                        uint8_t values[3];
+
+                        pixel_value = data[y * IMAGE_SIZE + x];
+                        get_channel_values (x, values);
+
+                        if ((pixel_value >> 24) != (uint32_t) y) {
+                                if (number_of_mismatches < MAX_MISMATCHES_TO_PRINT)
+                                        printf ("alpha %d came back as %u\n", y, pixel_value >> 24);
+                                number_of_mismatches++;
+                        }
+
+                        for (i = 0; i < 3; i++) {
+                                int expected, actual;
+
+                                expected = premultiply_with_floating_point (values[i], y);
+                                actual = (pixel_value >> (16 - 8 * i)) & 0xff;
+
+                                if (abs (actual - expected) == 1)
+                                        number_of_rounding_differences++;
+
+                                if (abs (actual - expected) > 1) {
+                                        if (number_of_mismatches < MAX_MISMATCHES_TO_PRINT)
+                                                printf ("value %d at alpha %d came back as %d, not %d\n",
+                                                        values[i], y, actual, expected);
+                                        number_of_mismatches++;
+                                }
+                        }
+                }
+        }
+        ply_image_free (image);
+
+        printf ("%s: premultiplied %d value and alpha pairs, %d channels off by 1 "
+                "from the floating point result and %d off by more\n",
+                number_of_mismatches == 0 ? "PASS" : "FAIL",
+                IMAGE_SIZE * IMAGE_SIZE, number_of_rounding_differences,
+                number_of_mismatches);
+
+        return number_of_mismatches > 0 ? 1 : 0;
+}
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -47,12 +47,22 @@
 
 #include <linux/fb.h>
 
+#include "ply-image-pack.h"
+#include "ply-logger.h"
 #include "ply-utils.h"
+#include "ply-worker-pool.h"
 
 struct _ply_image
 {
-        char               *filename;
-        ply_pixel_buffer_t *buffer;
+        char                    *filename;
+        ply_pixel_buffer_t      *buffer;
+
+        ply_worker_pool_job_t   *load_job;
+        ply_image_load_handler_t load_handler;
+        void                    *load_handler_user_data;
+
+        uint32_t                 was_loaded : 1;
+        uint32_t                 was_loaded_from_pack : 1;
 };
 
 ply_image_t *
@@ -78,40 +88,99 @@ ply_image_free (ply_image_t *image)
 
         assert (image->filename != NULL);
 
+        /* Don't bother decoding an image nobody wants anymore, but if a
+         * worker is already writing to the buffer, let it finish first
+         */
+        if (image->load_job != NULL) {
+                ply_worker_pool_cancel_job (ply_worker_pool_get_default (),
+                                            image->load_job);
+                image->load_job = NULL;
+        }
+
         ply_pixel_buffer_free (image->buffer);
         free (image->filename);
         free (image);
 }
 
+/* Computes (value * alpha + 127) / 255, that is value * alpha / 255
+ * rounded to the nearest integer, without a division.  An alpha of 0xff
+ * leaves the value alone.
+ */
+static inline uint8_t
+premultiply_channel (uint8_t value,
+                     uint8_t alpha)
+{
+        uint_least32_t product;
+
+        product = (uint_least32_t) value * alpha + 0x80;
+
+        return (uint8_t) ((product + (product >> 8)) >> 8);
+}
+
 static void
 transform_to_argb32 (png_struct   *png,
                      png_row_info *row_info,
                      png_byte     *data)
 {
-        unsigned int i;
+        png_size_t i;
 
+        /* Kept free of branches and calls so the compiler can turn it
+         * into vector code.
+         */
         for (i = 0; i < row_info->rowbytes; i += 4) {
+                png_byte *pixel = data + i;
                 uint8_t red, green, blue, alpha;
                 uint32_t pixel_value;
 
-                red = data[i + 0];
-                green = data[i + 1];
-                blue = data[i + 2];
-                alpha = data[i + 3];
-
-                /* pre-multiply the alpha if there's translucency */
-                if (alpha != 0xff) {
-                        red = (uint8_t) CLAMP (((red / 255.0) * (alpha / 255.0)) * 255.0, 0, 255.0);
-                        green = (uint8_t) CLAMP (((green / 255.0) * (alpha / 255.0)) * 255.0,
-                                                 0, 255.0);
-                        blue = (uint8_t) CLAMP (((blue / 255.0) * (alpha / 255.0)) * 255.0, 0, 255.0);
-                }
-
-                pixel_value = (alpha << 24) | (red << 16) | (green << 8) | (blue << 0);
-                memcpy (data + i, &pixel_value, sizeof(uint32_t));
+                red = pixel[0];
+                green = pixel[1];
+                blue = pixel[2];
+                alpha = pixel[3];
+
+                pixel_value = ((uint32_t) alpha << 24)
+                              | ((uint32_t) premultiply_channel (red, alpha) << 16)
+                              | ((uint32_t) premultiply_channel (green, alpha) << 8)
+                              | ((uint32_t) premultiply_channel (blue, alpha) << 0);
+                memcpy (pixel, &pixel_value, sizeof(uint32_t));
         }
 }
 
+static ply_image_pack_t *
+get_pack_for_file (const char *filename)
+{
+        ply_image_pack_t *pack;
+        char *directory, *slash;
+
+        directory = strdup (filename);
+        slash = strrchr (directory, '/');
+
+        if (slash == NULL) {
+                free (directory);
+                return NULL;
+        }
+        *slash = '\0';
+
+        pack = ply_image_pack_get_for_directory (directory);
+        free (directory);
+
+        return pack;
+}
+
+static bool
+ply_image_load_from_pack (ply_image_t *image)
+{
+        ply_image_pack_t *pack;
+
+        pack = get_pack_for_file (image->filename);
+
+        if (pack == NULL)
+                return false;
+
+        image->buffer = ply_image_pack_get_buffer (pack, image->filename);
+
+        return image->buffer != NULL;
+}
+
 bool
 ply_image_load (ply_image_t *image)
 {
@@ -125,6 +194,11 @@ ply_image_load (ply_image_t *image)
 
         assert (image != NULL);
 
+        if (ply_image_load_from_pack (image)) {
+                image->was_loaded_from_pack = true;
+                return true;
+        }
+
         fp = fopen (image->filename, "re");
         if (fp == NULL)
                 return false;
@@ -194,6 +268,131 @@ ply_image_load (ply_image_t *image)
         return true;
 }
 
+/* Finds out how big the image is without decoding it, from its image
+ * pack entry or the header of the png, so things can be laid out
+ * before the image is loaded
+ */
+bool
+ply_image_get_size_from_file (const char *filename,
+                              long       *width,
+                              long       *height)
+{
+        ply_image_pack_t *pack;
+        png_byte header[24];
+        FILE *fp;
+        bool has_size;
+
+        assert (filename != NULL);
+        assert (width != NULL);
+        assert (height != NULL);
+
+        pack = get_pack_for_file (filename);
+
+        if (pack != NULL && ply_image_pack_get_size (pack, filename, width, height))
+                return true;
+
+        fp = fopen (filename, "re");
+        if (fp == NULL)
+                return false;
+
+        /* The signature, then the IHDR chunk's length and type, then
+         * the width and height
+         */
+        has_size = fread (header, 1, sizeof(header), fp) == sizeof(header) &&
+                   png_sig_cmp (header, 0, 8) == 0 &&
+                   memcmp (header + 12, "IHDR", 4) == 0;
+        fclose (fp);
+
+        if (!has_size)
+                return false;
+
+        *width = png_get_uint_32 (header + 16);
+        *height = png_get_uint_32 (header + 20);
+
+        return true;
+}
+
+static void
+on_load_job (ply_image_t *image)
+{
+        image->was_loaded = ply_image_load (image);
+}
+
+static void
+on_load_job_finished (ply_image_t *image)
+{
+        ply_image_load_handler_t handler;
+
+        image->load_job = NULL;
+
+        if (image->was_loaded_from_pack)
+                ply_trace ("%s came from its image pack", image->filename);
+        else if (!image->was_loaded)
+                ply_trace ("could not load %s", image->filename);
+
+        handler = image->load_handler;
+        image->load_handler = NULL;
+
+        if (handler != NULL)
+                handler (image->load_handler_user_data, image->was_loaded, image);
+}
+
+/* Decodes the image on a worker thread.  The image must not be used
+ * until handler is called (from the event loop) or until
+ * ply_image_wait_for_load () returns.
+ */
+void
+ply_image_load_in_background (ply_image_t               *image,
+                              ply_worker_pool_priority_t priority,
+                              ply_image_load_handler_t   handler,
+                              void                      *user_data)
+{
+        ply_worker_pool_t *pool;
+
+        assert (image != NULL);
+        assert (image->load_job == NULL);
+
+        image->load_handler = handler;
+        image->load_handler_user_data = user_data;
+
+        pool = ply_worker_pool_get_default ();
+
+        if (pool == NULL) {
+                on_load_job (image);
+                on_load_job_finished (image);
+                return;
+        }
+
+        image->load_job = ply_worker_pool_queue_job (pool, priority,
+                                                     (ply_worker_pool_job_handler_t)
+                                                     on_load_job,
+                                                     (ply_worker_pool_completion_handler_t)
+                                                     on_load_job_finished,
+                                                     image);
+}
+
+bool
+ply_image_wait_for_load (ply_image_t *image)
+{
+        assert (image != NULL);
+
+        if (image->load_job != NULL)
+                ply_worker_pool_wait_for_job (ply_worker_pool_get_default (),
+                                              image->load_job);
+
+        return image->was_loaded;
+}
+
+/* Whether the image's pixels point straight into a mapped image pack
+ */
+bool
+ply_image_is_from_pack (ply_image_t *image)
+{
+        assert (image != NULL);
+
+        return image->was_loaded_from_pack;
+}
+
 uint32_t *
 ply_image_get_data (ply_image_t *image)
 {
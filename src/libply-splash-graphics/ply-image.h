@@ -23,6 +23,7 @@
 #define PLY_IMAGE_H
 
 #include "ply-pixel-buffer.h"
+#include "ply-worker-pool.h"
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -30,10 +31,23 @@
 
 typedef struct _ply_image ply_image_t;
 
+typedef void (*ply_image_load_handler_t) (void        *user_data,
+                                          bool         was_loaded,
+                                          ply_image_t *image);
+
 #ifndef PLY_HIDE_FUNCTION_DECLARATIONS
 ply_image_t *ply_image_new (const char *filename);
 void ply_image_free (ply_image_t *image);
 bool ply_image_load (ply_image_t *image);
+void ply_image_load_in_background (ply_image_t               *image,
+                                   ply_worker_pool_priority_t priority,
+                                   ply_image_load_handler_t   handler,
+                                   void                      *user_data);
+bool ply_image_wait_for_load (ply_image_t *image);
+bool ply_image_is_from_pack (ply_image_t *image);
+bool ply_image_get_size_from_file (const char *filename,
+                                   long       *width,
+                                   long       *height);
 uint32_t *ply_image_get_data (ply_image_t *image);
 long ply_image_get_width (ply_image_t *image);
 long ply_image_get_height (ply_image_t *image);
@@ -308,7 +308,7 @@ ply_progress_animation_draw (ply_progress_animation_t *progress_animation)
                                      progress_animation->frame_area.height);
 }
 
-static bool
+static void
 ply_progress_animation_add_frame (ply_progress_animation_t *progress_animation,
                                   const char               *filename)
 {
@@ -316,15 +316,29 @@ ply_progress_animation_add_frame (ply_progress_animation_t *progress_animation,
 
         image = ply_image_new (filename);
 
-        if (!ply_image_load (image)) {
-                ply_image_free (image);
-                return false;
-        }
+        ply_image_load_in_background (image, PLY_WORKER_POOL_PRIORITY_NORMAL,
+                                      NULL, NULL);
 
         ply_array_add_pointer_element (progress_animation->frames, image);
+}
 
-        progress_animation->area.width = MAX (progress_animation->area.width, (size_t) ply_image_get_width (image));
-        progress_animation->area.height = MAX (progress_animation->area.height, (size_t) ply_image_get_height (image));
+static bool
+ply_progress_animation_wait_for_frames (ply_progress_animation_t *progress_animation)
+{
+        ply_image_t *const *frames;
+        int number_of_frames;
+        int i;
+
+        number_of_frames = ply_array_get_size (progress_animation->frames);
+        frames = (ply_image_t *const *) ply_array_get_pointer_elements (progress_animation->frames);
+
+        for (i = 0; i < number_of_frames; i++) {
+                if (!ply_image_wait_for_load (frames[i]))
+                        return false;
+
+                progress_animation->area.width = MAX (progress_animation->area.width, (size_t) ply_image_get_width (frames[i]));
+                progress_animation->area.height = MAX (progress_animation->area.height, (size_t) ply_image_get_height (frames[i]));
+        }
 
         return true;
 }
@@ -353,21 +367,25 @@ ply_progress_animation_add_frames (ply_progress_animation_t *progress_animation)
                     && (strlen (entries[i]->d_name) > 4)
                     && strcmp (entries[i]->d_name + strlen (entries[i]->d_name) - 4, ".png") == 0) {
                         char *filename;
-                        bool r;
 
                         filename = NULL;
                         asprintf (&filename, "%s/%s", progress_animation->image_dir, entries[i]->d_name);
 
-                        r = ply_progress_animation_add_frame (progress_animation, filename);
+                        ply_progress_animation_add_frame (progress_animation, filename);
                         free (filename);
-                        if (!r)
-                                goto out;
                 }
 
                 free (entries[i]);
                 entries[i] = NULL;
         }
 
+        /* All the frames get decoded in parallel on the worker pool, but
+         * a progress animation can jump to any frame, so they all need
+         * to be there before it can be shown.
+         */
+        if (!ply_progress_animation_wait_for_frames (progress_animation))
+                goto out;
+
         number_of_frames = ply_array_get_size (progress_animation->frames);
         if (number_of_frames == 0) {
                 ply_trace ("could not find any progress animation frames");
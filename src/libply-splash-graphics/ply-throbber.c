@@ -22,7 +22,6 @@
 #include "config.h"
 
 #include <assert.h>
-#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
@@ -42,11 +41,11 @@
 
 #include "ply-throbber.h"
 #include "ply-event-loop.h"
+#include "ply-frame-clock.h"
+#include "ply-frame-sequence.h"
 #include "ply-pixel-buffer.h"
 #include "ply-pixel-display.h"
-#include "ply-array.h"
 #include "ply-logger.h"
-#include "ply-image.h"
 #include "ply-utils.h"
 
 #include <linux/kd.h>
@@ -61,25 +60,39 @@
 
 struct _ply_throbber
 {
-        ply_array_t         *frames;
-        ply_event_loop_t    *loop;
-        char                *image_dir;
-        char                *frames_prefix;
+        ply_frame_sequence_t *frames;
+        ply_event_loop_t     *loop;
+        ply_frame_clock_t    *clock;
 
-        ply_pixel_display_t *display;
-        ply_rectangle_t      frame_area;
-        ply_trigger_t       *stop_trigger;
+        ply_pixel_display_t  *display;
+        ply_rectangle_t       frame_area;
+        ply_trigger_t        *stop_trigger;
 
-        long                 x, y;
-        long                 width, height;
-        double               start_time, now;
+        long                  x, y;
+        double                start_time, now;
 
-        int                  frame_number;
-        uint32_t             is_stopped : 1;
+        int                   frame_number;
+        int                   drawn_frame_number;
+        uint32_t              is_stopped : 1;
 };
 
 static void ply_throbber_stop_now (ply_throbber_t *throbber);
 
+/* A frame that wasn't ready in time got decoded, so show it
+ */
+static void
+on_frame_ready (ply_throbber_t       *throbber,
+                ply_frame_sequence_t *sequence)
+{
+        if (throbber->is_stopped || throbber->display == NULL)
+                return;
+
+        ply_pixel_display_draw_area (throbber->display,
+                                     throbber->x, throbber->y,
+                                     ply_frame_sequence_get_width (sequence),
+                                     ply_frame_sequence_get_height (sequence));
+}
+
 ply_throbber_t *
 ply_throbber_new (const char *image_dir,
                   const char *frames_prefix)
@@ -91,12 +104,11 @@ ply_throbber_new (const char *image_dir,
 
         throbber = calloc (1, sizeof(ply_throbber_t));
 
-        throbber->frames = ply_array_new (PLY_ARRAY_ELEMENT_TYPE_POINTER);
-        throbber->frames_prefix = strdup (frames_prefix);
-        throbber->image_dir = strdup (image_dir);
+        throbber->frames = ply_frame_sequence_new (image_dir, frames_prefix);
+        ply_frame_sequence_set_frame_ready_handler (throbber->frames,
+                                                    (ply_frame_sequence_frame_ready_handler_t)
+                                                    on_frame_ready, throbber);
         throbber->is_stopped = true;
-        throbber->width = 0;
-        throbber->height = 0;
         throbber->frame_area.width = 0;
         throbber->frame_area.height = 0;
         throbber->frame_area.x = 0;
@@ -106,19 +118,6 @@ ply_throbber_new (const char *image_dir,
         return throbber;
 }
 
-static void
-ply_throbber_remove_frames (ply_throbber_t *throbber)
-{
-        int i;
-        ply_pixel_buffer_t **frames;
-
-        frames = (ply_pixel_buffer_t **) ply_array_steal_pointer_elements (throbber->frames);
-        for (i = 0; frames[i] != NULL; i++) {
-                ply_pixel_buffer_free (frames[i]);
-        }
-        free (frames);
-}
-
 void
 ply_throbber_free (ply_throbber_t *throbber)
 {
@@ -128,11 +127,7 @@ ply_throbber_free (ply_throbber_t *throbber)
         if (!throbber->is_stopped)
                 ply_throbber_stop_now (throbber);
 
-        ply_throbber_remove_frames (throbber);
-        ply_array_free (throbber->frames);
-
-        free (throbber->frames_prefix);
-        free (throbber->image_dir);
+        ply_frame_sequence_free (throbber->frames);
         free (throbber);
 }
 
@@ -140,12 +135,12 @@ static bool
 animate_at_time (ply_throbber_t *throbber,
                  double          time)
 {
-        int number_of_frames;
-        ply_pixel_buffer_t *const *frames;
+        int number_of_frames, number_of_loaded_frames;
         bool should_continue;
         double percent_in_sequence;
+        ply_rectangle_t changed_area;
 
-        number_of_frames = ply_array_get_size (throbber->frames);
+        number_of_frames = ply_frame_sequence_get_number_of_frames (throbber->frames);
 
         if (number_of_frames == 0)
                 return true;
@@ -158,133 +153,79 @@ animate_at_time (ply_throbber_t *throbber,
                 if (throbber->frame_number == number_of_frames - 1)
                         should_continue = false;
 
-        frames = (ply_pixel_buffer_t *const *) ply_array_get_pointer_elements (throbber->frames);
-        ply_pixel_buffer_get_size (frames[throbber->frame_number], &throbber->frame_area);
+        /* Frames that haven't been decoded yet get drawn as the last one
+         * that has, so that's the one to diff against next time
+         */
+        number_of_loaded_frames = ply_frame_sequence_get_number_of_loaded_frames (throbber->frames);
+
+        if (number_of_loaded_frames == 0)
+                return should_continue;
+
+        throbber->frame_number = MIN (throbber->frame_number, number_of_loaded_frames - 1);
+
+        if (!ply_frame_sequence_get_frame_size (throbber->frames, throbber->frame_number,
+                                                &throbber->frame_area))
+                return should_continue;
+
         throbber->frame_area.x = throbber->x;
         throbber->frame_area.y = throbber->y;
+
+        /* Only redraw the part that's different from what's showing
+         */
+        ply_frame_sequence_get_changed_area (throbber->frames,
+                                             throbber->drawn_frame_number,
+                                             throbber->frame_number,
+                                             &changed_area);
+        throbber->drawn_frame_number = throbber->frame_number;
+
+        if (changed_area.width == 0 || changed_area.height == 0)
+                return should_continue;
+
         ply_pixel_display_draw_area (throbber->display,
-                                     throbber->x, throbber->y,
-                                     throbber->frame_area.width,
-                                     throbber->frame_area.height);
+                                     throbber->x + changed_area.x,
+                                     throbber->y + changed_area.y,
+                                     changed_area.width,
+                                     changed_area.height);
 
         return should_continue;
 }
 
 static void
-on_timeout (ply_throbber_t *throbber)
+on_frame (ply_throbber_t    *throbber,
+          double             frame_time,
+          ply_frame_clock_t *clock)
 {
-        double sleep_time;
         bool should_continue;
 
-        throbber->now = ply_get_timestamp ();
+        throbber->now = frame_time;
 
         should_continue = animate_at_time (throbber,
                                            throbber->now - throbber->start_time);
 
-        sleep_time = 1.0 / FRAMES_PER_SECOND;
-        sleep_time = MAX (sleep_time - (ply_get_timestamp () - throbber->now),
-                          0.005);
-
         if (!should_continue) {
                 throbber->is_stopped = true;
+                ply_frame_clock_remove_handler (throbber->clock,
+                                                (ply_frame_clock_handler_t)
+                                                on_frame, throbber);
+
                 if (throbber->stop_trigger != NULL) {
                         ply_trigger_pull (throbber->stop_trigger, NULL);
                         throbber->stop_trigger = NULL;
                 }
-        } else {
-                ply_event_loop_watch_for_timeout (throbber->loop,
-                                                  sleep_time,
-                                                  (ply_event_loop_timeout_handler_t)
-                                                  on_timeout, throbber);
         }
 }
 
-static bool
-ply_throbber_add_frame (ply_throbber_t *throbber,
-                        const char     *filename)
-{
-        ply_image_t *image;
-        ply_pixel_buffer_t *frame;
-
-        image = ply_image_new (filename);
-
-        if (!ply_image_load (image)) {
-                ply_image_free (image);
-                return false;
-        }
-
-        frame = ply_image_convert_to_pixel_buffer (image);
-
-        ply_array_add_pointer_element (throbber->frames, frame);
-
-        throbber->width = MAX (throbber->width, (long) ply_pixel_buffer_get_width (frame));
-        throbber->height = MAX (throbber->height, (long) ply_pixel_buffer_get_height (frame));
-
-        return true;
-}
-
-static bool
-ply_throbber_add_frames (ply_throbber_t *throbber)
+void
+ply_throbber_set_frame_cache_size (ply_throbber_t *throbber,
+                                   size_t          cache_size)
 {
-        struct dirent **entries;
-        int number_of_entries;
-        int i;
-        bool load_finished;
-
-        entries = NULL;
-
-        number_of_entries = scandir (throbber->image_dir, &entries, NULL, versionsort);
-
-        if (number_of_entries <= 0)
-                return false;
-
-        load_finished = false;
-        for (i = 0; i < number_of_entries; i++) {
-                if (strncmp (entries[i]->d_name,
-                             throbber->frames_prefix,
-                             strlen (throbber->frames_prefix)) == 0
-                    && (strlen (entries[i]->d_name) > 4)
-                    && strcmp (entries[i]->d_name + strlen (entries[i]->d_name) - 4, ".png") == 0) {
-                        char *filename;
-
-                        filename = NULL;
-                        asprintf (&filename, "%s/%s", throbber->image_dir, entries[i]->d_name);
-
-                        if (!ply_throbber_add_frame (throbber, filename))
-                                goto out;
-
-                        free (filename);
-                }
-
-                free (entries[i]);
-                entries[i] = NULL;
-        }
-        load_finished = true;
-
-out:
-        if (!load_finished) {
-                ply_throbber_remove_frames (throbber);
-
-                while (entries[i] != NULL) {
-                        free (entries[i]);
-                        i++;
-                }
-        }
-        free (entries);
-
-        return (ply_array_get_size (throbber->frames) > 0);
+        ply_frame_sequence_set_cache_size (throbber->frames, cache_size);
 }
 
 bool
 ply_throbber_load (ply_throbber_t *throbber)
 {
-        if (ply_array_get_size (throbber->frames) != 0)
-                ply_throbber_remove_frames (throbber);
-
-        if (!ply_throbber_add_frames (throbber))
-                return false;
-
-        return true;
+        return ply_frame_sequence_load (throbber->frames);
 }
 
 bool
@@ -298,18 +239,20 @@ ply_throbber_start (ply_throbber_t      *throbber,
         assert (throbber->loop == NULL);
 
         throbber->loop = loop;
+        throbber->clock = ply_frame_clock_get_default ();
         throbber->display = display;
         throbber->is_stopped = false;
+        throbber->drawn_frame_number = -1;
 
         throbber->x = x;
         throbber->y = y;
 
         throbber->start_time = ply_get_timestamp ();
 
-        ply_event_loop_watch_for_timeout (throbber->loop,
-                                          1.0 / FRAMES_PER_SECOND,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, throbber);
+        ply_frame_clock_add_handler (throbber->clock,
+                                     FRAMES_PER_SECOND,
+                                     (ply_frame_clock_handler_t)
+                                     on_frame, throbber);
 
         return true;
 }
@@ -324,12 +267,13 @@ ply_throbber_stop_now (ply_throbber_t *throbber)
                                      throbber->y,
                                      throbber->frame_area.width,
                                      throbber->frame_area.height);
-        if (throbber->loop != NULL) {
-                ply_event_loop_stop_watching_for_timeout (throbber->loop,
-                                                          (ply_event_loop_timeout_handler_t)
-                                                          on_timeout, throbber);
-                throbber->loop = NULL;
+        if (throbber->clock != NULL) {
+                ply_frame_clock_remove_handler (throbber->clock,
+                                                (ply_frame_clock_handler_t)
+                                                on_frame, throbber);
+                throbber->clock = NULL;
         }
+        throbber->loop = NULL;
         throbber->display = NULL;
 }
 
@@ -359,28 +303,26 @@ ply_throbber_draw_area (ply_throbber_t     *throbber,
                         unsigned long       width,
                         unsigned long       height)
 {
-        ply_pixel_buffer_t *const *frames;
-
         if (throbber->is_stopped)
                 return;
 
-        frames = (ply_pixel_buffer_t *const *) ply_array_get_pointer_elements (throbber->frames);
-        ply_pixel_buffer_fill_with_buffer (buffer,
-                                           frames[throbber->frame_number],
-                                           throbber->x,
-                                           throbber->y);
+        ply_frame_sequence_draw_frame (throbber->frames,
+                                       throbber->frame_number,
+                                       buffer,
+                                       throbber->x,
+                                       throbber->y);
 }
 
 long
 ply_throbber_get_width (ply_throbber_t *throbber)
 {
-        return throbber->width;
+        return ply_frame_sequence_get_width (throbber->frames);
 }
 
 long
 ply_throbber_get_height (ply_throbber_t *throbber)
 {
-        return throbber->height;
+        return ply_frame_sequence_get_height (throbber->frames);
 }
 
 /* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
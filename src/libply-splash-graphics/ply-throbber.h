@@ -38,6 +38,8 @@ ply_throbber_t *ply_throbber_new (const char *image_dir,
                                   const char *frames_prefix);
 void ply_throbber_free (ply_throbber_t *throbber);
 
+void ply_throbber_set_frame_cache_size (ply_throbber_t *throbber,
+                                        size_t          cache_size);
 bool ply_throbber_load (ply_throbber_t *throbber);
 bool ply_throbber_start (ply_throbber_t      *throbber,
                          ply_event_loop_t    *loop,
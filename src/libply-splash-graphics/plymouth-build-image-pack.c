@@ -0,0 +1,107 @@
+/* plymouth-build-image-pack.c - precompiles the images of a theme
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ply-array.h"
+#include "ply-image-pack.h"
+#include "ply-logger.h"
+#include "ply-utils.h"
+
+static bool
+has_png_extension (const char *name)
+{
+        size_t length;
+
+        length = strlen (name);
+
+        return length > 4 && strcmp (name + length - 4, ".png") == 0;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+        ply_array_t *image_filenames;
+        struct dirent **entries;
+        char *pack_filename;
+        char **filenames;
+        int number_of_entries;
+        int exit_code;
+        int i;
+
+        if (argc != 2) {
+                ply_error ("usage: %s <theme directory>", argv[0]);
+                return 1;
+        }
+
+        entries = NULL;
+        number_of_entries = scandir (argv[1], &entries, NULL, versionsort);
+
+        if (number_of_entries < 0) {
+                ply_error ("%s: could not read %s: %m", argv[0], argv[1]);
+                return 1;
+        }
+
+        image_filenames = ply_array_new (PLY_ARRAY_ELEMENT_TYPE_POINTER);
+        for (i = 0; i < number_of_entries; i++) {
+                if (has_png_extension (entries[i]->d_name)) {
+                        char *filename;
+
+                        filename = NULL;
+                        asprintf (&filename, "%s/%s", argv[1], entries[i]->d_name);
+                        ply_array_add_pointer_element (image_filenames, filename);
+                }
+                free (entries[i]);
+        }
+        free (entries);
+
+        pack_filename = NULL;
+        asprintf (&pack_filename, "%s/%s", argv[1], PLY_IMAGE_PACK_FILENAME);
+
+        if (ply_array_get_size (image_filenames) == 0) {
+                /* Don't leave an old pack around for a theme with no images
+                 */
+                unlink (pack_filename);
+                exit_code = 0;
+        } else if (ply_image_pack_write (pack_filename,
+                                         (const char *const *)
+                                         ply_array_get_pointer_elements (image_filenames))) {
+                exit_code = 0;
+        } else {
+                ply_error ("%s: could not write %s", argv[0], pack_filename);
+                exit_code = 1;
+        }
+        free (pack_filename);
+
+        filenames = (char **) ply_array_steal_pointer_elements (image_filenames);
+        for (i = 0; filenames[i] != NULL; i++) {
+                free (filenames[i]);
+        }
+        free (filenames);
+        ply_array_free (image_filenames);
+
+        return exit_code;
+}
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
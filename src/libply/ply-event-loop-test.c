@@ -0,0 +1,279 @@
+/* ply-event-loop-test.c - checks the order idle handlers run in
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Each check runs a fresh loop one iteration at a time, has the
+ * handlers append a letter to a log, and compares the log with what
+ * ply_event_loop_watch_for_idle promises.  A "|" in the log marks the
+ * end of an iteration.  An iteration with nothing to do sleeps until
+ * something happens, so each check only runs as many as it needs.
+ */
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ply-event-loop.h"
+#include "ply-utils.h"
+
+typedef struct
+{
+        ply_event_loop_t *loop;
+        char              log[256];
+        int               pipe_fds[2];
+} test_state_t;
+
+static test_state_t state;
+
+static void
+log_string (const char *string)
+{
+        strncat (state.log, string, sizeof(state.log) - strlen (state.log) - 1);
+}
+
+static void
+run_iteration (void)
+{
+        ply_event_loop_process_pending_events (state.loop);
+        log_string ("|");
+}
+
+static void
+on_idle (void             *user_data,
+         ply_event_loop_t *loop)
+{
+        log_string (user_data);
+}
+
+static void
+on_idle_requeue (void             *user_data,
+                 ply_event_loop_t *loop)
+{
+        log_string ("R");
+        ply_event_loop_watch_for_idle (loop, PLY_EVENT_LOOP_IDLE_PRIORITY_DEFAULT,
+                                       on_idle, "d");
+}
+
+static void
+on_idle_requeue_after_write (void             *user_data,
+                             ply_event_loop_t *loop)
+{
+        log_string ("W");
+        ply_write (state.pipe_fds[1], "x", 1);
+        ply_event_loop_watch_for_idle (loop, PLY_EVENT_LOOP_IDLE_PRIORITY_HIGH,
+                                       on_idle, "h");
+}
+
+static void
+on_pipe_data (void *user_data,
+              int   fd)
+{
+        char byte;
+
+        if (read (fd, &byte, 1) == 1)
+                log_string ("F");
+}
+
+static void
+on_timeout (void             *user_data,
+            ply_event_loop_t *loop)
+{
+        log_string ("T");
+        ply_event_loop_watch_for_idle (loop, PLY_EVENT_LOOP_IDLE_PRIORITY_LOW,
+                                       on_idle, "i");
+}
+
+static void
+start_test (void)
+{
+        state.loop = ply_event_loop_new ();
+        state.log[0] = '\0';
+}
+
+static bool
+finish_test (const char *name,
+             const char *expected_log)
+{
+        bool passed;
+
+        passed = strcmp (state.log, expected_log) == 0;
+
+        if (passed)
+                printf ("PASS: %s\n", name);
+        else
+                printf ("FAIL: %s: expected \"%s\", got \"%s\"\n",
+                        name, expected_log, state.log);
+        fflush (stdout);
+
+        /* Let the loop tear down its sources before freeing it */
+        ply_event_loop_exit (state.loop, 0);
+        ply_event_loop_run (state.loop);
+        ply_event_loop_free (state.loop);
+        state.loop = NULL;
+
+        return passed;
+}
+
+/* Higher priorities go first, whatever order they were added in */
+static bool
+test_priority_order (void)
+{
+        start_test ();
+
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_LOW,
+                                       on_idle, "c");
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_DEFAULT,
+                                       on_idle, "b");
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_HIGH,
+                                       on_idle, "a");
+        run_iteration ();
+
+        return finish_test ("priority order", "abc|");
+}
+
+/* Handlers of the same priority run in the order they were added, and
+ * removing one doesn't disturb the others
+ */
+static bool
+test_fifo_order (void)
+{
+        start_test ();
+
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_DEFAULT,
+                                       on_idle, "1");
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_DEFAULT,
+                                       on_idle, "2");
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_DEFAULT,
+                                       on_idle, "x");
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_DEFAULT,
+                                       on_idle, "3");
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_LOW,
+                                       on_idle, "5");
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_DEFAULT,
+                                       on_idle, "4");
+        ply_event_loop_stop_watching_for_idle (state.loop, on_idle, "x");
+        run_iteration ();
+
+        return finish_test ("fifo order within a priority", "12345|");
+}
+
+/* A handler queued by an idle handler waits for the next iteration,
+ * even though its priority hasn't been drained yet in this one
+ */
+static bool
+test_requeue_waits_for_next_iteration (void)
+{
+        start_test ();
+
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_DEFAULT,
+                                       on_idle_requeue, NULL);
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_LOW,
+                                       on_idle, "c");
+        run_iteration ();
+        run_iteration ();
+
+        return finish_test ("requeued handler waits for next iteration", "Rc|d|");
+}
+
+/* In the next iteration, events that came in meanwhile are handled
+ * before the requeued handler runs
+ */
+static bool
+test_requeue_runs_after_events (void)
+{
+        ply_fd_watch_t *watch;
+        bool passed;
+
+        start_test ();
+
+        if (pipe (state.pipe_fds) < 0) {
+                perror ("pipe");
+                exit (1);
+        }
+
+        watch = ply_event_loop_watch_fd (state.loop, state.pipe_fds[0],
+                                         PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                         on_pipe_data, NULL, NULL);
+        ply_event_loop_watch_for_idle (state.loop, PLY_EVENT_LOOP_IDLE_PRIORITY_HIGH,
+                                       on_idle_requeue_after_write, NULL);
+        run_iteration ();
+        run_iteration ();
+        ply_event_loop_stop_watching_fd (state.loop, watch);
+
+        passed = finish_test ("requeued handler runs after events", "W|Fh|");
+
+        close (state.pipe_fds[0]);
+        close (state.pipe_fds[1]);
+
+        return passed;
+}
+
+/* Handlers queued by a timeout run in the same iteration, after it */
+static bool
+test_idle_after_timeout (void)
+{
+        start_test ();
+
+        ply_event_loop_watch_for_timeout (state.loop, 0.01, on_timeout, NULL);
+
+        /* The loop may wake up early, so forget iterations before the
+         * timeout fires
+         */
+        while (state.log[0] != 'T') {
+                state.log[0] = '\0';
+                run_iteration ();
+        }
+
+        return finish_test ("idle handlers queued by a timeout run after it", "Ti|");
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+        int number_of_failures;
+
+        number_of_failures = 0;
+
+        /* If a handler runs too early, a later iteration finds nothing
+         * to do and sleeps forever, so fail instead of hanging
+         */
+        alarm (10);
+
+        if (!test_priority_order ())
+                number_of_failures++;
+
+        if (!test_fifo_order ())
+                number_of_failures++;
+
+        if (!test_requeue_waits_for_next_iteration ())
+                number_of_failures++;
+
+        if (!test_requeue_runs_after_events ())
+                number_of_failures++;
+
+        if (!test_idle_after_timeout ())
+                number_of_failures++;
+
+        return number_of_failures > 0 ? 1 : 0;
+}
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -23,6 +23,7 @@
 #include "ply-event-loop.h"
 
 #include <assert.h>
+#include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
@@ -34,9 +35,13 @@
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/signalfd.h>
 #include <sys/termios.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
+#include "ply-buffer.h"
+#include "ply-hashtable.h"
 #include "ply-logger.h"
 #include "ply-list.h"
 #include "ply-utils.h"
@@ -45,33 +50,52 @@
 #define PLY_EVENT_LOOP_NUM_EVENT_HANDLERS 64
 #endif
 
+#ifndef PLY_SIGNAL_DISPATCHER_NUM_SIGNALS_PER_READ
+#define PLY_SIGNAL_DISPATCHER_NUM_SIGNALS_PER_READ 16
+#endif
+
 #ifndef PLY_EVENT_LOOP_NO_TIMED_WAKEUP
 #define PLY_EVENT_LOOP_NO_TIMED_WAKEUP 0.0
 #endif
 
 typedef struct
 {
-        int         fd;
-        ply_list_t *destinations;
-        ply_list_t *fd_watches;
-        uint32_t    is_getting_polled : 1;
-        uint32_t    is_disconnected : 1;
-        int         reference_count;
+        int                        fd;
+        ply_list_t                *destinations;
+        ply_list_t                *fd_watches;
+        ply_list_node_t           *node;
+
+        /* What the destinations are waiting for, worked out whenever
+         * they change rather than on every event
+         */
+        uint32_t                   event_mask;
+        ply_event_loop_fd_status_t handled_status;
+
+        uint32_t                   is_getting_polled : 1;
+        uint32_t                   is_disconnected : 1;
+        int                        reference_count;
 } ply_event_source_t;
 
 typedef struct
 {
         ply_event_source_t        *source;
+        ply_list_node_t           *node;
 
         ply_event_loop_fd_status_t status;
         ply_event_handler_t        status_met_handler;
         ply_event_handler_t        disconnected_handler;
         void                      *user_data;
+
+        /* Set for the loop's own fds, which just pass events on to
+         * handlers that get timed themselves
+         */
+        uint32_t                   is_internal : 1;
 } ply_event_destination_t;
 
 struct _ply_fd_watch
 {
         ply_event_destination_t *destination;
+        ply_list_node_t         *node;
 };
 
 typedef struct
@@ -86,9 +110,19 @@ typedef struct
 static int ply_signal_dispatcher_sender_fd = -1,
            ply_signal_dispatcher_receiver_fd = -1;
 
+/* Signals are normally blocked and read from a signalfd, which gets
+ * them in batches without running anything in signal context.  If
+ * there's no signalfd, posix signal handlers write them down a pipe
+ * instead.
+ */
 typedef struct
 {
-        ply_list_t *sources;
+        ply_event_loop_t *loop;
+        ply_list_t       *sources_by_signal[NSIG];
+
+        int               signal_fd;
+        sigset_t          watched_signals;
+        sigset_t          signals_blocked_before;
 } ply_signal_dispatcher_t;
 
 typedef struct
@@ -102,31 +136,92 @@ typedef struct
         double                           timeout;
         ply_event_loop_timeout_handler_t handler;
         void                            *user_data;
+
+        unsigned long                    serial;
+        int                              heap_index;
+        ply_list_node_t                 *node;
 } ply_event_loop_timeout_watch_t;
 
+typedef struct
+{
+        ply_event_loop_idle_handler_t handler;
+        void                         *user_data;
+        unsigned long                 serial;
+} ply_event_loop_idle_watch_t;
+
+typedef struct
+{
+        const char   *kind;
+        void         *handler;
+
+        unsigned long number_of_dispatches;
+        unsigned long number_of_stalls;
+        double        total_time;
+        double        maximum_time;
+} ply_event_loop_handler_statistics_t;
+
 struct _ply_event_loop
 {
-        int                      epoll_fd;
-        int                      exit_code;
-        double                   wakeup_time;
+        int                              epoll_fd;
+        int                              exit_code;
+
+        ply_list_t                      *sources;
+        ply_event_source_t             **sources_by_fd;
+        int                              number_of_fd_slots;
+        ply_list_t                      *exit_closures;
+
+        /* Pending timeouts are kept in a binary min-heap ordered by
+         * deadline, and also grouped by user data so they can be found
+         * again when asked to stop watching them
+         */
+        ply_event_loop_timeout_watch_t **timeout_heap;
+        int                              number_of_timeout_watches;
+        int                              timeout_heap_size;
+        unsigned long                    next_timeout_serial;
+        ply_hashtable_t                 *timeout_watches_by_user_data;
+
+        int                              timer_fd;
+        double                           timer_fd_wakeup_time;
+
+        /* Timeouts with slack get their deadlines nudged onto a wakeup
+         * that's already going to happen, or onto a multiple of
+         * timer_grid, so they fire together
+         */
+        double                           timer_grid;
+        unsigned long                    number_of_coalesced_timeouts;
 
-        ply_list_t              *sources;
-        ply_list_t              *exit_closures;
-        ply_list_t              *timeout_watches;
+        double                           creation_time;
+        unsigned long                    number_of_wakeups;
+        unsigned long                    number_of_timer_wakeups;
 
-        ply_signal_dispatcher_t *signal_dispatcher;
+        ply_list_t                      *idle_watches[PLY_EVENT_LOOP_NUM_IDLE_PRIORITIES];
+        unsigned long                    next_idle_serial;
 
-        uint32_t                 should_exit : 1;
+        ply_signal_dispatcher_t         *signal_dispatcher;
+
+        /* How long each handler has taken, kept in the order they
+         * first ran and looked up by handler
+         */
+        ply_list_t                      *handler_statistics;
+        ply_hashtable_t                 *handler_statistics_by_handler;
+        double                           stall_threshold;
+
+        unsigned long                    number_of_dispatched_timeouts;
+        double                           total_timeout_lateness;
+        double                           maximum_timeout_lateness;
+
+        uint32_t                         should_exit : 1;
 };
 
 static void ply_event_loop_remove_source (ply_event_loop_t   *loop,
                                           ply_event_source_t *source);
-static ply_list_node_t *ply_event_loop_find_source_node (ply_event_loop_t *loop,
+static ply_event_source_t *ply_event_loop_lookup_source (ply_event_loop_t *loop,
                                                          int               fd);
-
-static ply_list_node_t *
-ply_signal_dispatcher_find_source_node (ply_signal_dispatcher_t *dispatcher,
-                                        int                      signal_number);
+static void ply_event_loop_record_handler_time (ply_event_loop_t *loop,
+                                                const char       *kind,
+                                                void             *handler,
+                                                int               fd,
+                                                double            start_time);
 
 
 static ply_signal_source_t *
@@ -158,46 +253,135 @@ static ply_signal_dispatcher_t *
 ply_signal_dispatcher_new (void)
 {
         ply_signal_dispatcher_t *dispatcher;
+        sigset_t no_signals;
+
+        dispatcher = calloc (1, sizeof(ply_signal_dispatcher_t));
+
+        sigemptyset (&dispatcher->watched_signals);
+        sigemptyset (&dispatcher->signals_blocked_before);
+
+        sigemptyset (&no_signals);
+        dispatcher->signal_fd = signalfd (-1, &no_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+        if (dispatcher->signal_fd >= 0)
+                return dispatcher;
+
+        ply_trace ("could not create signalfd, falling back to signal handlers: %m");
 
         if (!ply_open_unidirectional_pipe (&ply_signal_dispatcher_sender_fd,
-                                           &ply_signal_dispatcher_receiver_fd))
+                                           &ply_signal_dispatcher_receiver_fd)) {
+                free (dispatcher);
                 return NULL;
+        }
 
-        dispatcher = calloc (1, sizeof(ply_signal_dispatcher_t));
+        return dispatcher;
+}
 
-        dispatcher->sources = ply_list_new ();
+static int
+ply_signal_dispatcher_get_fd (ply_signal_dispatcher_t *dispatcher)
+{
+        if (dispatcher->signal_fd >= 0)
+                return dispatcher->signal_fd;
 
-        return dispatcher;
+        return ply_signal_dispatcher_receiver_fd;
+}
+
+static void
+ply_signal_dispatcher_block_signal (ply_signal_dispatcher_t *dispatcher,
+                                    int                      signal_number)
+{
+        sigset_t signals, old_signals;
+
+        sigemptyset (&signals);
+        sigaddset (&signals, signal_number);
+        sigprocmask (SIG_BLOCK, &signals, &old_signals);
+
+        if (sigismember (&old_signals, signal_number))
+                sigaddset (&dispatcher->signals_blocked_before, signal_number);
+
+        sigaddset (&dispatcher->watched_signals, signal_number);
+
+        if (signalfd (dispatcher->signal_fd, &dispatcher->watched_signals, 0) < 0)
+                ply_trace ("could not watch signal %d: %m", signal_number);
+}
+
+static void
+ply_signal_dispatcher_unblock_signal (ply_signal_dispatcher_t *dispatcher,
+                                      int                      signal_number)
+{
+        struct timespec no_time = { 0, 0 };
+        sigset_t signals;
+
+        if (!sigismember (&dispatcher->watched_signals, signal_number))
+                return;
+
+        sigdelset (&dispatcher->watched_signals, signal_number);
+        signalfd (dispatcher->signal_fd, &dispatcher->watched_signals, 0);
+
+        if (sigismember (&dispatcher->signals_blocked_before, signal_number)) {
+                sigdelset (&dispatcher->signals_blocked_before, signal_number);
+                return;
+        }
+
+        /* Nobody is listening anymore, so throw away any copy of the
+         * signal that hasn't been read yet, rather than letting it get
+         * its default action the moment it's unblocked
+         */
+        sigemptyset (&signals);
+        sigaddset (&signals, signal_number);
+        while (sigtimedwait (&signals, NULL, &no_time) > 0) {
+                ply_trace ("dropping pending signal %d", signal_number);
+        }
+
+        sigprocmask (SIG_UNBLOCK, &signals, NULL);
 }
 
 static void
 ply_signal_dispatcher_free (ply_signal_dispatcher_t *dispatcher)
 {
-        ply_list_node_t *node;
+        int signal_number;
 
         if (dispatcher == NULL)
                 return;
 
-        close (ply_signal_dispatcher_receiver_fd);
-        ply_signal_dispatcher_receiver_fd = -1;
-        close (ply_signal_dispatcher_sender_fd);
-        ply_signal_dispatcher_sender_fd = -1;
+        for (signal_number = 1; signal_number < NSIG; signal_number++) {
+                ply_list_t *sources;
+                ply_list_node_t *node;
 
-        node = ply_list_get_first_node (dispatcher->sources);
-        while (node != NULL) {
-                ply_list_node_t *next_node;
-                ply_signal_source_t *source;
+                sources = dispatcher->sources_by_signal[signal_number];
 
-                source = (ply_signal_source_t *) ply_list_node_get_data (node);
+                if (sources == NULL)
+                        continue;
 
-                next_node = ply_list_get_next_node (dispatcher->sources, node);
+                node = ply_list_get_first_node (sources);
+                while (node != NULL) {
+                        ply_list_node_t *next_node;
+                        ply_signal_source_t *source;
 
-                ply_signal_source_free (source);
+                        source = (ply_signal_source_t *) ply_list_node_get_data (node);
 
-                node = next_node;
+                        next_node = ply_list_get_next_node (sources, node);
+
+                        ply_signal_source_free (source);
+
+                        node = next_node;
+                }
+
+                ply_list_free (sources);
+                dispatcher->sources_by_signal[signal_number] = NULL;
+
+                if (dispatcher->signal_fd >= 0)
+                        ply_signal_dispatcher_unblock_signal (dispatcher, signal_number);
         }
 
-        ply_list_free (dispatcher->sources);
+        if (dispatcher->signal_fd >= 0) {
+                close (dispatcher->signal_fd);
+        } else {
+                close (ply_signal_dispatcher_receiver_fd);
+                ply_signal_dispatcher_receiver_fd = -1;
+                close (ply_signal_dispatcher_sender_fd);
+                ply_signal_dispatcher_sender_fd = -1;
+        }
 
         free (dispatcher);
 }
@@ -225,47 +409,106 @@ ply_signal_dispatcher_get_next_signal_from_pipe (ply_signal_dispatcher_t *dispat
 }
 
 static void
-ply_signal_dispatcher_dispatch_signal (ply_signal_dispatcher_t *dispatcher,
-                                       int                      fd)
+ply_signal_dispatcher_run_handlers (ply_signal_dispatcher_t *dispatcher,
+                                    int                      signal_number)
 {
+        ply_list_t *sources;
         ply_list_node_t *node;
-        int signal_number;
 
-        assert (fd == ply_signal_dispatcher_receiver_fd);
+        if (signal_number <= 0 || signal_number >= NSIG)
+                return;
+
+        sources = dispatcher->sources_by_signal[signal_number];
 
-        signal_number = ply_signal_dispatcher_get_next_signal_from_pipe (dispatcher);
+        if (sources == NULL)
+                return;
 
-        node = ply_list_get_first_node (dispatcher->sources);
+        node = ply_list_get_first_node (sources);
         while (node != NULL) {
+                ply_list_node_t *next_node;
                 ply_signal_source_t *source;
 
                 source = (ply_signal_source_t *) ply_list_node_get_data (node);
+                next_node = ply_list_get_next_node (sources, node);
 
-                if (source->signal_number == signal_number)
-                        if (source->handler != NULL)
-                                source->handler (source->user_data, signal_number);
+                if (source->handler != NULL) {
+                        double start_time;
 
-                node = ply_list_get_next_node (dispatcher->sources, node);
+                        start_time = ply_get_timestamp ();
+                        source->handler (source->user_data, signal_number);
+                        ply_event_loop_record_handler_time (dispatcher->loop, "signal",
+                                                            source->handler, -1,
+                                                            start_time);
+                }
+
+                node = next_node;
         }
 }
 
+static void
+ply_signal_dispatcher_dispatch_signal (ply_signal_dispatcher_t *dispatcher,
+                                       int                      fd)
+{
+        struct signalfd_siginfo signals[PLY_SIGNAL_DISPATCHER_NUM_SIGNALS_PER_READ];
+        ssize_t bytes_read;
+        size_t i, number_of_signals;
+
+        assert (fd == ply_signal_dispatcher_get_fd (dispatcher));
+
+        if (dispatcher->signal_fd < 0) {
+                ply_signal_dispatcher_run_handlers (dispatcher,
+                                                    ply_signal_dispatcher_get_next_signal_from_pipe (dispatcher));
+                return;
+        }
+
+        do {
+                bytes_read = read (dispatcher->signal_fd, signals, sizeof(signals));
+
+                if (bytes_read < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        break;
+                }
+
+                number_of_signals = bytes_read / sizeof(struct signalfd_siginfo);
+                for (i = 0; i < number_of_signals; i++) {
+                        ply_signal_dispatcher_run_handlers (dispatcher, signals[i].ssi_signo);
+                }
+        } while (bytes_read == sizeof(signals));
+}
+
 static void
 ply_signal_dispatcher_reset_signal_sources (ply_signal_dispatcher_t *dispatcher,
                                             int                      fd)
 {
-        ply_list_node_t *node;
+        int signal_number;
 
-        node = ply_list_get_first_node (dispatcher->sources);
-        while (node != NULL) {
-                ply_signal_source_t *handler;
+        for (signal_number = 1; signal_number < NSIG; signal_number++) {
+                ply_list_t *sources;
+                ply_list_node_t *node;
+
+                sources = dispatcher->sources_by_signal[signal_number];
+
+                if (sources == NULL || ply_list_get_length (sources) == 0)
+                        continue;
+
+                if (dispatcher->signal_fd >= 0) {
+                        ply_signal_dispatcher_unblock_signal (dispatcher, signal_number);
+                        continue;
+                }
+
+                node = ply_list_get_first_node (sources);
+                while (node != NULL) {
+                        ply_signal_source_t *handler;
 
-                handler = (ply_signal_source_t *) ply_list_node_get_data (node);
+                        handler = (ply_signal_source_t *) ply_list_node_get_data (node);
 
-                signal (handler->signal_number,
-                        handler->old_posix_signal_handler != NULL ?
-                        handler->old_posix_signal_handler : SIG_DFL);
+                        signal (handler->signal_number,
+                                handler->old_posix_signal_handler != NULL ?
+                                handler->old_posix_signal_handler : SIG_DFL);
 
-                node = ply_list_get_next_node (dispatcher->sources, node);
+                        node = ply_list_get_next_node (sources, node);
+                }
         }
 }
 
@@ -377,6 +620,7 @@ ply_event_loop_update_source_event_mask (ply_event_loop_t   *loop,
         assert (source->destinations != NULL);
 
         event.events = EPOLLERR | EPOLLHUP;
+        source->handled_status = PLY_EVENT_LOOP_FD_STATUS_NONE;
 
         node = ply_list_get_first_node (source->destinations);
         while (node != NULL) {
@@ -395,10 +639,20 @@ ply_event_loop_update_source_event_mask (ply_event_loop_t   *loop,
                 if (destination->status & PLY_EVENT_LOOP_FD_STATUS_CAN_TAKE_DATA)
                         event.events |= EPOLLOUT;
 
+                if (destination->status_met_handler != NULL)
+                        source->handled_status |= destination->status;
+
                 node = next_node;
         }
         event.data.ptr = source;
 
+        /* Don't bother the kernel if nothing changed
+         */
+        if (event.events == source->event_mask)
+                return;
+
+        source->event_mask = event.events;
+
         if (source->is_getting_polled) {
                 int status;
 
@@ -414,7 +668,6 @@ ply_event_loop_add_destination_for_source (ply_event_loop_t        *loop,
                                            ply_event_destination_t *destination,
                                            ply_event_source_t      *source)
 {
-        ply_list_node_t *destination_node;
         ply_fd_watch_t *watch;
 
         assert (loop != NULL);
@@ -424,8 +677,8 @@ ply_event_loop_add_destination_for_source (ply_event_loop_t        *loop,
 
         destination->source = source;
         ply_event_source_take_reference (source);
-        destination_node = ply_list_append_data (source->destinations, destination);
-        assert (destination_node != NULL);
+        destination->node = ply_list_append_data (source->destinations, destination);
+        assert (destination->node != NULL);
         assert (destination->source == source);
 
         ply_event_loop_update_source_event_mask (loop, source);
@@ -433,7 +686,7 @@ ply_event_loop_add_destination_for_source (ply_event_loop_t        *loop,
         watch = ply_fd_watch_new (destination);
 
         ply_event_source_take_reference (source);
-        ply_list_append_data (source->fd_watches, watch);
+        watch->node = ply_list_append_data (source->fd_watches, watch);
 
         return watch;
 }
@@ -469,21 +722,41 @@ ply_event_loop_remove_destination_by_fd_watch (ply_event_loop_t *loop,
         source = destination->source;
         assert (source != NULL);
 
-        ply_list_remove_data (source->destinations, destination);
+        ply_list_remove_node (source->destinations, destination->node);
+        destination->node = NULL;
         ply_event_source_drop_reference (source);
-        assert (ply_list_find_node (source->destinations, destination) == NULL);
         ply_event_loop_update_source_event_mask (loop, source);
 }
 
+static void
+ply_event_loop_on_timer_fd_ready (ply_event_loop_t *loop,
+                                  int               fd)
+{
+        uint64_t number_of_expirations;
+
+        /* The timeouts themselves get handled on every iteration, this
+         * just acknowledges the wakeup.  Forget what the timer was set
+         * to, so it gets set again even if the earliest deadline came out
+         * a hair later than the clock when the timer went off
+         */
+        if (read (fd, &number_of_expirations, sizeof(number_of_expirations)) < 0 &&
+            errno != EAGAIN)
+                ply_trace ("could not read timer: %m");
+
+        loop->timer_fd_wakeup_time = PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
+        loop->number_of_timer_wakeups++;
+}
+
 ply_event_loop_t *
 ply_event_loop_new (void)
 {
         ply_event_loop_t *loop;
+        ply_fd_watch_t *watch;
+        int i;
 
         loop = calloc (1, sizeof(ply_event_loop_t));
 
         loop->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
-        loop->wakeup_time = PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
 
         assert (loop->epoll_fd >= 0);
 
@@ -492,21 +765,54 @@ ply_event_loop_new (void)
 
         loop->sources = ply_list_new ();
         loop->exit_closures = ply_list_new ();
-        loop->timeout_watches = ply_list_new ();
+        loop->timeout_watches_by_user_data = ply_hashtable_new (ply_hashtable_direct_hash,
+                                                                ply_hashtable_direct_compare);
+        loop->timer_fd_wakeup_time = PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
+        loop->creation_time = ply_get_timestamp ();
+
+        for (i = 0; i < PLY_EVENT_LOOP_NUM_IDLE_PRIORITIES; i++) {
+                loop->idle_watches[i] = ply_list_new ();
+        }
+
+        loop->handler_statistics = ply_list_new ();
+        loop->handler_statistics_by_handler = ply_hashtable_new (ply_hashtable_direct_hash,
+                                                                 ply_hashtable_direct_compare);
 
         loop->signal_dispatcher = ply_signal_dispatcher_new ();
 
         if (loop->signal_dispatcher == NULL)
                 return NULL;
 
-        ply_event_loop_watch_fd (loop,
-                                 ply_signal_dispatcher_receiver_fd,
-                                 PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
-                                 (ply_event_handler_t)
-                                 ply_signal_dispatcher_dispatch_signal,
-                                 (ply_event_handler_t)
-                                 ply_signal_dispatcher_reset_signal_sources,
-                                 loop->signal_dispatcher);
+        loop->signal_dispatcher->loop = loop;
+
+        watch = ply_event_loop_watch_fd (loop,
+                                         ply_signal_dispatcher_get_fd (loop->signal_dispatcher),
+                                         PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                         (ply_event_handler_t)
+                                         ply_signal_dispatcher_dispatch_signal,
+                                         (ply_event_handler_t)
+                                         ply_signal_dispatcher_reset_signal_sources,
+                                         loop->signal_dispatcher);
+        watch->destination->is_internal = true;
+
+        /* Timeouts wake the loop up through a timer in the epoll set
+         * rather than epoll_wait's timeout, which only has millisecond
+         * granularity.  If there's no timerfd, fall back to that.
+         */
+        loop->timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+        if (loop->timer_fd >= 0) {
+                watch = ply_event_loop_watch_fd (loop,
+                                                 loop->timer_fd,
+                                                 PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                                 (ply_event_handler_t)
+                                                 ply_event_loop_on_timer_fd_ready,
+                                                 NULL,
+                                                 loop);
+                watch->destination->is_internal = true;
+        } else {
+                ply_trace ("could not create timer, timeouts will be less precise: %m");
+        }
 
         return loop;
 }
@@ -565,41 +871,58 @@ ply_event_loop_run_exit_closures (ply_event_loop_t *loop)
 void
 ply_event_loop_free (ply_event_loop_t *loop)
 {
+        ply_list_node_t *node;
+        int i;
+
         if (loop == NULL)
                 return;
 
         assert (ply_list_get_length (loop->sources) == 0);
-        assert (ply_list_get_length (loop->timeout_watches) == 0);
+        assert (loop->number_of_timeout_watches == 0);
 
         ply_signal_dispatcher_free (loop->signal_dispatcher);
         ply_event_loop_free_exit_closures (loop);
 
+        for (i = 0; i < PLY_EVENT_LOOP_NUM_IDLE_PRIORITIES; i++) {
+                assert (ply_list_get_length (loop->idle_watches[i]) == 0);
+                ply_list_free (loop->idle_watches[i]);
+        }
+
+        node = ply_list_get_first_node (loop->handler_statistics);
+        while (node != NULL) {
+                ply_list_node_t *next_node;
+
+                next_node = ply_list_get_next_node (loop->handler_statistics, node);
+                free (ply_list_node_get_data (node));
+                node = next_node;
+        }
+        ply_list_free (loop->handler_statistics);
+        ply_hashtable_free (loop->handler_statistics_by_handler);
+
         ply_list_free (loop->sources);
-        ply_list_free (loop->timeout_watches);
+        free (loop->sources_by_fd);
+        ply_hashtable_free (loop->timeout_watches_by_user_data);
+        free (loop->timeout_heap);
+
+        if (loop->timer_fd >= 0)
+                close (loop->timer_fd);
 
         close (loop->epoll_fd);
         free (loop);
 }
 
-static ply_list_node_t *
-ply_event_loop_find_source_node (ply_event_loop_t *loop,
-                                 int               fd)
+/* Sources are indexed by fd, so finding one doesn't depend on how
+ * many other fds are being watched.  fds are small and densely
+ * allocated, so a plain array does the job.
+ */
+static ply_event_source_t *
+ply_event_loop_lookup_source (ply_event_loop_t *loop,
+                              int               fd)
 {
-        ply_list_node_t *node;
-
-        node = ply_list_get_first_node (loop->sources);
-        while (node != NULL) {
-                ply_event_source_t *source;
-
-                source = (ply_event_source_t *) ply_list_node_get_data (node);
-
-                if (source->fd == fd)
-                        break;
-
-                node = ply_list_get_next_node (loop->sources, node);
-        }
+        if (fd >= loop->number_of_fd_slots)
+                return NULL;
 
-        return node;
+        return loop->sources_by_fd[fd];
 }
 
 static void
@@ -609,7 +932,7 @@ ply_event_loop_add_source (ply_event_loop_t   *loop,
         struct epoll_event event = { 0 };
         int status;
 
-        assert (ply_event_loop_find_source_node (loop, source->fd) == NULL);
+        assert (ply_event_loop_lookup_source (loop, source->fd) == NULL);
         assert (source->is_getting_polled == false);
 
         event.events = EPOLLERR | EPOLLHUP;
@@ -618,10 +941,27 @@ ply_event_loop_add_source (ply_event_loop_t   *loop,
         status = epoll_ctl (loop->epoll_fd, EPOLL_CTL_ADD, source->fd, &event);
         assert (status == 0);
 
+        source->event_mask = event.events;
         source->is_getting_polled = true;
 
+        if (source->fd >= loop->number_of_fd_slots) {
+                int number_of_fd_slots;
+
+                number_of_fd_slots = MAX (2 * loop->number_of_fd_slots, 64);
+                while (number_of_fd_slots <= source->fd) {
+                        number_of_fd_slots *= 2;
+                }
+
+                loop->sources_by_fd = realloc (loop->sources_by_fd,
+                                               number_of_fd_slots * sizeof(ply_event_source_t *));
+                memset (loop->sources_by_fd + loop->number_of_fd_slots, 0,
+                        (number_of_fd_slots - loop->number_of_fd_slots) * sizeof(ply_event_source_t *));
+                loop->number_of_fd_slots = number_of_fd_slots;
+        }
+        loop->sources_by_fd[source->fd] = source;
+
         ply_event_source_take_reference (source);
-        ply_list_append_data (loop->sources, source);
+        source->node = ply_list_append_data (loop->sources, source);
 }
 
 static void
@@ -644,7 +984,11 @@ ply_event_loop_remove_source_node (ply_event_loop_t *loop,
                 source->is_getting_polled = false;
         }
 
+        assert (loop->sources_by_fd[source->fd] == source);
+        loop->sources_by_fd[source->fd] = NULL;
+
         ply_list_remove_node (loop->sources, source_node);
+        source->node = NULL;
         ply_event_source_drop_reference (source);
 }
 
@@ -652,15 +996,10 @@ static void
 ply_event_loop_remove_source (ply_event_loop_t   *loop,
                               ply_event_source_t *source)
 {
-        ply_list_node_t *source_node;
-
         assert (ply_list_get_length (source->destinations) == 0);
+        assert (source->node != NULL);
 
-        source_node = ply_list_find_node (loop->sources, source);
-
-        assert (source_node != NULL);
-
-        ply_event_loop_remove_source_node (loop, source_node);
+        ply_event_loop_remove_source_node (loop, source->node);
 }
 
 static void
@@ -691,20 +1030,15 @@ static ply_event_source_t *
 ply_event_loop_get_source_from_fd (ply_event_loop_t *loop,
                                    int               fd)
 {
-        ply_list_node_t *source_node;
         ply_event_source_t *source;
 
-        source_node = ply_event_loop_find_source_node (loop, fd);
+        source = ply_event_loop_lookup_source (loop, fd);
 
-        if (source_node == NULL) {
+        if (source == NULL) {
                 source = ply_event_source_new (fd);
                 ply_event_loop_add_source (loop, source);
-
-                source_node = ply_list_get_last_node (loop->sources);
-                assert (source_node != NULL);
         }
 
-        source = (ply_event_source_t *) ply_list_node_get_data (source_node);
         assert (source->fd == fd);
 
         return source;
@@ -766,7 +1100,7 @@ ply_event_loop_stop_watching_fd (ply_event_loop_t *loop,
          */
         if (source->is_disconnected) {
                 ply_trace ("source for fd %d is already disconnected", source->fd);
-                ply_list_remove_data (source->fd_watches, watch);
+                ply_list_remove_node (source->fd_watches, watch->node);
                 ply_event_source_drop_reference (source);
                 ply_fd_watch_free (watch);
                 return;
@@ -775,7 +1109,7 @@ ply_event_loop_stop_watching_fd (ply_event_loop_t *loop,
         ply_trace ("removing destination for fd %d", source->fd);
         ply_event_loop_remove_destination_by_fd_watch (loop, watch);
 
-        ply_list_remove_data (source->fd_watches, watch);
+        ply_list_remove_node (source->fd_watches, watch->node);
         ply_event_source_drop_reference (source);
         ply_fd_watch_free (watch);
         ply_event_destination_free (destination);
@@ -786,74 +1120,69 @@ ply_event_loop_stop_watching_fd (ply_event_loop_t *loop,
         }
 }
 
-static ply_list_node_t *
-ply_signal_dispatcher_find_source_node (ply_signal_dispatcher_t *dispatcher,
-                                        int                      signal_number)
-{
-        ply_list_node_t *node;
-
-        node = ply_list_get_first_node (dispatcher->sources);
-        while (node != NULL) {
-                ply_signal_source_t *handler;
-
-                handler = (ply_signal_source_t *) ply_list_node_get_data (node);
-
-                assert (handler != NULL);
-
-                if (handler->signal_number == signal_number)
-                        break;
-
-                node = ply_list_get_next_node (dispatcher->sources, node);
-        }
-
-        return node;
-}
-
 void
 ply_event_loop_watch_signal (ply_event_loop_t   *loop,
                              int                 signal_number,
                              ply_event_handler_t signal_handler,
                              void               *user_data)
 {
+        ply_signal_dispatcher_t *dispatcher;
         ply_signal_source_t *source;
 
+        assert (signal_number > 0 && signal_number < NSIG);
+
+        dispatcher = loop->signal_dispatcher;
         source = ply_signal_source_new (signal_number,
                                         signal_handler,
                                         user_data);
 
-        source->old_posix_signal_handler =
-                signal (signal_number, ply_signal_dispatcher_posix_signal_handler);
-        ply_list_append_data (loop->signal_dispatcher->sources, source);
-}
+        if (dispatcher->sources_by_signal[signal_number] == NULL)
+                dispatcher->sources_by_signal[signal_number] = ply_list_new ();
 
-static void
-ply_signal_dispatcher_remove_source_node (ply_signal_dispatcher_t *dispatcher,
-                                          ply_list_node_t         *node)
-{
-        ply_signal_source_t *source;
-
-        source = (ply_signal_source_t *) ply_list_node_get_data (node);
-
-        signal (source->signal_number,
-                source->old_posix_signal_handler != NULL ?
-                source->old_posix_signal_handler : SIG_DFL);
+        if (dispatcher->signal_fd >= 0) {
+                if (!sigismember (&dispatcher->watched_signals, signal_number))
+                        ply_signal_dispatcher_block_signal (dispatcher, signal_number);
+        } else {
+                source->old_posix_signal_handler =
+                        signal (signal_number, ply_signal_dispatcher_posix_signal_handler);
+        }
 
-        ply_list_remove_node (dispatcher->sources, node);
+        ply_list_append_data (dispatcher->sources_by_signal[signal_number], source);
 }
 
 void
 ply_event_loop_stop_watching_signal (ply_event_loop_t *loop,
                                      int               signal_number)
 {
+        ply_signal_dispatcher_t *dispatcher;
+        ply_signal_source_t *source;
         ply_list_node_t *node;
 
-        node = ply_signal_dispatcher_find_source_node (loop->signal_dispatcher,
-                                                       signal_number);
+        assert (signal_number > 0 && signal_number < NSIG);
+
+        dispatcher = loop->signal_dispatcher;
+
+        if (dispatcher->sources_by_signal[signal_number] == NULL)
+                return;
+
+        node = ply_list_get_first_node (dispatcher->sources_by_signal[signal_number]);
 
         if (node == NULL)
                 return;
 
-        ply_signal_dispatcher_remove_source_node (loop->signal_dispatcher, node);
+        source = (ply_signal_source_t *) ply_list_node_get_data (node);
+        ply_list_remove_node (dispatcher->sources_by_signal[signal_number], node);
+
+        if (dispatcher->signal_fd >= 0) {
+                if (ply_list_get_length (dispatcher->sources_by_signal[signal_number]) == 0)
+                        ply_signal_dispatcher_unblock_signal (dispatcher, signal_number);
+        } else {
+                signal (source->signal_number,
+                        source->old_posix_signal_handler != NULL ?
+                        source->old_posix_signal_handler : SIG_DFL);
+        }
+
+        ply_signal_source_free (source);
 }
 
 void
@@ -898,11 +1227,282 @@ ply_event_loop_stop_watching_for_exit (ply_event_loop_t             *loop,
         }
 }
 
+static bool
+ply_event_loop_timeout_watch_is_due_before (ply_event_loop_timeout_watch_t *watch,
+                                            ply_event_loop_timeout_watch_t *other_watch)
+{
+        /* Timeouts with the same deadline go off in the order they were added
+         */
+        if (watch->timeout != other_watch->timeout)
+                return watch->timeout < other_watch->timeout;
+
+        return watch->serial < other_watch->serial;
+}
+
+static void
+ply_event_loop_place_timeout_watch (ply_event_loop_t               *loop,
+                                    ply_event_loop_timeout_watch_t *watch,
+                                    int                             heap_index)
+{
+        loop->timeout_heap[heap_index] = watch;
+        watch->heap_index = heap_index;
+}
+
+static void
+ply_event_loop_sift_timeout_watch_up (ply_event_loop_t *loop,
+                                      int               heap_index)
+{
+        ply_event_loop_timeout_watch_t *watch;
+
+        watch = loop->timeout_heap[heap_index];
+        while (heap_index > 0) {
+                int parent_index;
+
+                parent_index = (heap_index - 1) / 2;
+
+                if (!ply_event_loop_timeout_watch_is_due_before (watch, loop->timeout_heap[parent_index]))
+                        break;
+
+                ply_event_loop_place_timeout_watch (loop, loop->timeout_heap[parent_index], heap_index);
+                heap_index = parent_index;
+        }
+        ply_event_loop_place_timeout_watch (loop, watch, heap_index);
+}
+
+static void
+ply_event_loop_sift_timeout_watch_down (ply_event_loop_t *loop,
+                                        int               heap_index)
+{
+        ply_event_loop_timeout_watch_t *watch;
+
+        watch = loop->timeout_heap[heap_index];
+        while (true) {
+                int child_index;
+
+                child_index = 2 * heap_index + 1;
+
+                if (child_index >= loop->number_of_timeout_watches)
+                        break;
+
+                if (child_index + 1 < loop->number_of_timeout_watches &&
+                    ply_event_loop_timeout_watch_is_due_before (loop->timeout_heap[child_index + 1],
+                                                                loop->timeout_heap[child_index]))
+                        child_index++;
+
+                if (!ply_event_loop_timeout_watch_is_due_before (loop->timeout_heap[child_index], watch))
+                        break;
+
+                ply_event_loop_place_timeout_watch (loop, loop->timeout_heap[child_index], heap_index);
+                heap_index = child_index;
+        }
+        ply_event_loop_place_timeout_watch (loop, watch, heap_index);
+}
+
+static void
+ply_event_loop_add_timeout_watch (ply_event_loop_t               *loop,
+                                  ply_event_loop_timeout_watch_t *watch)
+{
+        ply_list_t *watches;
+
+        if (loop->number_of_timeout_watches == loop->timeout_heap_size) {
+                loop->timeout_heap_size = MAX (2 * loop->timeout_heap_size, 16);
+                loop->timeout_heap = realloc (loop->timeout_heap,
+                                              loop->timeout_heap_size * sizeof(ply_event_loop_timeout_watch_t *));
+        }
+
+        watch->serial = loop->next_timeout_serial++;
+        ply_event_loop_place_timeout_watch (loop, watch, loop->number_of_timeout_watches);
+        loop->number_of_timeout_watches++;
+        ply_event_loop_sift_timeout_watch_up (loop, watch->heap_index);
+
+        watches = ply_hashtable_lookup (loop->timeout_watches_by_user_data, watch->user_data);
+
+        if (watches == NULL) {
+                watches = ply_list_new ();
+                ply_hashtable_insert (loop->timeout_watches_by_user_data, watch->user_data, watches);
+        }
+
+        watch->node = ply_list_append_data (watches, watch);
+}
+
+static void
+ply_event_loop_remove_timeout_watch (ply_event_loop_t               *loop,
+                                     ply_event_loop_timeout_watch_t *watch)
+{
+        ply_event_loop_timeout_watch_t *last_watch;
+        ply_list_t *watches;
+        int heap_index;
+
+        assert (watch->heap_index < loop->number_of_timeout_watches);
+        assert (loop->timeout_heap[watch->heap_index] == watch);
+
+        heap_index = watch->heap_index;
+        loop->number_of_timeout_watches--;
+        last_watch = loop->timeout_heap[loop->number_of_timeout_watches];
+
+        if (last_watch != watch) {
+                ply_event_loop_place_timeout_watch (loop, last_watch, heap_index);
+
+                if (heap_index > 0 &&
+                    ply_event_loop_timeout_watch_is_due_before (last_watch,
+                                                                loop->timeout_heap[(heap_index - 1) / 2]))
+                        ply_event_loop_sift_timeout_watch_up (loop, heap_index);
+                else
+                        ply_event_loop_sift_timeout_watch_down (loop, heap_index);
+        }
+        watch->heap_index = -1;
+
+        watches = ply_hashtable_lookup (loop->timeout_watches_by_user_data, watch->user_data);
+        assert (watches != NULL);
+
+        ply_list_remove_node (watches, watch->node);
+        watch->node = NULL;
+
+        if (ply_list_get_length (watches) == 0) {
+                ply_hashtable_remove (loop->timeout_watches_by_user_data, watch->user_data);
+                ply_list_free (watches);
+        }
+}
+
+static double
+ply_event_loop_get_wakeup_time (ply_event_loop_t *loop)
+{
+        if (loop->number_of_timeout_watches == 0)
+                return PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
+
+        return loop->timeout_heap[0]->timeout;
+}
+
+static void
+ply_event_loop_update_timer_fd (ply_event_loop_t *loop)
+{
+        struct itimerspec timer_spec = { { 0 } };
+        double wakeup_time;
+
+        wakeup_time = ply_event_loop_get_wakeup_time (loop);
+
+        if (wakeup_time == loop->timer_fd_wakeup_time)
+                return;
+
+        if (fabs (wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) > 0) {
+                double seconds;
+
+                /* Round up, so the timer never goes off before the deadline,
+                 * and never arm it with all zeros, since that disarms it
+                 */
+                seconds = floor (wakeup_time);
+                timer_spec.it_value.tv_sec = (time_t) seconds;
+                timer_spec.it_value.tv_nsec = (long) ceil ((wakeup_time - seconds) * 1000000000.0);
+
+                if (timer_spec.it_value.tv_nsec >= 1000000000L) {
+                        timer_spec.it_value.tv_sec++;
+                        timer_spec.it_value.tv_nsec -= 1000000000L;
+                }
+
+                if (timer_spec.it_value.tv_sec == 0 && timer_spec.it_value.tv_nsec == 0)
+                        timer_spec.it_value.tv_nsec = 1;
+        }
+
+        if (timerfd_settime (loop->timer_fd, TFD_TIMER_ABSTIME, &timer_spec, NULL) < 0) {
+                ply_trace ("could not set timer: %m");
+                return;
+        }
+
+        loop->timer_fd_wakeup_time = wakeup_time;
+}
+
+/* Finds the earliest pending deadline between earliest_deadline and
+ * latest_deadline below index in the heap.  Whole subtrees starting
+ * past latest_deadline get skipped, and so do the ones under a match,
+ * since nothing in them can be earlier.
+ */
+static void
+ply_event_loop_find_timeout_between (ply_event_loop_t *loop,
+                                     int               index,
+                                     double            earliest_deadline,
+                                     double            latest_deadline,
+                                     double           *deadline)
+{
+        double timeout;
+
+        if (index >= loop->number_of_timeout_watches)
+                return;
+
+        timeout = loop->timeout_heap[index]->timeout;
+
+        if (timeout > latest_deadline || timeout >= *deadline)
+                return;
+
+        if (timeout >= earliest_deadline) {
+                *deadline = timeout;
+                return;
+        }
+
+        ply_event_loop_find_timeout_between (loop, 2 * index + 1,
+                                             earliest_deadline, latest_deadline,
+                                             deadline);
+        ply_event_loop_find_timeout_between (loop, 2 * index + 2,
+                                             earliest_deadline, latest_deadline,
+                                             deadline);
+}
+
+static double
+ply_event_loop_coalesce_deadline (ply_event_loop_t *loop,
+                                  double            deadline,
+                                  double            slack)
+{
+        double latest_deadline, coalesced_deadline;
+
+        if (slack <= 0.0)
+                return deadline;
+
+        latest_deadline = deadline + slack;
+
+        /* Best case, the loop is already going to wake up in time for
+         * some other timeout
+         */
+        coalesced_deadline = INFINITY;
+        ply_event_loop_find_timeout_between (loop, 0, deadline, latest_deadline,
+                                             &coalesced_deadline);
+
+        if (coalesced_deadline <= latest_deadline) {
+                loop->number_of_coalesced_timeouts++;
+                return coalesced_deadline;
+        }
+
+        if (loop->timer_grid > 0.0) {
+                coalesced_deadline = ceil (deadline / loop->timer_grid) * loop->timer_grid;
+
+                if (coalesced_deadline <= latest_deadline) {
+                        if (coalesced_deadline > deadline)
+                                loop->number_of_coalesced_timeouts++;
+                        return coalesced_deadline;
+                }
+        }
+
+        return deadline;
+}
+
 void
 ply_event_loop_watch_for_timeout (ply_event_loop_t                *loop,
                                   double                           seconds,
                                   ply_event_loop_timeout_handler_t timeout_handler,
                                   void                            *user_data)
+{
+        ply_event_loop_watch_for_timeout_with_slack (loop, seconds, 0.0,
+                                                     timeout_handler, user_data);
+}
+
+/* Like ply_event_loop_watch_for_timeout (), but the handler may run up
+ * to slack seconds late if that lets it share a wakeup with something
+ * else.  It never runs early.
+ */
+void
+ply_event_loop_watch_for_timeout_with_slack (ply_event_loop_t                *loop,
+                                             double                           seconds,
+                                             double                           slack,
+                                             ply_event_loop_timeout_handler_t timeout_handler,
+                                             void                            *user_data)
 {
         ply_event_loop_timeout_watch_t *timeout_watch;
 
@@ -911,16 +1511,26 @@ ply_event_loop_watch_for_timeout (ply_event_loop_t                *loop,
         assert (seconds > 0.0);
 
         timeout_watch = calloc (1, sizeof(ply_event_loop_timeout_watch_t));
-        timeout_watch->timeout = ply_get_timestamp () + seconds;
+        timeout_watch->timeout = ply_event_loop_coalesce_deadline (loop,
+                                                                   ply_get_timestamp () + seconds,
+                                                                   slack);
         timeout_watch->handler = timeout_handler;
         timeout_watch->user_data = user_data;
 
-        if (fabs (loop->wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0)
-                loop->wakeup_time = timeout_watch->timeout;
-        else
-                loop->wakeup_time = MIN (loop->wakeup_time, timeout_watch->timeout);
+        ply_event_loop_add_timeout_watch (loop, timeout_watch);
+}
 
-        ply_list_append_data (loop->timeout_watches, timeout_watch);
+/* Timeouts with slack that can't share a wakeup that's already
+ * scheduled get pushed to the next multiple of seconds instead, if
+ * their slack reaches that far.  0 turns that off.
+ */
+void
+ply_event_loop_set_timer_grid (ply_event_loop_t *loop,
+                               double            seconds)
+{
+        assert (loop != NULL);
+
+        loop->timer_grid = MAX (seconds, 0.0);
 }
 
 void
@@ -928,34 +1538,33 @@ ply_event_loop_stop_watching_for_timeout (ply_event_loop_t                *loop,
                                           ply_event_loop_timeout_handler_t timeout_handler,
                                           void                            *user_data)
 {
+        ply_list_t *watches;
         ply_list_node_t *node;
         bool timeout_removed;
 
-        loop->wakeup_time = PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
-
         timeout_removed = false;
-        node = ply_list_get_first_node (loop->timeout_watches);
+
+        watches = ply_hashtable_lookup (loop->timeout_watches_by_user_data, user_data);
+
+        node = watches != NULL ? ply_list_get_first_node (watches) : NULL;
         while (node != NULL) {
                 ply_list_node_t *next_node;
                 ply_event_loop_timeout_watch_t *timeout_watch;
 
                 timeout_watch = (ply_event_loop_timeout_watch_t *) ply_list_node_get_data (node);
-                next_node = ply_list_get_next_node (loop->timeout_watches, node);
-
-                if (timeout_watch->handler == timeout_handler &&
-                    timeout_watch->user_data == user_data) {
-                        ply_list_remove_node (loop->timeout_watches, node);
-                        free (timeout_watch);
+                next_node = ply_list_get_next_node (watches, node);
 
+                if (timeout_watch->handler == timeout_handler) {
                         if (timeout_removed)
                                 ply_trace ("multiple matching timeouts found for removal");
 
                         timeout_removed = true;
-                } else {
-                        if (fabs (loop->wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0)
-                                loop->wakeup_time = timeout_watch->timeout;
-                        else
-                                loop->wakeup_time = MIN (loop->wakeup_time, timeout_watch->timeout);
+
+                        /* This frees the list along with its last watch, but
+                         * next_node is NULL by then
+                         */
+                        ply_event_loop_remove_timeout_watch (loop, timeout_watch);
+                        free (timeout_watch);
                 }
 
                 node = next_node;
@@ -965,6 +1574,83 @@ ply_event_loop_stop_watching_for_timeout (ply_event_loop_t                *loop,
                 ply_trace ("no matching timeout found for removal");
 }
 
+/* Idle handlers run once, after the events and timeouts of the current
+ * iteration have been handled and before the loop goes back to sleep.
+ * Higher priorities go first, and handlers of the same priority run in
+ * the order they were added.  Handlers added while idle handlers are
+ * running wait for the next iteration, which won't sleep.
+ */
+void
+ply_event_loop_watch_for_idle (ply_event_loop_t              *loop,
+                               ply_event_loop_idle_priority_t priority,
+                               ply_event_loop_idle_handler_t  idle_handler,
+                               void                          *user_data)
+{
+        ply_event_loop_idle_watch_t *idle_watch;
+
+        assert (loop != NULL);
+        assert (idle_handler != NULL);
+        assert (priority >= PLY_EVENT_LOOP_IDLE_PRIORITY_HIGH &&
+                priority <= PLY_EVENT_LOOP_IDLE_PRIORITY_LOW);
+
+        idle_watch = calloc (1, sizeof(ply_event_loop_idle_watch_t));
+        idle_watch->handler = idle_handler;
+        idle_watch->user_data = user_data;
+        idle_watch->serial = loop->next_idle_serial++;
+
+        ply_list_append_data (loop->idle_watches[priority], idle_watch);
+}
+
+void
+ply_event_loop_stop_watching_for_idle (ply_event_loop_t             *loop,
+                                       ply_event_loop_idle_handler_t idle_handler,
+                                       void                         *user_data)
+{
+        bool idle_watch_removed;
+        int i;
+
+        assert (loop != NULL);
+
+        idle_watch_removed = false;
+        for (i = 0; i < PLY_EVENT_LOOP_NUM_IDLE_PRIORITIES; i++) {
+                ply_list_node_t *node;
+
+                node = ply_list_get_first_node (loop->idle_watches[i]);
+                while (node != NULL) {
+                        ply_list_node_t *next_node;
+                        ply_event_loop_idle_watch_t *idle_watch;
+
+                        idle_watch = (ply_event_loop_idle_watch_t *) ply_list_node_get_data (node);
+                        next_node = ply_list_get_next_node (loop->idle_watches[i], node);
+
+                        if (idle_watch->handler == idle_handler &&
+                            idle_watch->user_data == user_data) {
+                                ply_list_remove_node (loop->idle_watches[i], node);
+                                free (idle_watch);
+                                idle_watch_removed = true;
+                        }
+
+                        node = next_node;
+                }
+        }
+
+        if (!idle_watch_removed)
+                ply_trace ("no matching idle handler found for removal");
+}
+
+static bool
+ply_event_loop_has_idle_watches (ply_event_loop_t *loop)
+{
+        int i;
+
+        for (i = 0; i < PLY_EVENT_LOOP_NUM_IDLE_PRIORITIES; i++) {
+                if (ply_list_get_length (loop->idle_watches[i]) > 0)
+                        return true;
+        }
+
+        return false;
+}
+
 static ply_event_loop_fd_status_t
 ply_event_loop_get_fd_status_from_poll_mask (uint32_t mask)
 {
@@ -988,26 +1674,10 @@ static bool
 ply_event_loop_source_has_met_status (ply_event_source_t        *source,
                                       ply_event_loop_fd_status_t status)
 {
-        ply_list_node_t *node;
-
         assert (source != NULL);
         assert (ply_event_loop_fd_status_is_valid (status));
 
-        node = ply_list_get_first_node (source->destinations);
-        while (node != NULL) {
-                ply_list_node_t *next_node;
-                ply_event_destination_t *destination;
-
-                destination = (ply_event_destination_t *) ply_list_node_get_data (node);
-                next_node = ply_list_get_next_node (source->destinations, node);
-
-                if (((destination->status & status) != 0)
-                    && (destination->status_met_handler != NULL))
-                        return true;
-
-                node = next_node;
-        }
-        return false;
+        return (source->handled_status & status) != 0;
 }
 
 static void
@@ -1030,8 +1700,22 @@ ply_event_loop_handle_met_status_for_source (ply_event_loop_t          *loop,
                 next_node = ply_list_get_next_node (source->destinations, node);
 
                 if (((destination->status & status) != 0)
-                    && (destination->status_met_handler != NULL))
-                        destination->status_met_handler (destination->user_data, source->fd);
+                    && (destination->status_met_handler != NULL)) {
+                        ply_event_handler_t handler;
+                        bool is_internal;
+                        double start_time;
+
+                        /* The handler can free the destination */
+                        handler = destination->status_met_handler;
+                        is_internal = destination->is_internal;
+
+                        start_time = ply_get_timestamp ();
+                        handler (destination->user_data, source->fd);
+
+                        if (!is_internal)
+                                ply_event_loop_record_handler_time (loop, "fd", handler,
+                                                                    source->fd, start_time);
+                }
 
                 node = next_node;
         }
@@ -1056,12 +1740,24 @@ ply_event_loop_handle_disconnect_for_source (ply_event_loop_t   *loop,
                 next_node = ply_list_get_next_node (source->destinations, node);
 
                 if (destination->disconnected_handler != NULL) {
+                        ply_event_handler_t handler;
+                        bool is_internal;
+                        double start_time;
+
+                        handler = destination->disconnected_handler;
+                        is_internal = destination->is_internal;
+
                         ply_trace ("calling disconnected_handler %p for fd %d",
-                                   destination->disconnected_handler, source->fd);
-                        destination->disconnected_handler (destination->user_data, source->fd);
+                                   handler, source->fd);
+                        start_time = ply_get_timestamp ();
+                        handler (destination->user_data, source->fd);
 
                         ply_trace ("done calling disconnected_handler %p for fd %d",
-                                   destination->disconnected_handler, source->fd);
+                                   handler, source->fd);
+
+                        if (!is_internal)
+                                ply_event_loop_record_handler_time (loop, "disconnect", handler,
+                                                                    source->fd, start_time);
                 }
 
                 node = next_node;
@@ -1097,26 +1793,35 @@ ply_event_loop_free_watches_for_source (ply_event_loop_t   *loop,
 static void
 ply_event_loop_free_timeout_watches (ply_event_loop_t *loop)
 {
-        ply_list_node_t *node;
-
         assert (loop != NULL);
 
-        node = ply_list_get_first_node (loop->timeout_watches);
-        while (node != NULL) {
-                ply_list_node_t *next_node;
+        while (loop->number_of_timeout_watches > 0) {
                 ply_event_loop_timeout_watch_t *watch;
 
-                watch = (ply_event_loop_timeout_watch_t *) ply_list_node_get_data (node);
-                next_node = ply_list_get_next_node (loop->timeout_watches, node);
-
+                watch = loop->timeout_heap[loop->number_of_timeout_watches - 1];
+                ply_event_loop_remove_timeout_watch (loop, watch);
                 free (watch);
-                ply_list_remove_node (loop->timeout_watches, node);
-
-                node = next_node;
         }
+}
 
-        assert (ply_list_get_length (loop->timeout_watches) == 0);
-        loop->wakeup_time = PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
+static void
+ply_event_loop_free_idle_watches (ply_event_loop_t *loop)
+{
+        int i;
+
+        for (i = 0; i < PLY_EVENT_LOOP_NUM_IDLE_PRIORITIES; i++) {
+                ply_list_node_t *node;
+
+                node = ply_list_get_first_node (loop->idle_watches[i]);
+                while (node != NULL) {
+                        ply_list_node_t *next_node;
+
+                        next_node = ply_list_get_next_node (loop->idle_watches[i], node);
+                        free (ply_list_node_get_data (node));
+                        ply_list_remove_node (loop->idle_watches[i], node);
+                        node = next_node;
+                }
+        }
 }
 
 static void
@@ -1166,43 +1871,262 @@ ply_event_loop_disconnect_source (ply_event_loop_t   *loop,
         ply_event_loop_remove_source (loop, source);
 }
 
+/* Turns a handler address into something like on_keyboard_input, or
+ * libply-splash-core.so.5+0x12a40 for functions that aren't exported,
+ * so stalls can be traced back without a debugger attached
+ */
+static char *
+ply_event_loop_get_handler_name (void *handler)
+{
+        Dl_info info;
+        char *name = NULL;
+
+        if (dladdr (handler, &info) == 0 || info.dli_fname == NULL) {
+                asprintf (&name, "%p", handler);
+                return name;
+        }
+
+        if (info.dli_sname != NULL && info.dli_saddr == handler) {
+                name = strdup (info.dli_sname);
+        } else if (info.dli_sname != NULL && info.dli_saddr != NULL) {
+                asprintf (&name, "%s+0x%lx", info.dli_sname,
+                          (unsigned long) ((char *) handler - (char *) info.dli_saddr));
+        } else {
+                const char *filename;
+
+                filename = strrchr (info.dli_fname, '/');
+                if (filename != NULL)
+                        filename++;
+                else
+                        filename = info.dli_fname;
+
+                asprintf (&name, "%s+0x%lx", filename,
+                          (unsigned long) ((char *) handler - (char *) info.dli_fbase));
+        }
+
+        return name;
+}
+
 static void
-ply_event_loop_handle_timeouts (ply_event_loop_t *loop)
+ply_event_loop_record_handler_time (ply_event_loop_t *loop,
+                                    const char       *kind,
+                                    void             *handler,
+                                    int               fd,
+                                    double            start_time)
+{
+        ply_event_loop_handler_statistics_t *statistics;
+        double time_taken;
+
+        if (loop == NULL)
+                return;
+
+        time_taken = ply_get_timestamp () - start_time;
+
+        statistics = ply_hashtable_lookup (loop->handler_statistics_by_handler, handler);
+
+        if (statistics == NULL) {
+                statistics = calloc (1, sizeof(ply_event_loop_handler_statistics_t));
+                statistics->kind = kind;
+                statistics->handler = handler;
+                ply_list_append_data (loop->handler_statistics, statistics);
+                ply_hashtable_insert (loop->handler_statistics_by_handler, handler, statistics);
+        }
+
+        statistics->number_of_dispatches++;
+        statistics->total_time += time_taken;
+        statistics->maximum_time = MAX (statistics->maximum_time, time_taken);
+
+        if (loop->stall_threshold > 0.0 && time_taken >= loop->stall_threshold) {
+                char *name;
+
+                statistics->number_of_stalls++;
+
+                name = ply_event_loop_get_handler_name (handler);
+                if (fd >= 0)
+                        ply_trace ("%s handler %s for fd %d blocked the event loop for %.1fms",
+                                   kind, name, fd, time_taken * 1000.0);
+                else
+                        ply_trace ("%s handler %s blocked the event loop for %.1fms",
+                                   kind, name, time_taken * 1000.0);
+                free (name);
+        }
+}
+
+/* Handlers that take at least seconds to run get traced.  0 turns
+ * that off.
+ */
+void
+ply_event_loop_set_stall_threshold (ply_event_loop_t *loop,
+                                    double            seconds)
 {
+        assert (loop != NULL);
+
+        loop->stall_threshold = MAX (seconds, 0.0);
+}
+
+static int
+compare_handler_statistics (const void *a,
+                            const void *b)
+{
+        const ply_event_loop_handler_statistics_t *statistics_a, *statistics_b;
+
+        statistics_a = *(ply_event_loop_handler_statistics_t *const *) a;
+        statistics_b = *(ply_event_loop_handler_statistics_t *const *) b;
+
+        if (statistics_a->total_time > statistics_b->total_time)
+                return -1;
+
+        if (statistics_a->total_time < statistics_b->total_time)
+                return 1;
+
+        return 0;
+}
+
+/* Returns a summary of how long every handler that ever ran has taken,
+ * busiest first, and how late timeouts ran.  Times are in microseconds.
+ */
+char *
+ply_event_loop_get_statistics (ply_event_loop_t *loop)
+{
+        ply_event_loop_handler_statistics_t **handler_statistics;
         ply_list_node_t *node;
+        ply_buffer_t *buffer;
+        char *string;
+        double running_time;
+        int i, number_of_handlers;
+
+        assert (loop != NULL);
+
+        buffer = ply_buffer_new ();
+
+        running_time = ply_get_timestamp () - loop->creation_time;
+        ply_buffer_append (buffer,
+                           "wakeups: %lu, %.2f per second, %lu for timeouts\n",
+                           loop->number_of_wakeups,
+                           running_time > 0.0 ? loop->number_of_wakeups / running_time : 0.0,
+                           loop->number_of_timer_wakeups);
+
+        if (loop->number_of_dispatched_timeouts > 0)
+                ply_buffer_append (buffer,
+                                   "timeouts: %lu dispatched, %lu coalesced, %llu us average lateness, %llu us max lateness\n",
+                                   loop->number_of_dispatched_timeouts,
+                                   loop->number_of_coalesced_timeouts,
+                                   (unsigned long long) (loop->total_timeout_lateness * 1000000.0 /
+                                                         loop->number_of_dispatched_timeouts),
+                                   (unsigned long long) (loop->maximum_timeout_lateness * 1000000.0));
+        else
+                ply_buffer_append (buffer, "timeouts: none dispatched\n");
+
+        number_of_handlers = ply_list_get_length (loop->handler_statistics);
+        handler_statistics = calloc (number_of_handlers + 1, sizeof(ply_event_loop_handler_statistics_t *));
+
+        i = 0;
+        node = ply_list_get_first_node (loop->handler_statistics);
+        while (node != NULL) {
+                handler_statistics[i++] = ply_list_node_get_data (node);
+                node = ply_list_get_next_node (loop->handler_statistics, node);
+        }
+
+        qsort (handler_statistics, number_of_handlers,
+               sizeof(ply_event_loop_handler_statistics_t *),
+               compare_handler_statistics);
+
+        for (i = 0; i < number_of_handlers; i++) {
+                ply_event_loop_handler_statistics_t *statistics;
+                char *name;
+
+                statistics = handler_statistics[i];
+                name = ply_event_loop_get_handler_name (statistics->handler);
+
+                ply_buffer_append (buffer,
+                                   "%s handler %s: %lu dispatches, %llu us total, %llu us average, %llu us max",
+                                   statistics->kind, name, statistics->number_of_dispatches,
+                                   (unsigned long long) (statistics->total_time * 1000000.0),
+                                   (unsigned long long) (statistics->total_time * 1000000.0 /
+                                                         statistics->number_of_dispatches),
+                                   (unsigned long long) (statistics->maximum_time * 1000000.0));
+
+                if (statistics->number_of_stalls > 0)
+                        ply_buffer_append (buffer, ", %lu stalls", statistics->number_of_stalls);
+
+                ply_buffer_append (buffer, "\n");
+                free (name);
+        }
+        free (handler_statistics);
+
+        string = ply_buffer_steal_bytes (buffer);
+        ply_buffer_free (buffer);
+
+        return string;
+}
+
+static void
+ply_event_loop_handle_timeouts (ply_event_loop_t *loop)
+{
         double now;
 
         assert (loop != NULL);
 
+        /* Handlers can add and remove timeouts, but anything they add is
+         * due after now, so this always finishes
+         */
         now = ply_get_timestamp ();
-        node = ply_list_get_first_node (loop->timeout_watches);
-        loop->wakeup_time = PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
-        while (node != NULL) {
-                ply_list_node_t *next_node;
+        while (loop->number_of_timeout_watches > 0 &&
+               loop->timeout_heap[0]->timeout <= now) {
                 ply_event_loop_timeout_watch_t *watch;
+                double start_time, lateness;
 
-                watch = (ply_event_loop_timeout_watch_t *) ply_list_node_get_data (node);
-                next_node = ply_list_get_next_node (loop->timeout_watches, node);
+                watch = loop->timeout_heap[0];
+                assert (watch->handler != NULL);
 
-                if (watch->timeout <= now) {
-                        assert (watch->handler != NULL);
+                ply_event_loop_remove_timeout_watch (loop, watch);
 
-                        ply_list_remove_node (loop->timeout_watches, node);
+                start_time = ply_get_timestamp ();
+                lateness = MAX (start_time - watch->timeout, 0.0);
+                loop->number_of_dispatched_timeouts++;
+                loop->total_timeout_lateness += lateness;
+                loop->maximum_timeout_lateness = MAX (loop->maximum_timeout_lateness, lateness);
 
-                        watch->handler (watch->user_data, loop);
-                        free (watch);
+                watch->handler (watch->user_data, loop);
+                ply_event_loop_record_handler_time (loop, "timeout", watch->handler,
+                                                    -1, start_time);
+                free (watch);
+        }
+}
 
-                        /* start over in case the handler invalidated the list
-                         */
-                        next_node = ply_list_get_first_node (loop->timeout_watches);
-                } else {
-                        if (fabs (loop->wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0)
-                                loop->wakeup_time = watch->timeout;
-                        else
-                                loop->wakeup_time = MIN (loop->wakeup_time, watch->timeout);
-                }
+static void
+ply_event_loop_handle_idle_watches (ply_event_loop_t *loop)
+{
+        unsigned long next_idle_serial;
+        int i;
 
-                node = next_node;
+        /* Only run what was queued before we started, so handlers that
+         * queue themselves again can't keep the loop from sleeping forever
+         */
+        next_idle_serial = loop->next_idle_serial;
+        for (i = 0; i < PLY_EVENT_LOOP_NUM_IDLE_PRIORITIES; i++) {
+                ply_list_node_t *node;
+
+                while ((node = ply_list_get_first_node (loop->idle_watches[i])) != NULL) {
+                        ply_event_loop_idle_watch_t *idle_watch;
+                        double start_time;
+
+                        idle_watch = (ply_event_loop_idle_watch_t *) ply_list_node_get_data (node);
+
+                        if (idle_watch->serial >= next_idle_serial)
+                                break;
+
+                        ply_list_remove_node (loop->idle_watches[i], node);
+
+                        start_time = ply_get_timestamp ();
+                        idle_watch->handler (idle_watch->user_data, loop);
+                        ply_event_loop_record_handler_time (loop, "idle", idle_watch->handler,
+                                                            -1, start_time);
+                        free (idle_watch);
+
+                        if (loop->should_exit)
+                                return;
+                }
         }
 }
 
@@ -1218,18 +2142,37 @@ ply_event_loop_process_pending_events (ply_event_loop_t *loop)
                 PLY_EVENT_LOOP_NUM_EVENT_HANDLERS * sizeof(struct epoll_event));
 
         do {
+                double wakeup_time;
                 int timeout;
 
-                if (fabs (loop->wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0) {
+                wakeup_time = ply_event_loop_get_wakeup_time (loop);
+
+                if (loop->timer_fd >= 0) {
+                        ply_event_loop_update_timer_fd (loop);
+                        timeout = -1;
+                } else if (fabs (wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0) {
                         timeout = -1;
                 } else {
-                        timeout = (int) ((loop->wakeup_time - ply_get_timestamp ()) * 1000);
+                        timeout = (int) ((wakeup_time - ply_get_timestamp ()) * 1000);
                         timeout = MAX (timeout, 0);
                 }
 
+                /* Idle handlers queued by the last round of them are
+                 * still waiting, so just check for events and go on
+                 */
+                if (ply_event_loop_has_idle_watches (loop))
+                        timeout = 0;
+
                 number_of_received_events = epoll_wait (loop->epoll_fd, events,
                                                         PLY_EVENT_LOOP_NUM_EVENT_HANDLERS,
                                                         timeout);
+
+                if (timeout != 0) {
+                        loop->number_of_wakeups++;
+
+                        if (loop->timer_fd < 0 && number_of_received_events == 0)
+                                loop->number_of_timer_wakeups++;
+                }
                 if (number_of_received_events < 0) {
                         if (errno != EINTR && errno != EAGAIN) {
                                 ply_event_loop_exit (loop, 255);
@@ -1291,6 +2234,9 @@ ply_event_loop_process_pending_events (ply_event_loop_t *loop)
 
                 ply_event_source_drop_reference (source);
         }
+
+        if (!loop->should_exit)
+                ply_event_loop_handle_idle_watches (loop);
 }
 
 void
@@ -1313,6 +2259,7 @@ ply_event_loop_run (ply_event_loop_t *loop)
         ply_event_loop_run_exit_closures (loop);
         ply_event_loop_free_sources (loop);
         ply_event_loop_free_timeout_watches (loop);
+        ply_event_loop_free_idle_watches (loop);
 
         loop->should_exit = false;
 
@@ -37,6 +37,15 @@ typedef enum
         PLY_EVENT_LOOP_FD_STATUS_CAN_TAKE_DATA = 0x4,
 } ply_event_loop_fd_status_t;
 
+typedef enum
+{
+        PLY_EVENT_LOOP_IDLE_PRIORITY_HIGH = 0,
+        PLY_EVENT_LOOP_IDLE_PRIORITY_DEFAULT,
+        PLY_EVENT_LOOP_IDLE_PRIORITY_LOW,
+} ply_event_loop_idle_priority_t;
+
+#define PLY_EVENT_LOOP_NUM_IDLE_PRIORITIES (PLY_EVENT_LOOP_IDLE_PRIORITY_LOW + 1)
+
 typedef void (*ply_event_handler_t) (void *user_data,
                                      int   source_fd);
 
@@ -45,6 +54,8 @@ typedef void (*ply_event_loop_exit_handler_t) (void             *user_data,
                                                ply_event_loop_t *loop);
 typedef void (*ply_event_loop_timeout_handler_t) (void             *user_data,
                                                   ply_event_loop_t *loop);
+typedef void (*ply_event_loop_idle_handler_t) (void             *user_data,
+                                               ply_event_loop_t *loop);
 
 #ifndef PLY_HIDE_FUNCTION_DECLARATIONS
 ply_event_loop_t *ply_event_loop_new (void);
@@ -75,16 +86,35 @@ void ply_event_loop_watch_for_timeout (ply_event_loop_t                *loop,
                                        double                           seconds,
                                        ply_event_loop_timeout_handler_t timeout_handler,
                                        void                            *user_data);
+void ply_event_loop_watch_for_timeout_with_slack (ply_event_loop_t                *loop,
+                                                  double                           seconds,
+                                                  double                           slack,
+                                                  ply_event_loop_timeout_handler_t timeout_handler,
+                                                  void                            *user_data);
+void ply_event_loop_set_timer_grid (ply_event_loop_t *loop,
+                                    double            seconds);
 
 void ply_event_loop_stop_watching_for_timeout (ply_event_loop_t                *loop,
                                                ply_event_loop_timeout_handler_t timeout_handler,
                                                void                            *user_data);
 
+void ply_event_loop_watch_for_idle (ply_event_loop_t              *loop,
+                                    ply_event_loop_idle_priority_t priority,
+                                    ply_event_loop_idle_handler_t  idle_handler,
+                                    void                          *user_data);
+void ply_event_loop_stop_watching_for_idle (ply_event_loop_t             *loop,
+                                            ply_event_loop_idle_handler_t idle_handler,
+                                            void                         *user_data);
+
 int ply_event_loop_run (ply_event_loop_t *loop);
 void ply_event_loop_exit (ply_event_loop_t *loop,
                           int               exit_code);
 void
 ply_event_loop_process_pending_events (ply_event_loop_t *loop);
+
+void ply_event_loop_set_stall_threshold (ply_event_loop_t *loop,
+                                         double            seconds);
+char *ply_event_loop_get_statistics (ply_event_loop_t *loop);
 #endif
 
 #endif
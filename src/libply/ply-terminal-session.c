@@ -26,6 +26,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -107,11 +108,19 @@ static bool
 ply_terminal_session_execute (ply_terminal_session_t *session,
                               bool                    look_in_path)
 {
+        sigset_t no_signals;
+
         ply_close_all_fds ();
 
         if (!ply_terminal_session_open_console (session))
                 return false;
 
+        /* The event loop blocks the signals it watches, and the program
+         * we're about to run shouldn't inherit that
+         */
+        sigemptyset (&no_signals);
+        sigprocmask (SIG_SETMASK, &no_signals, NULL);
+
         if (look_in_path)
                 execvp (session->argv[0], session->argv);
         else
@@ -572,4 +581,19 @@ ply_terminal_session_close_log (ply_terminal_session_t *session)
         return ply_logger_close_file (session->logger);
 }
 
+void
+ply_terminal_session_append_to_log (ply_terminal_session_t *session,
+                                    const char             *text)
+{
+        assert (session != NULL);
+        assert (session->logger != NULL);
+        assert (text != NULL);
+
+        /* Unlike console output, this only goes to the log file and
+         * isn't echoed back to the terminal.
+         */
+        ply_logger_inject_bytes (session->logger, text, strlen (text));
+        ply_logger_flush (session->logger);
+}
+
 /* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
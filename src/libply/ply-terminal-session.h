@@ -74,6 +74,8 @@ int ply_terminal_session_get_fd (ply_terminal_session_t *session);
 bool ply_terminal_session_open_log (ply_terminal_session_t *session,
                                     const char             *filename);
 void ply_terminal_session_close_log (ply_terminal_session_t *session);
+void ply_terminal_session_append_to_log (ply_terminal_session_t *session,
+                                         const char             *text);
 #endif
 
 #endif /* PLY_TERMINAL_SESSION_H */
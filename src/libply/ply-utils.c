@@ -297,6 +297,51 @@ ply_write (int         fd,
         return bytes_left_to_write == 0;
 }
 
+/* Writes out everything in iovecs with as few system calls as possible.
+ * The iovecs get changed along the way, so keep hold of anything that
+ * needs freeing.
+ */
+bool
+ply_write_iovecs (int           fd,
+                  struct iovec *iovecs,
+                  int           number_of_iovecs)
+{
+        assert (fd >= 0);
+
+        while (number_of_iovecs > 0) {
+                ssize_t bytes_written;
+
+                if (iovecs->iov_len == 0) {
+                        iovecs++;
+                        number_of_iovecs--;
+                        continue;
+                }
+
+                bytes_written = writev (fd, iovecs, MIN (number_of_iovecs, IOV_MAX));
+
+                if (bytes_written <= 0) {
+                        if (bytes_written < 0 && errno == EINTR)
+                                continue;
+                        return false;
+                }
+
+                /* The write can stop part way through an iovec
+                 */
+                while (number_of_iovecs > 0 && (size_t) bytes_written >= iovecs->iov_len) {
+                        bytes_written -= iovecs->iov_len;
+                        iovecs++;
+                        number_of_iovecs--;
+                }
+
+                if (number_of_iovecs > 0) {
+                        iovecs->iov_base = ((uint8_t *) iovecs->iov_base) + bytes_written;
+                        iovecs->iov_len -= bytes_written;
+                }
+        }
+
+        return true;
+}
+
 bool
 ply_write_uint32 (int      fd,
                   uint32_t value)
@@ -26,6 +26,7 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #ifndef MIN
 #define MIN(a, b) ((a) <= (b) ? (a) : (b))
@@ -73,6 +74,9 @@ bool ply_write (int         fd,
                 size_t      number_of_bytes);
 bool ply_write_uint32 (int      fd,
                        uint32_t value);
+bool ply_write_iovecs (int           fd,
+                       struct iovec *iovecs,
+                       int           number_of_iovecs);
 bool ply_read (int    fd,
                void  *buffer,
                size_t number_of_bytes);
@@ -0,0 +1,512 @@
+/* ply-worker-pool.c - runs jobs on background threads
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-worker-pool.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "ply-event-loop.h"
+#include "ply-list.h"
+#include "ply-logger.h"
+#include "ply-utils.h"
+
+/* A small, fixed number of threads that run jobs handed to them by the
+ * main thread.  Threads are only started once there is work for them.
+ *
+ * When a job finishes, the worker puts it on a list of finished jobs
+ * and bumps an eventfd.  The event loop watches that eventfd, so
+ * completion handlers always run on the main thread, just like any
+ * other event source.
+ *
+ * When the event loop exits, the workers finish the jobs they're in
+ * the middle of and stop.  Jobs that haven't started yet stay queued,
+ * so they can still be waited for (which runs them on the spot) or
+ * cancelled, and anything queued after that just runs right away.
+ */
+
+#ifndef PLY_WORKER_POOL_MAXIMUM_WORKERS
+#define PLY_WORKER_POOL_MAXIMUM_WORKERS 4
+#endif
+
+typedef enum
+{
+        PLY_WORKER_POOL_JOB_STATE_QUEUED = 0,
+        PLY_WORKER_POOL_JOB_STATE_RUNNING,
+        PLY_WORKER_POOL_JOB_STATE_FINISHED,
+} ply_worker_pool_job_state_t;
+
+struct _ply_worker_pool_job
+{
+        ply_worker_pool_job_handler_t        job_handler;
+        ply_worker_pool_completion_handler_t completion_handler;
+        void                                *user_data;
+
+        ply_worker_pool_job_state_t          state;
+};
+
+struct _ply_worker_pool
+{
+        ply_event_loop_t *loop;
+        ply_fd_watch_t   *completion_watch;
+        int               completion_fd;
+
+        pthread_mutex_t   mutex;
+        pthread_cond_t    job_queued;
+        pthread_cond_t    job_finished;
+
+        ply_list_t       *urgent_jobs;
+        ply_list_t       *queued_jobs;
+        ply_list_t       *finished_jobs;
+
+        pthread_t        *workers;
+        int               number_of_workers;
+        int               maximum_number_of_workers;
+        int               number_of_idle_workers;
+
+        uint32_t          is_shutting_down : 1;
+};
+
+static void on_jobs_finished (ply_worker_pool_t *pool);
+
+static void
+ply_worker_pool_stop_workers (ply_worker_pool_t *pool)
+{
+        int i;
+
+        pthread_mutex_lock (&pool->mutex);
+        pool->is_shutting_down = true;
+        pthread_cond_broadcast (&pool->job_queued);
+        pthread_mutex_unlock (&pool->mutex);
+
+        for (i = 0; i < pool->number_of_workers; i++) {
+                pthread_join (pool->workers[i], NULL);
+        }
+        pool->number_of_workers = 0;
+}
+
+static void
+detach_from_event_loop (ply_worker_pool_t *pool)
+{
+        assert (pool != NULL);
+
+        ply_trace ("event loop exiting, stopping worker threads");
+        ply_worker_pool_stop_workers (pool);
+
+        pool->loop = NULL;
+        pool->completion_watch = NULL;
+}
+
+ply_worker_pool_t *
+ply_worker_pool_new (ply_event_loop_t *loop,
+                     int               number_of_workers)
+{
+        ply_worker_pool_t *pool;
+
+        pool = calloc (1, sizeof(ply_worker_pool_t));
+
+        pool->completion_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+        if (pool->completion_fd < 0) {
+                ply_trace ("could not create eventfd for worker pool: %m");
+                free (pool);
+                return NULL;
+        }
+
+        if (number_of_workers <= 0) {
+                number_of_workers = (int) sysconf (_SC_NPROCESSORS_ONLN);
+                number_of_workers = CLAMP (number_of_workers, 1,
+                                           PLY_WORKER_POOL_MAXIMUM_WORKERS);
+        }
+
+        pthread_mutex_init (&pool->mutex, NULL);
+        pthread_cond_init (&pool->job_queued, NULL);
+        pthread_cond_init (&pool->job_finished, NULL);
+
+        pool->urgent_jobs = ply_list_new ();
+        pool->queued_jobs = ply_list_new ();
+        pool->finished_jobs = ply_list_new ();
+        pool->maximum_number_of_workers = number_of_workers;
+        pool->workers = calloc (number_of_workers, sizeof(pthread_t));
+
+        pool->loop = loop;
+
+        if (loop != NULL) {
+                pool->completion_watch = ply_event_loop_watch_fd (loop,
+                                                                  pool->completion_fd,
+                                                                  PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                                                  (ply_event_handler_t)
+                                                                  on_jobs_finished,
+                                                                  NULL, pool);
+                ply_event_loop_watch_for_exit (loop,
+                                               (ply_event_loop_exit_handler_t)
+                                               detach_from_event_loop,
+                                               pool);
+        }
+
+        return pool;
+}
+
+ply_worker_pool_t *
+ply_worker_pool_get_default (void)
+{
+        static ply_worker_pool_t *pool = NULL;
+
+        if (pool == NULL)
+                pool = ply_worker_pool_new (ply_event_loop_get_default (), 0);
+
+        return pool;
+}
+
+static void
+free_jobs (ply_list_t *jobs)
+{
+        ply_list_node_t *node;
+
+        node = ply_list_get_first_node (jobs);
+        while (node != NULL) {
+                ply_list_node_t *next_node;
+                ply_worker_pool_job_t *job;
+
+                job = (ply_worker_pool_job_t *) ply_list_node_get_data (node);
+                next_node = ply_list_get_next_node (jobs, node);
+
+                free (job);
+                ply_list_remove_node (jobs, node);
+
+                node = next_node;
+        }
+}
+
+void
+ply_worker_pool_free (ply_worker_pool_t *pool)
+{
+        if (pool == NULL)
+                return;
+
+        ply_worker_pool_stop_workers (pool);
+
+        if (pool->loop != NULL) {
+                if (pool->completion_watch != NULL)
+                        ply_event_loop_stop_watching_fd (pool->loop,
+                                                         pool->completion_watch);
+                ply_event_loop_stop_watching_for_exit (pool->loop,
+                                                       (ply_event_loop_exit_handler_t)
+                                                       detach_from_event_loop,
+                                                       pool);
+        }
+
+        free_jobs (pool->urgent_jobs);
+        ply_list_free (pool->urgent_jobs);
+        free_jobs (pool->queued_jobs);
+        ply_list_free (pool->queued_jobs);
+        free_jobs (pool->finished_jobs);
+        ply_list_free (pool->finished_jobs);
+
+        pthread_cond_destroy (&pool->job_finished);
+        pthread_cond_destroy (&pool->job_queued);
+        pthread_mutex_destroy (&pool->mutex);
+
+        close (pool->completion_fd);
+        free (pool->workers);
+        free (pool);
+}
+
+static void
+ply_worker_pool_finish_job (ply_worker_pool_t     *pool,
+                            ply_worker_pool_job_t *job)
+{
+        if (job->completion_handler != NULL)
+                job->completion_handler (job->user_data, pool);
+
+        free (job);
+}
+
+static void
+on_jobs_finished (ply_worker_pool_t *pool)
+{
+        uint64_t count;
+
+        if (read (pool->completion_fd, &count, sizeof(count)) < 0 &&
+            errno != EAGAIN)
+                ply_trace ("could not read worker pool eventfd: %m");
+
+        /* Take jobs off the list one at a time and drop the lock while
+         * running each completion handler.  Handlers are free to queue
+         * more jobs or wait for ones that are still on the list.
+         */
+        while (true) {
+                ply_list_node_t *node;
+                ply_worker_pool_job_t *job;
+
+                pthread_mutex_lock (&pool->mutex);
+                node = ply_list_get_first_node (pool->finished_jobs);
+
+                if (node == NULL) {
+                        pthread_mutex_unlock (&pool->mutex);
+                        break;
+                }
+
+                job = (ply_worker_pool_job_t *) ply_list_node_get_data (node);
+                ply_list_remove_node (pool->finished_jobs, node);
+                pthread_mutex_unlock (&pool->mutex);
+
+                ply_worker_pool_finish_job (pool, job);
+        }
+}
+
+static void *
+ply_worker_pool_run_worker (ply_worker_pool_t *pool)
+{
+        pthread_mutex_lock (&pool->mutex);
+        while (true) {
+                ply_list_t *jobs;
+                ply_list_node_t *node;
+                ply_worker_pool_job_t *job;
+                uint64_t count = 1;
+
+                pool->number_of_idle_workers++;
+                while (!pool->is_shutting_down &&
+                       ply_list_get_length (pool->urgent_jobs) == 0 &&
+                       ply_list_get_length (pool->queued_jobs) == 0) {
+                        pthread_cond_wait (&pool->job_queued, &pool->mutex);
+                }
+                pool->number_of_idle_workers--;
+
+                if (pool->is_shutting_down)
+                        break;
+
+                if (ply_list_get_length (pool->urgent_jobs) > 0)
+                        jobs = pool->urgent_jobs;
+                else
+                        jobs = pool->queued_jobs;
+
+                node = ply_list_get_first_node (jobs);
+                job = (ply_worker_pool_job_t *) ply_list_node_get_data (node);
+                ply_list_remove_node (jobs, node);
+                job->state = PLY_WORKER_POOL_JOB_STATE_RUNNING;
+                pthread_mutex_unlock (&pool->mutex);
+
+                job->job_handler (job->user_data);
+
+                pthread_mutex_lock (&pool->mutex);
+                job->state = PLY_WORKER_POOL_JOB_STATE_FINISHED;
+                ply_list_append_data (pool->finished_jobs, job);
+                pthread_cond_broadcast (&pool->job_finished);
+
+                if (write (pool->completion_fd, &count, sizeof(count)) < 0) {
+                        /* The counter can only overflow if nobody has
+                         * looked at it in a very long time, and then the
+                         * eventfd is readable anyway.
+                         */
+                }
+        }
+        pthread_mutex_unlock (&pool->mutex);
+
+        return NULL;
+}
+
+static void
+ply_worker_pool_start_worker (ply_worker_pool_t *pool)
+{
+        pthread_t *worker;
+        sigset_t all_signals, old_signals;
+        int error;
+
+        /* The event loop reads signals from a signalfd, which only works
+         * if no thread can have them delivered to it, so workers start
+         * with every signal blocked
+         */
+        sigfillset (&all_signals);
+        pthread_sigmask (SIG_BLOCK, &all_signals, &old_signals);
+
+        worker = &pool->workers[pool->number_of_workers];
+        error = pthread_create (worker, NULL,
+                                (void *(*)(void *))ply_worker_pool_run_worker,
+                                pool);
+
+        pthread_sigmask (SIG_SETMASK, &old_signals, NULL);
+
+        if (error != 0) {
+                errno = error;
+                ply_trace ("could not start worker thread: %m");
+                return;
+        }
+
+        pool->number_of_workers++;
+}
+
+/* Returns a handle that can be passed to ply_worker_pool_wait_for_job ()
+ * or ply_worker_pool_cancel_job () until the completion handler runs.
+ * Once the event loop has exited, the job and its completion handler run
+ * before this returns, and there's no handle.
+ */
+ply_worker_pool_job_t *
+ply_worker_pool_queue_job (ply_worker_pool_t                   *pool,
+                           ply_worker_pool_priority_t           priority,
+                           ply_worker_pool_job_handler_t        job_handler,
+                           ply_worker_pool_completion_handler_t completion_handler,
+                           void                                *user_data)
+{
+        ply_worker_pool_job_t *job;
+
+        assert (pool != NULL);
+        assert (job_handler != NULL);
+
+        job = calloc (1, sizeof(ply_worker_pool_job_t));
+        job->job_handler = job_handler;
+        job->completion_handler = completion_handler;
+        job->user_data = user_data;
+        job->state = PLY_WORKER_POOL_JOB_STATE_QUEUED;
+
+        pthread_mutex_lock (&pool->mutex);
+
+        if (pool->is_shutting_down) {
+                pthread_mutex_unlock (&pool->mutex);
+
+                job->state = PLY_WORKER_POOL_JOB_STATE_RUNNING;
+                job->job_handler (job->user_data);
+                job->state = PLY_WORKER_POOL_JOB_STATE_FINISHED;
+
+                ply_worker_pool_finish_job (pool, job);
+                return NULL;
+        }
+
+        if (priority == PLY_WORKER_POOL_PRIORITY_HIGH)
+                ply_list_append_data (pool->urgent_jobs, job);
+        else
+                ply_list_append_data (pool->queued_jobs, job);
+
+        if (pool->number_of_idle_workers == 0 &&
+            pool->number_of_workers < pool->maximum_number_of_workers)
+                ply_worker_pool_start_worker (pool);
+
+        pthread_cond_signal (&pool->job_queued);
+        pthread_mutex_unlock (&pool->mutex);
+
+        return job;
+}
+
+/* Takes a job that no worker has picked up yet off the queue.
+ * Called with the lock held.
+ */
+static void
+ply_worker_pool_unqueue_job (ply_worker_pool_t     *pool,
+                             ply_worker_pool_job_t *job)
+{
+        ply_list_node_t *node;
+
+        assert (job->state == PLY_WORKER_POOL_JOB_STATE_QUEUED);
+
+        node = ply_list_find_node (pool->urgent_jobs, job);
+        if (node != NULL)
+                ply_list_remove_node (pool->urgent_jobs, node);
+        else
+                ply_list_remove_node (pool->queued_jobs,
+                                      ply_list_find_node (pool->queued_jobs, job));
+}
+
+/* Waits for a worker to finish the job and takes it off the list of
+ * finished jobs.  Called with the lock held.
+ */
+static void
+ply_worker_pool_wait_for_worker (ply_worker_pool_t     *pool,
+                                 ply_worker_pool_job_t *job)
+{
+        ply_list_node_t *node;
+
+        while (job->state != PLY_WORKER_POOL_JOB_STATE_FINISHED) {
+                pthread_cond_wait (&pool->job_finished, &pool->mutex);
+        }
+
+        node = ply_list_find_node (pool->finished_jobs, job);
+        assert (node != NULL);
+        ply_list_remove_node (pool->finished_jobs, node);
+}
+
+void
+ply_worker_pool_wait_for_job (ply_worker_pool_t     *pool,
+                              ply_worker_pool_job_t *job)
+{
+        assert (pool != NULL);
+        assert (job != NULL);
+
+        pthread_mutex_lock (&pool->mutex);
+
+        /* If no worker has picked the job up yet, there's no point in
+         * waiting for one to get to it.  Just run it here.
+         */
+        if (job->state == PLY_WORKER_POOL_JOB_STATE_QUEUED) {
+                ply_worker_pool_unqueue_job (pool, job);
+                job->state = PLY_WORKER_POOL_JOB_STATE_RUNNING;
+                pthread_mutex_unlock (&pool->mutex);
+
+                job->job_handler (job->user_data);
+                job->state = PLY_WORKER_POOL_JOB_STATE_FINISHED;
+
+                ply_worker_pool_finish_job (pool, job);
+                return;
+        }
+
+        ply_worker_pool_wait_for_worker (pool, job);
+        pthread_mutex_unlock (&pool->mutex);
+
+        ply_worker_pool_finish_job (pool, job);
+}
+
+/* Makes sure the job won't run and its completion handler won't be
+ * called.  If a worker is already in the middle of it, this waits for
+ * the worker to be done, so the job's data can be freed as soon as
+ * this returns.  Returns false if the job had already run.
+ */
+bool
+ply_worker_pool_cancel_job (ply_worker_pool_t     *pool,
+                            ply_worker_pool_job_t *job)
+{
+        bool was_cancelled;
+
+        assert (pool != NULL);
+        assert (job != NULL);
+
+        pthread_mutex_lock (&pool->mutex);
+
+        if (job->state == PLY_WORKER_POOL_JOB_STATE_QUEUED) {
+                ply_worker_pool_unqueue_job (pool, job);
+                was_cancelled = true;
+        } else {
+                ply_worker_pool_wait_for_worker (pool, job);
+                was_cancelled = false;
+        }
+
+        pthread_mutex_unlock (&pool->mutex);
+
+        free (job);
+
+        return was_cancelled;
+}
+
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -0,0 +1,66 @@
+/* ply-worker-pool.h - runs jobs on background threads
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_WORKER_POOL_H
+#define PLY_WORKER_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "ply-event-loop.h"
+
+typedef struct _ply_worker_pool ply_worker_pool_t;
+typedef struct _ply_worker_pool_job ply_worker_pool_job_t;
+
+typedef enum
+{
+        PLY_WORKER_POOL_PRIORITY_NORMAL = 0,
+        PLY_WORKER_POOL_PRIORITY_HIGH,
+} ply_worker_pool_priority_t;
+
+/* Runs on a worker thread, so it must not touch anything the main
+ * thread might be using at the same time (including ply_trace).
+ */
+typedef void (*ply_worker_pool_job_handler_t) (void *user_data);
+
+/* Runs on the main thread, from the event loop, once the job is done.
+ */
+typedef void (*ply_worker_pool_completion_handler_t) (void              *user_data,
+                                                      ply_worker_pool_t *pool);
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_worker_pool_t *ply_worker_pool_new (ply_event_loop_t *loop,
+                                        int               number_of_workers);
+void ply_worker_pool_free (ply_worker_pool_t *pool);
+ply_worker_pool_t *ply_worker_pool_get_default (void);
+
+ply_worker_pool_job_t *ply_worker_pool_queue_job (ply_worker_pool_t                   *pool,
+                                                  ply_worker_pool_priority_t           priority,
+                                                  ply_worker_pool_job_handler_t        job_handler,
+                                                  ply_worker_pool_completion_handler_t completion_handler,
+                                                  void                                *user_data);
+void ply_worker_pool_wait_for_job (ply_worker_pool_t     *pool,
+                                   ply_worker_pool_job_t *job);
+bool ply_worker_pool_cancel_job (ply_worker_pool_t     *pool,
+                                 ply_worker_pool_job_t *job);
+#endif
+
+#endif /* PLY_WORKER_POOL_H */
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
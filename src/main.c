@@ -47,6 +47,8 @@
 #include "ply-boot-splash.h"
 #include "ply-device-manager.h"
 #include "ply-event-loop.h"
+#include "ply-frame-clock.h"
+#include "ply-frame-statistics.h"
 #include "ply-hashtable.h"
 #include "ply-list.h"
 #include "ply-logger.h"
@@ -60,9 +62,39 @@
 #define PLY_MAX_COMMAND_LINE_SIZE 4097
 #endif
 
+#ifndef PLY_DEFAULT_STALL_THRESHOLD
+#define PLY_DEFAULT_STALL_THRESHOLD 0.05
+#endif
+
 #define BOOT_DURATION_FILE     PLYMOUTH_TIME_DIRECTORY "/boot-duration"
 #define SHUTDOWN_DURATION_FILE PLYMOUTH_TIME_DIRECTORY "/shutdown-duration"
 
+#ifndef PLY_POWER_SUPPLY_DIRECTORY
+#define PLY_POWER_SUPPLY_DIRECTORY "/sys/class/power_supply"
+#endif
+
+/* Timers with slack get lined up on multiples of this when saving
+ * power, so ones that aren't quite due together still share a wakeup
+ */
+#ifndef PLY_POWER_SAVING_TIMER_GRID
+#define PLY_POWER_SAVING_TIMER_GRID 0.01
+#endif
+
+/* How often the power supplies get looked at again, since their drivers
+ * may not be loaded when the daemon starts and the machine can be
+ * plugged in or unplugged while the splash is up
+ */
+#ifndef PLY_POWER_SUPPLY_CHECK_INTERVAL
+#define PLY_POWER_SUPPLY_CHECK_INTERVAL 10.0
+#endif
+
+/* When status updates are coalesced, the splash hears about them at
+ * most this often
+ */
+#ifndef PLY_STATUS_UPDATE_INTERVAL
+#define PLY_STATUS_UPDATE_INTERVAL (1.0 / 60.0)
+#endif
+
 typedef enum
 {
         PLY_MODE_BOOT,
@@ -70,6 +102,21 @@ typedef enum
         PLY_MODE_UPDATES
 } ply_mode_t;
 
+typedef enum
+{
+        PLY_POWER_SAVING_UNSET = 0,
+        PLY_POWER_SAVING_AUTOMATIC,
+        PLY_POWER_SAVING_ALWAYS,
+        PLY_POWER_SAVING_NEVER
+} ply_power_saving_t;
+
+typedef enum
+{
+        PLY_STATUS_UPDATES_UNSET = 0,
+        PLY_STATUS_UPDATES_COALESCED,
+        PLY_STATUS_UPDATES_IMMEDIATE
+} ply_status_updates_t;
+
 typedef struct
 {
         const char    *keys;
@@ -107,6 +154,16 @@ typedef struct
 
         double                  start_time;
         double                  splash_delay;
+        double                  cpu_budget;
+        ply_power_saving_t      power_saving;
+
+        ply_status_updates_t    status_updates;
+        char                   *pending_status;
+        int                     pending_system_update_progress;
+        double                  last_status_update_time;
+        unsigned long           number_of_status_updates;
+        unsigned long           number_of_delivered_status_updates;
+        unsigned long           number_of_dropped_status_updates;
 
         char                    kernel_command_line[PLY_MAX_COMMAND_LINE_SIZE];
         uint32_t                kernel_command_line_is_set : 1;
@@ -120,6 +177,10 @@ typedef struct
         uint32_t                is_inactive : 1;
         uint32_t                is_shown : 1;
         uint32_t                should_force_details : 1;
+        uint32_t                has_pending_system_update : 1;
+        uint32_t                status_update_is_scheduled : 1;
+        uint32_t                is_saving_power : 1;
+        uint32_t                power_saving_is_checked : 1;
 
         char                   *override_splash_path;
         char                   *system_default_splash_path;
@@ -209,6 +270,114 @@ on_session_hangup (state_t *state)
         ply_trace ("got hang up on terminal session fd");
 }
 
+static void
+deliver_status_updates (state_t *state)
+{
+        state->status_update_is_scheduled = false;
+        state->last_status_update_time = ply_get_timestamp ();
+
+        if (state->pending_status != NULL) {
+                if (state->boot_splash != NULL) {
+                        ply_boot_splash_update_status (state->boot_splash,
+                                                       state->pending_status);
+                        state->number_of_delivered_status_updates++;
+                } else {
+                        state->number_of_dropped_status_updates++;
+                }
+
+                free (state->pending_status);
+                state->pending_status = NULL;
+        }
+
+        if (state->has_pending_system_update) {
+                state->has_pending_system_update = false;
+
+                if (state->boot_splash == NULL) {
+                        ply_trace ("no splash set");
+                        state->number_of_dropped_status_updates++;
+                        return;
+                }
+
+                ply_trace ("setting system update to '%i'", state->pending_system_update_progress);
+                if (!ply_boot_splash_system_update (state->boot_splash,
+                                                    state->pending_system_update_progress)) {
+                        ply_trace ("failed to update splash");
+                        state->number_of_dropped_status_updates++;
+                        return;
+                }
+                state->number_of_delivered_status_updates++;
+        }
+}
+
+/* Services can start hundreds at a time, and each one sends a status
+ * update.  Redrawing the splash for every one of them is wasted work,
+ * so unless configured otherwise, only the latest update gets passed
+ * on, once per PLY_STATUS_UPDATE_INTERVAL.  The progress model still
+ * sees every update.  Without a splash there's nothing to pass them on
+ * to, so they're dropped straight away.
+ */
+static void
+schedule_status_updates (state_t *state)
+{
+        double time_since_last_update;
+
+        state->number_of_status_updates++;
+
+        if (state->boot_splash == NULL) {
+                state->number_of_dropped_status_updates++;
+                free (state->pending_status);
+                state->pending_status = NULL;
+                state->has_pending_system_update = false;
+                return;
+        }
+
+        if (state->status_update_is_scheduled)
+                return;
+
+        time_since_last_update = ply_get_timestamp () - state->last_status_update_time;
+
+        if (state->status_updates == PLY_STATUS_UPDATES_IMMEDIATE ||
+            time_since_last_update >= PLY_STATUS_UPDATE_INTERVAL) {
+                deliver_status_updates (state);
+                return;
+        }
+
+        state->status_update_is_scheduled = true;
+        ply_event_loop_watch_for_timeout_with_slack (state->loop,
+                                                     PLY_STATUS_UPDATE_INTERVAL - time_since_last_update,
+                                                     PLY_STATUS_UPDATE_INTERVAL,
+                                                     (ply_event_loop_timeout_handler_t)
+                                                     deliver_status_updates,
+                                                     state);
+}
+
+static void
+drop_pending_status_updates (state_t *state)
+{
+        if (state->status_update_is_scheduled) {
+                ply_event_loop_stop_watching_for_timeout (state->loop,
+                                                          (ply_event_loop_timeout_handler_t)
+                                                          deliver_status_updates,
+                                                          state);
+                state->status_update_is_scheduled = false;
+        }
+
+        if (state->pending_status != NULL)
+                state->number_of_dropped_status_updates++;
+
+        if (state->has_pending_system_update)
+                state->number_of_dropped_status_updates++;
+
+        free (state->pending_status);
+        state->pending_status = NULL;
+        state->has_pending_system_update = false;
+
+        ply_trace ("passed %lu of %lu status updates on to the splash, and dropped %lu",
+                   state->number_of_delivered_status_updates,
+                   state->number_of_status_updates,
+                   state->number_of_dropped_status_updates);
+}
+
 static void
 on_update (state_t    *state,
            const char *status)
@@ -216,9 +385,10 @@ on_update (state_t    *state,
         ply_trace ("updating status to '%s'", status);
         ply_progress_status_update (state->progress,
                                     status);
-        if (state->boot_splash != NULL)
-                ply_boot_splash_update_status (state->boot_splash,
-                                               status);
+
+        free (state->pending_status);
+        state->pending_status = strdup (status);
+        schedule_status_updates (state);
 }
 
 static void
@@ -254,16 +424,9 @@ static void
 on_system_update (state_t *state,
                   int      progress)
 {
-        if (state->boot_splash == NULL) {
-                ply_trace ("no splash set");
-                return;
-        }
-
-        ply_trace ("setting system update to '%i'", progress);
-        if (!ply_boot_splash_system_update (state->boot_splash, progress)) {
-                ply_trace ("failed to update splash");
-                return;
-        }
+        state->pending_system_update_progress = progress;
+        state->has_pending_system_update = true;
+        schedule_status_updates (state);
 }
 
 static void
@@ -303,6 +466,54 @@ load_settings (state_t    *state,
         if (!ply_key_file_load (key_file))
                 goto out;
 
+        if (isnan (state->cpu_budget)) {
+                const char *budget_string;
+
+                budget_string = ply_key_file_get_value (key_file, "Daemon", "CPUBudget");
+
+                if (budget_string != NULL) {
+                        state->cpu_budget = atof (budget_string);
+                        ply_trace ("Animation CPU budget is set to %lf%%", state->cpu_budget);
+                }
+        }
+
+        if (state->power_saving == PLY_POWER_SAVING_UNSET) {
+                const char *power_saving_string;
+
+                power_saving_string = ply_key_file_get_value (key_file, "Daemon", "PowerSaving");
+
+                if (power_saving_string != NULL) {
+                        if (strcmp (power_saving_string, "always") == 0)
+                                state->power_saving = PLY_POWER_SAVING_ALWAYS;
+                        else if (strcmp (power_saving_string, "never") == 0)
+                                state->power_saving = PLY_POWER_SAVING_NEVER;
+                        else
+                                state->power_saving = PLY_POWER_SAVING_AUTOMATIC;
+
+                        ply_trace ("Power saving is set to %s", power_saving_string);
+                }
+        }
+
+        if (state->status_updates == PLY_STATUS_UPDATES_UNSET) {
+                const char *status_updates_string;
+
+                status_updates_string = ply_key_file_get_value (key_file, "Daemon", "StatusUpdates");
+
+                if (status_updates_string != NULL) {
+                        if (strcmp (status_updates_string, "immediate") == 0)
+                                state->status_updates = PLY_STATUS_UPDATES_IMMEDIATE;
+                        else if (strcmp (status_updates_string, "coalesce") == 0)
+                                state->status_updates = PLY_STATUS_UPDATES_COALESCED;
+                        else
+                                ply_error ("plymouthd: ignoring StatusUpdates=%s in %s, "
+                                           "it should be coalesce or immediate",
+                                           status_updates_string, path);
+
+                        if (state->status_updates != PLY_STATUS_UPDATES_UNSET)
+                                ply_trace ("Status updates are set to %s", status_updates_string);
+                }
+        }
+
         splash_string = ply_key_file_get_value (key_file, "Daemon", "Theme");
 
         if (splash_string == NULL)
@@ -328,6 +539,144 @@ out:
         return settings_loaded;
 }
 
+static bool
+read_power_supply_attribute (const char *power_supply,
+                             const char *attribute,
+                             char       *value,
+                             size_t      size)
+{
+        char *path = NULL;
+        FILE *fp;
+        bool was_read;
+
+        asprintf (&path, PLY_POWER_SUPPLY_DIRECTORY "/%s/%s", power_supply, attribute);
+        fp = fopen (path, "re");
+        free (path);
+
+        if (fp == NULL)
+                return false;
+
+        was_read = fgets (value, size, fp) != NULL;
+        fclose (fp);
+
+        if (was_read)
+                value[strcspn (value, "\n")] = '\0';
+
+        return was_read;
+}
+
+static bool
+is_running_on_battery (void)
+{
+        DIR *dir;
+        struct dirent *entry;
+        bool has_battery, has_mains_power;
+
+        dir = opendir (PLY_POWER_SUPPLY_DIRECTORY);
+
+        if (dir == NULL)
+                return false;
+
+        has_battery = false;
+        has_mains_power = false;
+        while ((entry = readdir (dir)) != NULL) {
+                char type[32], value[32];
+
+                if (entry->d_name[0] == '.')
+                        continue;
+
+                if (!read_power_supply_attribute (entry->d_name, "type", type, sizeof(type)))
+                        continue;
+
+                if (strcmp (type, "Mains") == 0) {
+                        if (read_power_supply_attribute (entry->d_name, "online", value, sizeof(value)) &&
+                            strcmp (value, "1") == 0)
+                                has_mains_power = true;
+                } else if (strcmp (type, "Battery") == 0) {
+                        /* Peripherals like mice report batteries too */
+                        if (read_power_supply_attribute (entry->d_name, "scope", value, sizeof(value)) &&
+                            strcmp (value, "Device") == 0)
+                                continue;
+
+                        if (read_power_supply_attribute (entry->d_name, "status", value, sizeof(value)) &&
+                            strcmp (value, "Discharging") == 0)
+                                has_battery = true;
+                }
+        }
+        closedir (dir);
+
+        return has_battery && !has_mains_power;
+}
+
+static void
+check_power_saving (state_t *state)
+{
+        bool should_save_power;
+
+        switch (state->power_saving) {
+        case PLY_POWER_SAVING_ALWAYS:
+                should_save_power = true;
+                break;
+        case PLY_POWER_SAVING_NEVER:
+                should_save_power = false;
+                break;
+        case PLY_POWER_SAVING_UNSET:
+        case PLY_POWER_SAVING_AUTOMATIC:
+        default:
+                should_save_power = is_running_on_battery ();
+                break;
+        }
+
+        if (state->power_saving_is_checked &&
+            state->is_saving_power == should_save_power)
+                return;
+
+        state->power_saving_is_checked = true;
+        state->is_saving_power = should_save_power;
+
+        ply_frame_clock_set_power_saving (ply_frame_clock_get_default (), should_save_power);
+
+        if (should_save_power) {
+                ply_trace ("saving power, so coalescing timers and slowing animations down");
+                ply_event_loop_set_timer_grid (state->loop, PLY_POWER_SAVING_TIMER_GRID);
+        } else if (state->mode == PLY_MODE_SHUTDOWN || state->mode == PLY_MODE_UPDATES) {
+                /* Shutdowns and updates can sit on the splash for a long
+                 * time, so they're worth keeping quiet even when plugged in
+                 */
+                ply_trace ("coalescing timers for %s",
+                           state->mode == PLY_MODE_SHUTDOWN ? "shutdown" : "updates");
+                ply_event_loop_set_timer_grid (state->loop, PLY_POWER_SAVING_TIMER_GRID);
+        } else {
+                ply_trace ("not saving power");
+                ply_event_loop_set_timer_grid (state->loop, 0.0);
+        }
+}
+
+static void
+on_power_supply_check_timeout (state_t *state)
+{
+        check_power_saving (state);
+
+        ply_event_loop_watch_for_timeout_with_slack (state->loop,
+                                                     PLY_POWER_SUPPLY_CHECK_INTERVAL,
+                                                     PLY_POWER_SUPPLY_CHECK_INTERVAL,
+                                                     (ply_event_loop_timeout_handler_t)
+                                                     on_power_supply_check_timeout,
+                                                     state);
+}
+
+static void
+watch_power_supplies (state_t *state)
+{
+        if (state->power_saving == PLY_POWER_SAVING_ALWAYS ||
+            state->power_saving == PLY_POWER_SAVING_NEVER) {
+                check_power_saving (state);
+                return;
+        }
+
+        on_power_supply_check_timeout (state);
+}
+
 static void
 show_detailed_splash (state_t *state)
 {
@@ -597,7 +946,9 @@ on_hide_message (state_t    *state,
                 if (strcmp (list_message, message) == 0) {
                         free (list_message);
                         ply_list_remove_node (state->messages, node);
-                        ply_boot_splash_hide_message (state->boot_splash, message);
+
+                        if (state->boot_splash != NULL)
+                                ply_boot_splash_hide_message (state->boot_splash, message);
                 }
                 node = next_node;
         }
@@ -1259,6 +1610,37 @@ on_reactivate (state_t *state)
         update_display (state);
 }
 
+static void
+log_frame_statistics (state_t *state)
+{
+        char *statistics;
+        char *summary = NULL;
+
+        statistics = ply_frame_statistics_to_string (ply_frame_statistics_get_default ());
+        ply_trace ("frame statistics:\n%s", statistics);
+
+        if (state->session != NULL) {
+                asprintf (&summary, "\nplymouth frame statistics:\n%s", statistics);
+                ply_terminal_session_append_to_log (state->session, summary);
+                free (summary);
+        }
+
+        free (statistics);
+}
+
+static void
+log_event_loop_statistics (state_t *state)
+{
+        char *statistics;
+
+        if (!ply_is_tracing ())
+                return;
+
+        statistics = ply_event_loop_get_statistics (state->loop);
+        ply_trace ("event loop statistics:\n%s", statistics);
+        free (statistics);
+}
+
 static void
 on_quit (state_t       *state,
          bool           retain_splash,
@@ -1290,6 +1672,10 @@ on_quit (state_t       *state,
         tell_systemd_to_stop_printing_details (state);
 #endif
 
+        log_frame_statistics (state);
+        log_event_loop_statistics (state);
+        drop_pending_status_updates (state);
+
         ply_trace ("closing log");
         if (state->session != NULL)
                 ply_terminal_session_close_log (state->session);
@@ -1321,6 +1707,32 @@ on_has_active_vt (state_t *state)
                 return false;
 }
 
+static char *
+on_get_statistics (state_t *state)
+{
+        char *frame_statistics, *event_loop_statistics;
+        char *statistics = NULL;
+
+        frame_statistics = ply_frame_statistics_to_string (ply_frame_statistics_get_default ());
+        event_loop_statistics = ply_event_loop_get_statistics (state->loop);
+
+        asprintf (&statistics,
+                  "%s%s"
+                  "status updates: %lu received, %lu delivered, %lu coalesced, %lu dropped\n",
+                  frame_statistics, event_loop_statistics,
+                  state->number_of_status_updates,
+                  state->number_of_delivered_status_updates,
+                  state->number_of_status_updates -
+                  state->number_of_delivered_status_updates -
+                  state->number_of_dropped_status_updates,
+                  state->number_of_dropped_status_updates);
+
+        free (frame_statistics);
+        free (event_loop_statistics);
+
+        return statistics;
+}
+
 static ply_boot_server_t *
 start_boot_server (state_t *state)
 {
@@ -1346,6 +1758,7 @@ start_boot_server (state_t *state)
                                       (ply_boot_server_reactivate_handler_t) on_reactivate,
                                       (ply_boot_server_quit_handler_t) on_quit,
                                       (ply_boot_server_has_active_vt_handler_t) on_has_active_vt,
+                                      (ply_boot_server_get_statistics_handler_t) on_get_statistics,
                                       state);
 
         if (!ply_boot_server_listen (server)) {
@@ -1857,6 +2270,33 @@ check_logging (state_t *state)
                 ply_trace ("logging will be enabled!");
 }
 
+static void
+check_stall_threshold (state_t *state)
+{
+        const char *threshold_string;
+        double threshold;
+
+        /* When debugging, trace any handler that keeps the event loop
+         * from running for long enough to drop a frame or two
+         */
+        if (ply_is_tracing ())
+                threshold = PLY_DEFAULT_STALL_THRESHOLD;
+        else
+                threshold = 0.0;
+
+        threshold_string = command_line_get_string_after_prefix (state->kernel_command_line,
+                                                                 "plymouth.stall-threshold=");
+
+        if (threshold_string != NULL)
+                threshold = atof (threshold_string) / 1000.0;
+
+        if (threshold > 0.0)
+                ply_trace ("tracing event loop handlers that take longer than %.1fms",
+                           threshold * 1000.0);
+
+        ply_event_loop_set_stall_threshold (state->loop, threshold);
+}
+
 static bool
 redirect_standard_io_to_dev_null (void)
 {
@@ -1925,6 +2365,7 @@ initialize_environment (state_t *state)
 
         check_verbosity (state);
         check_logging (state);
+        check_stall_threshold (state);
 
         ply_trace ("source built on %s", __DATE__);
 
@@ -2191,6 +2632,7 @@ main (int    argc,
 
         state.progress = ply_progress_new ();
         state.splash_delay = NAN;
+        state.cpu_budget = NAN;
 
         ply_progress_load_cache (state.progress,
                                  get_cache_file_for_mode (state.mode));
@@ -2208,6 +2650,12 @@ main (int    argc,
         find_system_default_splash (&state);
         find_distribution_default_splash (&state);
 
+        if (!isnan (state.cpu_budget))
+                ply_frame_clock_set_cpu_budget (ply_frame_clock_get_default (),
+                                                state.cpu_budget / 100.0);
+
+        watch_power_supplies (&state);
+
         if (command_line_has_argument (state.kernel_command_line, "plymouth.ignore-serial-consoles"))
                 device_manager_flags |= PLY_DEVICE_MANAGER_FLAGS_IGNORE_SERIAL_CONSOLES;
 
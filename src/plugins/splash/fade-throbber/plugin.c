@@ -43,10 +43,12 @@
 #include "ply-buffer.h"
 #include "ply-entry.h"
 #include "ply-event-loop.h"
+#include "ply-frame-clock.h"
 #include "ply-label.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-image.h"
+#include "ply-image-cache.h"
 #include "ply-key-file.h"
 #include "ply-pixel-buffer.h"
 #include "ply-pixel-display.h"
@@ -91,6 +93,7 @@ typedef struct
 struct _ply_boot_splash_plugin
 {
         ply_event_loop_t              *loop;
+        ply_frame_clock_t             *clock;
         ply_boot_splash_mode_t         mode;
         ply_image_t                   *logo_image;
         ply_image_t                   *star_image;
@@ -412,6 +415,10 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
         ply_image_free (plugin->logo_image);
         ply_image_free (plugin->star_image);
         ply_image_free (plugin->lock_image);
+
+        /* Drop the images this theme shared, in case another one is loaded next
+         */
+        ply_image_cache_clear (ply_image_cache_get_default ());
         free (plugin);
 }
 
@@ -495,11 +502,11 @@ animate_at_time (ply_boot_splash_plugin_t *plugin,
 }
 
 static void
-on_timeout (ply_boot_splash_plugin_t *plugin)
+on_frame (ply_boot_splash_plugin_t *plugin,
+          double                    frame_time,
+          ply_frame_clock_t        *clock)
 {
-        double sleep_time;
-
-        plugin->now = ply_get_timestamp ();
+        plugin->now = frame_time;
 
         /* The choice below is between
          *
@@ -521,15 +528,6 @@ on_timeout (ply_boot_splash_plugin_t *plugin)
         time += 1.0 / FRAMES_PER_SECOND;
         animate_at_time (plugin, time);
 #endif
-
-        sleep_time = 1.0 / FRAMES_PER_SECOND;
-        sleep_time = MAX (sleep_time - (ply_get_timestamp () - plugin->now),
-                          0.005);
-
-        ply_event_loop_watch_for_timeout (plugin->loop,
-                                          sleep_time,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, plugin);
 }
 
 static void
@@ -575,10 +573,11 @@ start_animation (ply_boot_splash_plugin_t *plugin)
         if (plugin->mode == PLY_BOOT_SPLASH_MODE_SHUTDOWN)
                 return;
 
-        ply_event_loop_watch_for_timeout (plugin->loop,
-                                          1.0 / FRAMES_PER_SECOND,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, plugin);
+        plugin->clock = ply_frame_clock_get_default ();
+        ply_frame_clock_add_handler (plugin->clock,
+                                     FRAMES_PER_SECOND,
+                                     (ply_frame_clock_handler_t)
+                                     on_frame, plugin);
 }
 
 static void
@@ -592,10 +591,11 @@ stop_animation (ply_boot_splash_plugin_t *plugin)
 
         plugin->is_animating = false;
 
-        if (plugin->loop != NULL) {
-                ply_event_loop_stop_watching_for_timeout (plugin->loop,
-                                                          (ply_event_loop_timeout_handler_t)
-                                                          on_timeout, plugin);
+        if (plugin->clock != NULL) {
+                ply_frame_clock_remove_handler (plugin->clock,
+                                                (ply_frame_clock_handler_t)
+                                                on_frame, plugin);
+                plugin->clock = NULL;
         }
         redraw_views (plugin);
 }
@@ -47,8 +47,10 @@
 #include "ply-event-loop.h"
 #include "ply-key-file.h"
 #include "ply-list.h"
+#include "ply-frame-clock.h"
 #include "ply-logger.h"
 #include "ply-image.h"
+#include "ply-image-cache.h"
 #include "ply-pixel-display.h"
 #include "ply-trigger.h"
 #include "ply-utils.h"
@@ -72,6 +74,7 @@
 struct _ply_boot_splash_plugin
 {
         ply_event_loop_t           *loop;
+        ply_frame_clock_t          *clock;
         ply_boot_splash_mode_t      mode;
         ply_list_t                 *displays;
         ply_keyboard_t             *keyboard;
@@ -89,6 +92,8 @@ struct _ply_boot_splash_plugin
         script_lib_math_data_t     *script_math_lib;
         script_lib_string_data_t   *script_string_lib;
 
+        int                         refresh_rate;
+
         uint32_t                    is_animating : 1;
 };
 
@@ -212,19 +217,34 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
         ply_list_free (plugin->script_env_vars);
         free (plugin->script_filename);
         free (plugin->image_dir);
+
+        /* Drop the images this theme shared, in case another one is loaded next
+         */
+        ply_image_cache_clear (ply_image_cache_get_default ());
         free (plugin);
 }
 
 static void
-on_timeout (ply_boot_splash_plugin_t *plugin)
+on_frame (ply_boot_splash_plugin_t *plugin,
+          double                    frame_time,
+          ply_frame_clock_t        *clock)
 {
-        double sleep_time;
-
-        sleep_time = 1.0 / plugin->script_plymouth_lib->refresh_rate;
-        ply_event_loop_watch_for_timeout (plugin->loop,
-                                          sleep_time,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, plugin);
+        int refresh_rate;
+
+        /* Scripts can change their refresh rate at any time, so pick up
+         * the new rate before the next frame is scheduled.
+         */
+        refresh_rate = MAX (plugin->script_plymouth_lib->refresh_rate, 1);
+        if (refresh_rate != plugin->refresh_rate) {
+                ply_frame_clock_remove_handler (plugin->clock,
+                                                (ply_frame_clock_handler_t)
+                                                on_frame, plugin);
+                ply_frame_clock_add_handler (plugin->clock,
+                                             refresh_rate,
+                                             (ply_frame_clock_handler_t)
+                                             on_frame, plugin);
+                plugin->refresh_rate = refresh_rate;
+        }
 
         script_lib_plymouth_on_refresh (plugin->script_state,
                                         plugin->script_plymouth_lib);
@@ -285,7 +305,14 @@ start_script_animation (ply_boot_splash_plugin_t *plugin)
                 ply_keyboard_add_input_handler (plugin->keyboard,
                                                 (ply_keyboard_input_handler_t)
                                                 on_keyboard_input, plugin);
-        on_timeout (plugin);
+
+        plugin->clock = ply_frame_clock_get_default ();
+        plugin->refresh_rate = MAX (plugin->script_plymouth_lib->refresh_rate, 1);
+        ply_frame_clock_add_handler (plugin->clock,
+                                     plugin->refresh_rate,
+                                     (ply_frame_clock_handler_t)
+                                     on_frame, plugin);
+        on_frame (plugin, ply_frame_clock_get_frame_time (plugin->clock), plugin->clock);
 
         return true;
 }
@@ -315,10 +342,12 @@ stop_script_animation (ply_boot_splash_plugin_t *plugin)
                                      plugin->script_plymouth_lib);
         script_lib_sprite_refresh (plugin->script_sprite_lib);
 
-        if (plugin->loop != NULL)
-                ply_event_loop_stop_watching_for_timeout (plugin->loop,
-                                                          (ply_event_loop_timeout_handler_t)
-                                                          on_timeout, plugin);
+        if (plugin->clock != NULL) {
+                ply_frame_clock_remove_handler (plugin->clock,
+                                                (ply_frame_clock_handler_t)
+                                                on_frame, plugin);
+                plugin->clock = NULL;
+        }
 
         if (plugin->keyboard != NULL) {
                 ply_keyboard_remove_input_handler (plugin->keyboard,
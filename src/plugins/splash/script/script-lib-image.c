@@ -23,6 +23,7 @@
 #include "config.h"
 
 #include "ply-image.h"
+#include "ply-image-cache.h"
 #include "ply-label.h"
 #include "ply-pixel-buffer.h"
 #include "ply-utils.h"
@@ -69,14 +70,12 @@ static script_return_t image_new (script_state_t *state,
         } else {
                 asprintf (&path_filename, "%s/%s", data->image_dir, filename);
         }
-        ply_image_t *file_image = ply_image_new (path_filename);
-        if (ply_image_load (file_image)) {
-                ply_pixel_buffer_t *buffer = ply_image_convert_to_pixel_buffer (file_image);
+        ply_pixel_buffer_t *buffer = ply_image_cache_get_buffer (ply_image_cache_get_default (),
+                                                                 path_filename, 0, 0, 0.0);
+        if (buffer)
                 reply = script_obj_new_native (buffer, data->class);
-        } else {
-                ply_image_free (file_image);
+        else
                 reply = script_obj_new_null ();
-        }
         free (filename);
         free (path_filename);
         return script_return_obj (reply);
@@ -118,14 +117,11 @@ static script_return_t image_rotate (script_state_t *state,
         script_lib_image_data_t *data = user_data;
         ply_pixel_buffer_t *image = script_obj_as_native_of_class (state->this, data->class);
         float angle = script_obj_hash_get_number (state->local, "angle");
-        ply_rectangle_t size;
 
         if (image) {
-                ply_pixel_buffer_get_size (image, &size);
-                ply_pixel_buffer_t *new_image = ply_pixel_buffer_rotate (image,
-                                                                         size.width / 2,
-                                                                         size.height / 2,
-                                                                         angle);
+                ply_pixel_buffer_t *new_image = ply_image_cache_rotate_buffer (ply_image_cache_get_default (),
+                                                                               image,
+                                                                               angle);
                 return script_return_obj (script_obj_new_native (new_image, data->class));
         }
         return script_return_obj_null ();
@@ -140,7 +136,10 @@ static script_return_t image_scale (script_state_t *state,
         int height = script_obj_hash_get_number (state->local, "height");
 
         if (image) {
-                ply_pixel_buffer_t *new_image = ply_pixel_buffer_resize (image, width, height);
+                ply_pixel_buffer_t *new_image = ply_image_cache_resize_buffer (ply_image_cache_get_default (),
+                                                                               image,
+                                                                               width,
+                                                                               height);
                 return script_return_obj (script_obj_new_native (new_image, data->class));
         }
         return script_return_obj_null ();
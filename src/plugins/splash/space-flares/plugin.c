@@ -45,11 +45,13 @@
 #include "ply-buffer.h"
 #include "ply-entry.h"
 #include "ply-event-loop.h"
+#include "ply-frame-clock.h"
 #include "ply-key-file.h"
 #include "ply-label.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-image.h"
+#include "ply-image-cache.h"
 #include "ply-pixel-buffer.h"
 #include "ply-pixel-display.h"
 #include "ply-trigger.h"
@@ -173,6 +175,7 @@ typedef struct
 struct _ply_boot_splash_plugin
 {
         ply_event_loop_t              *loop;
+        ply_frame_clock_t             *clock;
         ply_boot_splash_mode_t         mode;
         ply_image_t                   *logo_image;
         ply_image_t                   *lock_image;
@@ -585,6 +588,10 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
 
         free_views (plugin);
 
+
+        /* Drop the images this theme shared, in case another one is loaded next
+         */
+        ply_image_cache_clear (ply_image_cache_get_default ());
         free (plugin);
 }
 
@@ -1115,13 +1122,11 @@ view_animate_attime (view_t *view, double time)
 }
 
 static void
-on_timeout (ply_boot_splash_plugin_t *plugin)
+on_frame (ply_boot_splash_plugin_t *plugin,
+          double                    frame_time,
+          ply_frame_clock_t        *clock)
 {
         ply_list_node_t *node;
-        double sleep_time;
-        double now;
-
-        now = ply_get_timestamp ();
 
         node = ply_list_get_first_node (plugin->views);
 
@@ -1132,18 +1137,11 @@ on_timeout (ply_boot_splash_plugin_t *plugin)
                 view = ply_list_node_get_data (node);
                 next_node = ply_list_get_next_node (plugin->views, node);
 
-                view_animate_attime (view, now);
+                view_animate_attime (view, frame_time);
 
                 node = next_node;
         }
-        plugin->now = now;
-
-        sleep_time = 1.0 / FRAMES_PER_SECOND;
-
-        ply_event_loop_watch_for_timeout (plugin->loop,
-                                          sleep_time,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, plugin);
+        plugin->now = frame_time;
 }
 
 static void
@@ -1177,7 +1175,12 @@ start_animation (ply_boot_splash_plugin_t *plugin)
                 node = next_node;
         }
 
-        on_timeout (plugin);
+        plugin->clock = ply_frame_clock_get_default ();
+        ply_frame_clock_add_handler (plugin->clock,
+                                     FRAMES_PER_SECOND,
+                                     (ply_frame_clock_handler_t)
+                                     on_frame, plugin);
+        on_frame (plugin, ply_frame_clock_get_frame_time (plugin->clock), plugin->clock);
 
         plugin->is_animating = true;
 }
@@ -1209,10 +1212,11 @@ stop_animation (ply_boot_splash_plugin_t *plugin)
 
         plugin->is_animating = false;
 
-        if (plugin->loop != NULL) {
-                ply_event_loop_stop_watching_for_timeout (plugin->loop,
-                                                          (ply_event_loop_timeout_handler_t)
-                                                          on_timeout, plugin);
+        if (plugin->clock != NULL) {
+                ply_frame_clock_remove_handler (plugin->clock,
+                                                (ply_frame_clock_handler_t)
+                                                on_frame, plugin);
+                plugin->clock = NULL;
         }
 
 #ifdef  SHOW_LOGO_HALO
@@ -1594,44 +1598,75 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
                     ply_buffer_t             *boot_buffer,
                     ply_boot_splash_mode_t    mode)
 {
+#ifdef  SHOW_PLANETS
+        int i;
+#endif
+
         assert (plugin != NULL);
         assert (plugin->logo_image != NULL);
 
         plugin->loop = loop;
         plugin->mode = mode;
 
+        /* Decode all the images in parallel and collect them below.
+         */
+        ply_image_load_in_background (plugin->logo_image,
+                                      PLY_WORKER_POOL_PRIORITY_HIGH,
+                                      NULL, NULL);
+        ply_image_load_in_background (plugin->star_image,
+                                      PLY_WORKER_POOL_PRIORITY_HIGH,
+                                      NULL, NULL);
+#ifdef  SHOW_PLANETS
+        for (i = 0; i < 5; i++) {
+                ply_image_load_in_background (plugin->planet_image[i],
+                                              PLY_WORKER_POOL_PRIORITY_NORMAL,
+                                              NULL, NULL);
+        }
+#endif
+#ifdef  SHOW_PROGRESS_BAR
+        ply_image_load_in_background (plugin->progress_barimage,
+                                      PLY_WORKER_POOL_PRIORITY_NORMAL,
+                                      NULL, NULL);
+#endif
+        ply_image_load_in_background (plugin->lock_image,
+                                      PLY_WORKER_POOL_PRIORITY_NORMAL,
+                                      NULL, NULL);
+        ply_image_load_in_background (plugin->box_image,
+                                      PLY_WORKER_POOL_PRIORITY_NORMAL,
+                                      NULL, NULL);
+
         ply_trace ("loading logo image");
-        if (!ply_image_load (plugin->logo_image))
+        if (!ply_image_wait_for_load (plugin->logo_image))
                 return false;
 
         ply_trace ("loading star image");
-        if (!ply_image_load (plugin->star_image))
+        if (!ply_image_wait_for_load (plugin->star_image))
                 return false;
 
         ply_trace ("loading planet images");
 #ifdef  SHOW_PLANETS
-        if (!ply_image_load (plugin->planet_image[0]))
+        if (!ply_image_wait_for_load (plugin->planet_image[0]))
                 return false;
-        if (!ply_image_load (plugin->planet_image[1]))
+        if (!ply_image_wait_for_load (plugin->planet_image[1]))
                 return false;
-        if (!ply_image_load (plugin->planet_image[2]))
+        if (!ply_image_wait_for_load (plugin->planet_image[2]))
                 return false;
-        if (!ply_image_load (plugin->planet_image[3]))
+        if (!ply_image_wait_for_load (plugin->planet_image[3]))
                 return false;
-        if (!ply_image_load (plugin->planet_image[4]))
+        if (!ply_image_wait_for_load (plugin->planet_image[4]))
                 return false;
 #endif
 #ifdef  SHOW_PROGRESS_BAR
-        if (!ply_image_load (plugin->progress_barimage))
+        if (!ply_image_wait_for_load (plugin->progress_barimage))
                 return false;
 #endif
 
         ply_trace ("loading lock image");
-        if (!ply_image_load (plugin->lock_image))
+        if (!ply_image_wait_for_load (plugin->lock_image))
                 return false;
 
         ply_trace ("loading box image");
-        if (!ply_image_load (plugin->box_image))
+        if (!ply_image_wait_for_load (plugin->box_image))
                 return false;
 
         if (!load_views (plugin)) {
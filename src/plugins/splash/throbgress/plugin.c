@@ -50,6 +50,7 @@
 #include "ply-progress-bar.h"
 #include "ply-logger.h"
 #include "ply-image.h"
+#include "ply-image-cache.h"
 #include "ply-trigger.h"
 #include "ply-pixel-buffer.h"
 #include "ply-pixel-display.h"
@@ -443,6 +444,10 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
 
         free_views (plugin);
 
+
+        /* Drop the images this theme shared, in case another one is loaded next
+         */
+        ply_image_cache_clear (ply_image_cache_get_default ());
         free (plugin);
 }
 
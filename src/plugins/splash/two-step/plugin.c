@@ -48,6 +48,7 @@
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-image.h"
+#include "ply-image-cache.h"
 #include "ply-key-file.h"
 #include "ply-trigger.h"
 #include "ply-pixel-buffer.h"
@@ -94,6 +95,9 @@ typedef struct
         ply_rectangle_t           box_area, lock_area, watermark_area;
         ply_trigger_t            *end_trigger;
         ply_image_t              *background_image;
+        ply_pixel_buffer_t       *base_layer;
+        uint32_t                  base_layer_has_background_image : 1;
+        uint32_t                  base_layer_has_watermark : 1;
 } view_t;
 
 struct _ply_boot_splash_plugin
@@ -125,6 +129,8 @@ struct _ply_boot_splash_plugin
 
         progress_function_t                 progress_function;
 
+        size_t                              frame_cache_size;
+
         ply_trigger_t                      *idle_trigger;
         ply_trigger_t                      *stop_trigger;
 
@@ -161,6 +167,8 @@ view_new (ply_boot_splash_plugin_t *plugin,
 
         view->throbber = ply_throbber_new (plugin->animation_dir,
                                            "throbber-");
+        ply_throbber_set_frame_cache_size (view->throbber,
+                                           plugin->frame_cache_size);
         ply_progress_animation_set_transition (view->progress_animation,
                                                plugin->transition,
                                                plugin->transition_duration);
@@ -184,6 +192,8 @@ view_free (view_t *view)
         if (view->background_image != NULL)
                 ply_image_free (view->background_image);
 
+        ply_pixel_buffer_free (view->base_layer);
+
         free (view);
 }
 
@@ -210,6 +220,8 @@ view_load_end_animation (view_t *view)
         ply_trace ("trying prefix: %s", animation_prefix);
         view->end_animation = ply_animation_new (plugin->animation_dir,
                                                  animation_prefix);
+        ply_animation_set_frame_cache_size (view->end_animation,
+                                            plugin->frame_cache_size);
 
         if (ply_animation_load (view->end_animation))
                 return;
@@ -218,6 +230,8 @@ view_load_end_animation (view_t *view)
         ply_trace ("now trying more general prefix: animation-");
         view->end_animation = ply_animation_new (plugin->animation_dir,
                                                  "animation-");
+        ply_animation_set_frame_cache_size (view->end_animation,
+                                            plugin->frame_cache_size);
         if (ply_animation_load (view->end_animation))
                 return;
         ply_animation_free (view->end_animation);
@@ -225,6 +239,8 @@ view_load_end_animation (view_t *view)
         ply_trace ("now trying old compat prefix: throbber-");
         view->end_animation = ply_animation_new (plugin->animation_dir,
                                                  "throbber-");
+        ply_animation_set_frame_cache_size (view->end_animation,
+                                            plugin->frame_cache_size);
         if (ply_animation_load (view->end_animation)) {
                 /* files named throbber- are for end animation, so
                  * there's no throbber */
@@ -542,6 +558,7 @@ create_plugin (ply_key_file_t *key_file)
         char *transition_duration;
         char *color;
         char *progress_function;
+        char *frame_cache_size;
 
         srand ((int) ply_get_timestamp ());
         plugin = calloc (1, sizeof(ply_boot_splash_plugin_t));
@@ -656,6 +673,17 @@ create_plugin (ply_key_file_t *key_file)
                 }
         }
 
+        /* Big animations can be played out of a bounded cache of decoded
+         * frames, given in kilobytes, instead of keeping every frame in
+         * memory.
+         */
+        frame_cache_size = ply_key_file_get_value (key_file, "two-step", "FrameCacheSize");
+        if (frame_cache_size != NULL) {
+                plugin->frame_cache_size = strtoul (frame_cache_size, NULL, 0) * 1024;
+                ply_trace ("Using a %zu byte frame cache", plugin->frame_cache_size);
+        }
+        free (frame_cache_size);
+
         plugin->views = ply_list_new ();
 
         return plugin;
@@ -721,6 +749,10 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
 
         free (plugin->animation_dir);
         free_views (plugin);
+
+        /* Drop the images this theme shared, in case another one is loaded next
+         */
+        ply_image_cache_clear (ply_image_cache_get_default ());
         free (plugin);
 }
 
@@ -886,6 +918,99 @@ draw_background (view_t             *view,
         }
 }
 
+static void
+draw_static_images (view_t             *view,
+                    ply_pixel_buffer_t *pixel_buffer)
+{
+        ply_boot_splash_plugin_t *plugin;
+        ply_rectangle_t screen_area;
+        ply_rectangle_t image_area;
+
+        plugin = view->plugin;
+
+        ply_pixel_buffer_get_size (pixel_buffer, &screen_area);
+
+        if (plugin->corner_image != NULL) {
+                image_area.width = ply_image_get_width (plugin->corner_image);
+                image_area.height = ply_image_get_height (plugin->corner_image);
+                image_area.x = screen_area.width - image_area.width - 20;
+                image_area.y = screen_area.height - image_area.height - 20;
+
+                ply_pixel_buffer_fill_with_argb32_data (pixel_buffer, &image_area, ply_image_get_data (plugin->corner_image));
+        }
+
+        if (plugin->header_image != NULL) {
+                long sprite_height;
+
+
+                if (view->progress_animation != NULL)
+                        sprite_height = ply_progress_animation_get_height (view->progress_animation);
+                else
+                        sprite_height = 0;
+
+                if (view->throbber != NULL)
+                        sprite_height = MAX (ply_throbber_get_height (view->throbber),
+                                             sprite_height);
+
+                image_area.width = ply_image_get_width (plugin->header_image);
+                image_area.height = ply_image_get_height (plugin->header_image);
+                image_area.x = screen_area.width / 2.0 - image_area.width / 2.0;
+                image_area.y = plugin->animation_vertical_alignment * screen_area.height - sprite_height / 2.0 - image_area.height;
+
+                ply_pixel_buffer_fill_with_argb32_data (pixel_buffer, &image_area, ply_image_get_data (plugin->header_image));
+        }
+}
+
+/* The background fill, background image and watermark never change
+ * while the splash is up, so compose them once into a screen sized
+ * buffer and copy the dirty part of that on every frame instead of
+ * redoing the gradient and all the blending each time.  That costs one
+ * extra screen sized buffer per view, 4 bytes a pixel, so about 8MB at
+ * 1920x1080 and 32MB at 3840x2160.
+ *
+ * The corner and header images go on top of the animations, so they
+ * aren't part of it.
+ */
+static ply_pixel_buffer_t *
+view_get_base_layer (view_t          *view,
+                     ply_rectangle_t *screen_area)
+{
+        ply_boot_splash_plugin_t *plugin;
+        bool has_background_image, has_watermark;
+
+        plugin = view->plugin;
+
+        has_background_image = view->background_image != NULL;
+        has_watermark = plugin->watermark_image != NULL;
+
+        if (view->base_layer != NULL &&
+            (ply_pixel_buffer_get_width (view->base_layer) != screen_area->width ||
+             ply_pixel_buffer_get_height (view->base_layer) != screen_area->height ||
+             view->base_layer_has_background_image != has_background_image ||
+             view->base_layer_has_watermark != has_watermark)) {
+                ply_pixel_buffer_free (view->base_layer);
+                view->base_layer = NULL;
+        }
+
+        if (view->base_layer != NULL)
+                return view->base_layer;
+
+        ply_trace ("composing %lux%lu base layer", screen_area->width, screen_area->height);
+
+        view->base_layer = ply_pixel_buffer_new (screen_area->width, screen_area->height);
+        view->base_layer_has_background_image = has_background_image;
+        view->base_layer_has_watermark = has_watermark;
+
+        draw_background (view, view->base_layer, 0, 0,
+                         screen_area->width, screen_area->height);
+
+        /* The gradient or solid fill underneath covers every pixel
+         */
+        ply_pixel_buffer_set_opaque (view->base_layer, true);
+
+        return view->base_layer;
+}
+
 static void
 on_draw (view_t             *view,
          ply_pixel_buffer_t *pixel_buffer,
@@ -895,15 +1020,23 @@ on_draw (view_t             *view,
          int                 height)
 {
         ply_boot_splash_plugin_t *plugin;
+        ply_pixel_buffer_t *base_layer;
         ply_rectangle_t screen_area;
-        ply_rectangle_t image_area;
+        ply_rectangle_t area;
 
         plugin = view->plugin;
 
-        draw_background (view, pixel_buffer, x, y, width, height);
-
         ply_pixel_buffer_get_size (pixel_buffer, &screen_area);
 
+        area.x = x;
+        area.y = y;
+        area.width = width;
+        area.height = height;
+
+        base_layer = view_get_base_layer (view, &screen_area);
+        ply_pixel_buffer_fill_with_buffer_with_clip (pixel_buffer, base_layer,
+                                                     0, 0, &area);
+
         if (plugin->state == PLY_BOOT_SPLASH_DISPLAY_QUESTION_ENTRY ||
             plugin->state == PLY_BOOT_SPLASH_DISPLAY_PASSWORD_ENTRY) {
                 uint32_t *box_data, *lock_data;
@@ -939,35 +1072,7 @@ on_draw (view_t             *view,
                                                  x, y, width, height);
                 }
 
-                if (plugin->corner_image != NULL) {
-                        image_area.width = ply_image_get_width (plugin->corner_image);
-                        image_area.height = ply_image_get_height (plugin->corner_image);
-                        image_area.x = screen_area.width - image_area.width - 20;
-                        image_area.y = screen_area.height - image_area.height - 20;
-
-                        ply_pixel_buffer_fill_with_argb32_data (pixel_buffer, &image_area, ply_image_get_data (plugin->corner_image));
-                }
-
-                if (plugin->header_image != NULL) {
-                        long sprite_height;
-
-
-                        if (view->progress_animation != NULL)
-                                sprite_height = ply_progress_animation_get_height (view->progress_animation);
-                        else
-                                sprite_height = 0;
-
-                        if (view->throbber != NULL)
-                                sprite_height = MAX (ply_throbber_get_height (view->throbber),
-                                                     sprite_height);
-
-                        image_area.width = ply_image_get_width (plugin->header_image);
-                        image_area.height = ply_image_get_height (plugin->header_image);
-                        image_area.x = screen_area.width / 2.0 - image_area.width / 2.0;
-                        image_area.y = plugin->animation_vertical_alignment * screen_area.height - sprite_height / 2.0 - image_area.height;
-
-                        ply_pixel_buffer_fill_with_argb32_data (pixel_buffer, &image_area, ply_image_get_data (plugin->header_image));
-                }
+                draw_static_images (view, pixel_buffer);
         }
         ply_label_draw_area (view->message_label,
                              pixel_buffer,
@@ -1026,18 +1131,44 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
         plugin->loop = loop;
         plugin->mode = mode;
 
+        /* Decode all the images in parallel, background first since
+         * nothing can be shown without it, and then collect them below.
+         */
+        if (plugin->background_tile_image != NULL)
+                ply_image_load_in_background (plugin->background_tile_image,
+                                              PLY_WORKER_POOL_PRIORITY_HIGH,
+                                              NULL, NULL);
+        if (plugin->watermark_image != NULL)
+                ply_image_load_in_background (plugin->watermark_image,
+                                              PLY_WORKER_POOL_PRIORITY_HIGH,
+                                              NULL, NULL);
+        if (plugin->corner_image != NULL)
+                ply_image_load_in_background (plugin->corner_image,
+                                              PLY_WORKER_POOL_PRIORITY_NORMAL,
+                                              NULL, NULL);
+        if (plugin->header_image != NULL)
+                ply_image_load_in_background (plugin->header_image,
+                                              PLY_WORKER_POOL_PRIORITY_NORMAL,
+                                              NULL, NULL);
+        ply_image_load_in_background (plugin->lock_image,
+                                      PLY_WORKER_POOL_PRIORITY_NORMAL,
+                                      NULL, NULL);
+        ply_image_load_in_background (plugin->box_image,
+                                      PLY_WORKER_POOL_PRIORITY_NORMAL,
+                                      NULL, NULL);
+
         ply_trace ("loading lock image");
-        if (!ply_image_load (plugin->lock_image))
+        if (!ply_image_wait_for_load (plugin->lock_image))
                 return false;
 
         ply_trace ("loading box image");
-        if (!ply_image_load (plugin->box_image))
+        if (!ply_image_wait_for_load (plugin->box_image))
                 return false;
 
         if (plugin->corner_image != NULL) {
                 ply_trace ("loading corner image");
 
-                if (!ply_image_load (plugin->corner_image)) {
+                if (!ply_image_wait_for_load (plugin->corner_image)) {
                         ply_image_free (plugin->corner_image);
                         plugin->corner_image = NULL;
                 }
@@ -1046,7 +1177,7 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
         if (plugin->header_image != NULL) {
                 ply_trace ("loading header image");
 
-                if (!ply_image_load (plugin->header_image)) {
+                if (!ply_image_wait_for_load (plugin->header_image)) {
                         ply_image_free (plugin->header_image);
                         plugin->header_image = NULL;
                 }
@@ -1054,7 +1185,7 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
 
         if (plugin->background_tile_image != NULL) {
                 ply_trace ("loading background tile image");
-                if (!ply_image_load (plugin->background_tile_image)) {
+                if (!ply_image_wait_for_load (plugin->background_tile_image)) {
                         ply_image_free (plugin->background_tile_image);
                         plugin->background_tile_image = NULL;
                 }
@@ -1062,7 +1193,7 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
 
         if (plugin->watermark_image != NULL) {
                 ply_trace ("loading watermark image");
-                if (!ply_image_load (plugin->watermark_image)) {
+                if (!ply_image_wait_for_load (plugin->watermark_image)) {
                         ply_image_free (plugin->watermark_image);
                         plugin->watermark_image = NULL;
                 }
@@ -0,0 +1,426 @@
+/* ply-boot-protocol-test.c - checks the boot server against the protocol
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Runs a boot server in-process, sends it requests over its socket, and
+ * compares what comes back with what ply-boot-protocol.h says should.
+ * Batches also get sent through ply-boot-client, both to the real server
+ * and to a stand-in for a daemon that only speaks version 1.  The socket
+ * is the daemon's, so the checks are skipped if a plymouthd is already
+ * running.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ply-boot-client.h"
+#include "ply-boot-protocol.h"
+#include "ply-boot-server.h"
+#include "ply-buffer.h"
+#include "ply-event-loop.h"
+#include "ply-utils.h"
+
+/* What automake's test driver takes to mean the test didn't run */
+#define EXIT_SKIPPED 77
+
+typedef struct
+{
+        ply_event_loop_t  *loop;
+        ply_boot_server_t *server;
+        char               log[256];
+        uint32_t           batch_is_done : 1;
+
+        /* The version 1 stand-in */
+        int                old_daemon_socket_fd;
+        int                old_daemon_connection_fd;
+        ply_fd_watch_t    *old_daemon_socket_watch;
+        ply_fd_watch_t    *old_daemon_connection_watch;
+        ply_buffer_t      *old_daemon_buffer;
+        char               old_daemon_log[256];
+} test_state_t;
+
+static test_state_t state;
+
+static bool
+report (const char *name,
+        bool        passed)
+{
+        printf ("%s: %s\n", passed ? "PASS" : "FAIL", name);
+        fflush (stdout);
+
+        return passed;
+}
+
+static void
+log_string (char       *log,
+            size_t      size,
+            const char *string)
+{
+        strncat (log, string, size - strlen (log) - 1);
+}
+
+static void
+on_request_done (const char        *name,
+                 ply_boot_client_t *client)
+{
+        log_string (state.log, sizeof(state.log), name);
+        log_string (state.log, sizeof(state.log), "+ ");
+}
+
+static void
+on_request_failed (const char        *name,
+                   ply_boot_client_t *client)
+{
+        log_string (state.log, sizeof(state.log), name);
+        log_string (state.log, sizeof(state.log), "- ");
+}
+
+static void
+on_batch_done (void              *user_data,
+               ply_boot_client_t *client)
+{
+        log_string (state.log, sizeof(state.log), "batch+");
+        state.batch_is_done = true;
+}
+
+static void
+on_batch_failed (void              *user_data,
+                 ply_boot_client_t *client)
+{
+        log_string (state.log, sizeof(state.log), "batch-");
+        state.batch_is_done = true;
+}
+
+static void
+on_update (void              *user_data,
+           const char        *status,
+           ply_boot_server_t *server)
+{
+        log_string (state.log, sizeof(state.log), "[");
+        log_string (state.log, sizeof(state.log), status);
+        log_string (state.log, sizeof(state.log), "] ");
+}
+
+static bool
+on_has_active_vt (void              *user_data,
+                  ply_boot_server_t *server)
+{
+        return false;
+}
+
+/* Queues an update, an active VT check, which gets NAKed, and a ping
+ * as one batch, and runs the loop until the batch is replied to
+ */
+static void
+send_batch (ply_boot_client_t *client)
+{
+        state.log[0] = '\0';
+        state.batch_is_done = false;
+
+        ply_boot_client_begin_batch (client);
+        ply_boot_client_update_daemon (client, "status",
+                                       (ply_boot_client_response_handler_t)
+                                       on_request_done,
+                                       (ply_boot_client_response_handler_t)
+                                       on_request_failed,
+                                       "update");
+        ply_boot_client_ask_daemon_has_active_vt (client,
+                                                  (ply_boot_client_response_handler_t)
+                                                  on_request_done,
+                                                  (ply_boot_client_response_handler_t)
+                                                  on_request_failed,
+                                                  "vt");
+        ply_boot_client_ping_daemon (client,
+                                     (ply_boot_client_response_handler_t)
+                                     on_request_done,
+                                     (ply_boot_client_response_handler_t)
+                                     on_request_failed,
+                                     "ping");
+        ply_boot_client_end_batch (client, on_batch_done, on_batch_failed, NULL);
+
+        while (!state.batch_is_done)
+                ply_event_loop_process_pending_events (state.loop);
+}
+
+/* Version 1 requests are a command byte and then either a NUL, or \002,
+ * a size byte and the argument.  The stand-in NAKs protocol version and
+ * active VT requests, and ACKs everything else.
+ */
+static void
+on_old_daemon_request (void *user_data,
+                       int   fd)
+{
+        char bytes[256];
+        ssize_t bytes_read;
+
+        bytes_read = recv (fd, bytes, sizeof(bytes), MSG_DONTWAIT);
+
+        if (bytes_read <= 0)
+                return;
+
+        ply_buffer_append_bytes (state.old_daemon_buffer, bytes, bytes_read);
+
+        while (ply_buffer_get_size (state.old_daemon_buffer) >= 2) {
+                const uint8_t *request;
+                size_t request_size;
+                char command[2] = "";
+
+                request = (const uint8_t *) ply_buffer_get_bytes (state.old_daemon_buffer);
+                request_size = 2;
+
+                if (request[1] == '\002') {
+                        if (ply_buffer_get_size (state.old_daemon_buffer) < 3)
+                                break;
+
+                        request_size = 3 + request[2];
+                }
+
+                if (ply_buffer_get_size (state.old_daemon_buffer) < request_size)
+                        break;
+
+                command[0] = request[0];
+                log_string (state.old_daemon_log, sizeof(state.old_daemon_log), command);
+
+                if (command[0] == PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROTOCOL_VERSION[0] ||
+                    command[0] == PLY_BOOT_PROTOCOL_REQUEST_TYPE_HAS_ACTIVE_VT[0])
+                        ply_write (fd, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK, 1);
+                else
+                        ply_write (fd, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK, 1);
+
+                ply_buffer_remove_bytes (state.old_daemon_buffer, request_size);
+        }
+}
+
+static void
+on_old_daemon_connection (void *user_data,
+                          int   fd)
+{
+        state.old_daemon_connection_fd = accept (fd, NULL, NULL);
+
+        if (state.old_daemon_connection_fd < 0)
+                return;
+
+        state.old_daemon_connection_watch =
+                ply_event_loop_watch_fd (state.loop, state.old_daemon_connection_fd,
+                                         PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                         on_old_daemon_request, NULL, NULL);
+}
+
+/* A daemon that NAKs the protocol version request gets the batch as
+ * plain version 1 requests, and each one still gets its own reply
+ */
+static bool
+test_batch_to_old_daemon (ply_boot_client_t *client)
+{
+        bool passed;
+
+        state.old_daemon_buffer = ply_buffer_new ();
+        state.old_daemon_socket_watch =
+                ply_event_loop_watch_fd (state.loop, state.old_daemon_socket_fd,
+                                         PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                         on_old_daemon_connection, NULL, NULL);
+
+        if (!ply_boot_client_connect (client, NULL, NULL)) {
+                perror ("could not connect to version 1 stand-in");
+                return report ("batch to version 1 daemon", false);
+        }
+        ply_boot_client_attach_to_event_loop (client, state.loop);
+
+        send_batch (client);
+
+        passed = strcmp (state.log, "update+ vt- ping+ batch-") == 0 &&
+                 strcmp (state.old_daemon_log, "pUVP") == 0;
+
+        if (!passed)
+                printf ("client saw \"%s\", stand-in saw \"%s\"\n",
+                        state.log, state.old_daemon_log);
+
+        if (state.old_daemon_connection_watch != NULL) {
+                ply_event_loop_stop_watching_fd (state.loop, state.old_daemon_connection_watch);
+                close (state.old_daemon_connection_fd);
+        }
+        ply_event_loop_stop_watching_fd (state.loop, state.old_daemon_socket_watch);
+        close (state.old_daemon_socket_fd);
+        ply_buffer_free (state.old_daemon_buffer);
+
+        return report ("batch to version 1 daemon", passed);
+}
+
+/* The real server replies to the batch as a whole, and the client hands
+ * each request its own status.  Everything gets NAKed unless the check
+ * runs as root.
+ */
+static bool
+test_batch_to_server (ply_boot_client_t *client)
+{
+        const char *expected_log;
+        bool passed;
+
+        if (!ply_boot_client_connect (client, NULL, NULL)) {
+                perror ("could not connect to boot server");
+                return report ("batch to boot server", false);
+        }
+        ply_boot_client_attach_to_event_loop (client, state.loop);
+
+        send_batch (client);
+
+        if (getuid () == 0)
+                expected_log = "[status] update+ vt- ping+ batch-";
+        else
+                expected_log = "update- vt- ping- batch-";
+
+        passed = strcmp (state.log, expected_log) == 0;
+
+        if (!passed)
+                printf ("expected \"%s\", got \"%s\"\n", expected_log, state.log);
+
+        return report ("batch to boot server", passed);
+}
+
+/* Runs the loop until size bytes have come back on fd, or the daemon
+ * hangs up.  Returns how many bytes were read.
+ */
+static size_t
+read_reply (int     fd,
+            uint8_t *reply,
+            size_t  size)
+{
+        size_t bytes_read;
+
+        bytes_read = 0;
+        while (bytes_read < size) {
+                ssize_t result;
+
+                result = recv (fd, reply + bytes_read, size - bytes_read, MSG_DONTWAIT);
+
+                if (result == 0)
+                        break;
+
+                if (result > 0) {
+                        bytes_read += result;
+                        continue;
+                }
+
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                        break;
+
+                ply_event_loop_process_pending_events (state.loop);
+        }
+
+        return bytes_read;
+}
+
+/* An empty batch gets an ACK and a count of zero, and the daemon goes
+ * on answering requests after it
+ */
+static bool
+test_empty_batch (void)
+{
+        static const uint8_t request[] = { 'B', 0, 0, 0, 0, 'P', '\0' };
+        uint8_t reply[6];
+        int fd;
+        bool passed;
+
+        fd = ply_connect_to_unix_socket (PLY_BOOT_PROTOCOL_TRIMMED_ABSTRACT_SOCKET_PATH,
+                                         PLY_UNIX_SOCKET_TYPE_TRIMMED_ABSTRACT);
+
+        if (fd < 0) {
+                perror ("could not connect to boot server");
+                return report ("empty batch", false);
+        }
+
+        passed = ply_write (fd, request, sizeof(request)) &&
+                 read_reply (fd, reply, sizeof(reply)) == sizeof(reply) &&
+                 memcmp (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK "\0\0\0\0", 5) == 0;
+
+        /* The ping is only there to show the daemon is still alive, and
+         * gets a NAK if the check isn't running as root
+         */
+        if (passed)
+                passed = reply[5] == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK[0] ||
+                         reply[5] == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK[0];
+
+        close (fd);
+
+        return report ("empty batch", passed);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+        ply_boot_client_t *old_daemon_client, *client;
+        int number_of_failures;
+
+        /* A daemon that stops answering shouldn't hang the check */
+        alarm (10);
+
+        state.loop = ply_event_loop_new ();
+
+        /* The stand-in goes first, since the server never lets go of the
+         * socket
+         */
+        state.old_daemon_socket_fd =
+                ply_listen_to_unix_socket (PLY_BOOT_PROTOCOL_TRIMMED_ABSTRACT_SOCKET_PATH,
+                                           PLY_UNIX_SOCKET_TYPE_TRIMMED_ABSTRACT);
+
+        if (state.old_daemon_socket_fd < 0) {
+                printf ("SKIP: could not listen on the boot server socket, "
+                        "is plymouthd running?\n");
+                return EXIT_SKIPPED;
+        }
+
+        number_of_failures = 0;
+
+        old_daemon_client = ply_boot_client_new ();
+        if (!test_batch_to_old_daemon (old_daemon_client))
+                number_of_failures++;
+
+        state.server = ply_boot_server_new (on_update, NULL, NULL, NULL, NULL, NULL, NULL,
+                                            NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                                            NULL, NULL, NULL, NULL, NULL, on_has_active_vt, NULL,
+                                            &state);
+
+        if (!ply_boot_server_listen (state.server)) {
+                perror ("could not listen on the boot server socket");
+                return 1;
+        }
+
+        ply_boot_server_attach_to_event_loop (state.server, state.loop);
+
+        client = ply_boot_client_new ();
+        if (!test_batch_to_server (client))
+                number_of_failures++;
+
+        if (!test_empty_batch ())
+                number_of_failures++;
+
+        ply_boot_client_free (old_daemon_client);
+        ply_boot_client_free (client);
+        ply_boot_server_free (state.server);
+
+        return number_of_failures > 0 ? 1 : 0;
+}
+/* vim: set ts=4 sw=4 expandtab autoindent cindent cino={.5s,(0: */
@@ -45,8 +45,35 @@
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_HIDE_SPLASH "H"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_NEWROOT "R"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_HAS_ACTIVE_VT "V"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_STATISTICS "T"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_ERROR "!"
 
+/* Version 1 requests are a command byte, followed by either a NUL, or
+ * \002, a size byte and that many bytes of NUL terminated argument.
+ *
+ * Clients find out whether the daemon knows anything newer by sending
+ * a PROTOCOL_VERSION request, which is answered with the version
+ * number as a string.  Daemons that only speak version 1 NAK it.
+ *
+ * Version 2 adds batches: a BATCH command byte, a 32-bit count, then
+ * for each command its command byte, a 32-bit argument size (0 for no
+ * argument) and the NUL terminated argument.  All 32-bit numbers are
+ * little endian.  The reply is a single ACK if every command succeeded
+ * or NAK if any failed, then the 32-bit count and an ACK or NAK per
+ * command.  Commands that get anything but an ACK or NAK back can't be
+ * batched.
+ *
+ * Version 2 also adds STREAM, which gets an ACK like any other request,
+ * but after which the daemon doesn't reply to anything on the
+ * connection.  Requests that can't be batched are dropped once a
+ * connection is streaming.
+ */
+#define PLY_BOOT_PROTOCOL_VERSION 2
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROTOCOL_VERSION "p"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_BATCH "B"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_STREAM "s"
+#define PLY_BOOT_PROTOCOL_UNBATCHABLE_REQUEST_TYPES "*cWKTDQpBs"
+
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK "\x6"
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK "\x15"
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER "\x2"
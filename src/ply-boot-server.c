@@ -27,6 +27,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -39,6 +40,15 @@
 #include "ply-trigger.h"
 #include "ply-utils.h"
 
+#ifndef PLY_BOOT_CONNECTION_READ_SIZE
+#define PLY_BOOT_CONNECTION_READ_SIZE 4096
+#endif
+
+/* Batches can have big arguments, but not unboundedly big ones */
+#ifndef PLY_BOOT_CONNECTION_MAX_BATCH_SIZE
+#define PLY_BOOT_CONNECTION_MAX_BATCH_SIZE (1024 * 1024)
+#endif
+
 typedef struct
 {
         int                fd;
@@ -47,7 +57,21 @@ typedef struct
         uid_t              uid;
         pid_t              pid;
 
+        /* Who's on the other end, for tracing */
+        char              *process_identity;
+
+        /* Bytes read from the client that don't make up a whole
+         * request yet
+         */
+        ply_buffer_t      *buffer;
+
+        /* While a batch is being handled, replies are collected here
+         * instead of being sent
+         */
+        ply_buffer_t      *batch_statuses;
+
         uint32_t           credentials_read : 1;
+        uint32_t           is_streaming : 1;
 } ply_boot_connection_t;
 
 struct _ply_boot_server
@@ -77,6 +101,7 @@ struct _ply_boot_server
         ply_boot_server_reactivate_handler_t          reactivate_handler;
         ply_boot_server_quit_handler_t                quit_handler;
         ply_boot_server_has_active_vt_handler_t       has_active_vt_handler;
+        ply_boot_server_get_statistics_handler_t      get_statistics_handler;
         void                                         *user_data;
 
         uint32_t                                      is_listening : 1;
@@ -103,6 +128,7 @@ ply_boot_server_new (ply_boot_server_update_handler_t              update_handle
                      ply_boot_server_reactivate_handler_t          reactivate_handler,
                      ply_boot_server_quit_handler_t                quit_handler,
                      ply_boot_server_has_active_vt_handler_t       has_active_vt_handler,
+                     ply_boot_server_get_statistics_handler_t      get_statistics_handler,
                      void                                         *user_data)
 {
         ply_boot_server_t *server;
@@ -132,6 +158,7 @@ ply_boot_server_new (ply_boot_server_update_handler_t              update_handle
         server->reactivate_handler = reactivate_handler;
         server->quit_handler = quit_handler;
         server->has_active_vt_handler = has_active_vt_handler;
+        server->get_statistics_handler = get_statistics_handler;
         server->user_data = user_data;
 
         return server;
@@ -161,10 +188,11 @@ ply_boot_connection_new (ply_boot_server_t *server,
 {
         ply_boot_connection_t *connection;
 
-        connection = calloc (1, sizeof(ply_boot_server_t));
+        connection = calloc (1, sizeof(ply_boot_connection_t));
         connection->fd = fd;
         connection->server = server;
         connection->watch = NULL;
+        connection->buffer = ply_buffer_new ();
 
         return connection;
 }
@@ -176,6 +204,8 @@ ply_boot_connection_free (ply_boot_connection_t *connection)
                 return;
 
         close (connection->fd);
+        ply_buffer_free (connection->buffer);
+        free (connection->process_identity);
         free (connection);
 }
 
@@ -200,49 +230,79 @@ ply_boot_server_stop_listening (ply_boot_server_t *server)
         assert (server != NULL);
 }
 
+/* Reads whatever the client has sent so far without waiting for more.
+ * Only one read happens per wakeup, so a client that never stops
+ * sending can't keep the event loop from getting to anything else.
+ */
 static bool
-ply_boot_connection_read_request (ply_boot_connection_t *connection,
-                                  char                 **command,
-                                  char                 **argument)
+ply_boot_connection_read_available_data (ply_boot_connection_t *connection)
 {
-        uint8_t header[2];
+        char bytes[PLY_BOOT_CONNECTION_READ_SIZE];
+        ssize_t bytes_read;
 
-        assert (connection != NULL);
-        assert (connection->fd >= 0);
+        do {
+                bytes_read = recv (connection->fd, bytes, sizeof(bytes), MSG_DONTWAIT);
+        } while (bytes_read < 0 && errno == EINTR);
 
-        connection->credentials_read = false;
+        if (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                ply_trace ("could not read connection request: %m");
 
-        if (!ply_read (connection->fd, header, sizeof(header)))
+        if (bytes_read <= 0)
                 return false;
 
-        *command = calloc (2, sizeof(char));
-        *command[0] = header[0];
+        ply_buffer_append_bytes (connection->buffer, bytes, bytes_read);
 
-        *argument = NULL;
-        if (header[1] == '\002') {
-                uint8_t argument_size;
+        return true;
+}
+
+/* Takes the first request off the connection's buffer, if all of it
+ * has arrived.  A request is a command byte, then either a NUL, or
+ * \002 followed by a size byte and that many bytes of argument.
+ */
+static bool
+ply_boot_connection_parse_request (ply_boot_connection_t *connection,
+                                   char                 **command,
+                                   char                 **argument)
+{
+        const uint8_t *bytes;
+        size_t size, request_size;
+        bool has_argument;
+        uint8_t argument_size;
+
+        bytes = (const uint8_t *) ply_buffer_get_bytes (connection->buffer);
+        size = ply_buffer_get_size (connection->buffer);
+
+        if (size < 2)
+                return false;
+
+        has_argument = bytes[1] == '\002';
+        argument_size = 0;
+        request_size = 2;
 
-                if (!ply_read (connection->fd, &argument_size, sizeof(uint8_t))) {
-                        free (*command);
+        if (has_argument) {
+                if (size < 3)
                         return false;
-                }
 
-                *argument = calloc (argument_size, sizeof(char));
+                argument_size = bytes[2];
+                request_size = 3 + argument_size;
 
-                if (!ply_read (connection->fd, *argument, argument_size)) {
-                        free (*argument);
-                        free (*command);
+                if (size < request_size)
                         return false;
-                }
         }
 
-        if (!ply_get_credentials_from_fd (connection->fd, &connection->pid, &connection->uid, NULL)) {
-                ply_trace ("couldn't read credentials from connection: %m");
-                free (*argument);
-                free (*command);
-                return false;
+        *command = calloc (2, sizeof(char));
+        (*command)[0] = bytes[0];
+
+        *argument = NULL;
+        if (has_argument) {
+                /* The argument is supposed to include its NUL terminator,
+                 * but don't count on it
+                 */
+                *argument = calloc (argument_size + 1, sizeof(char));
+                memcpy (*argument, bytes + 3, argument_size);
         }
-        connection->credentials_read = true;
+
+        ply_buffer_remove_bytes (connection->buffer, request_size);
 
         return true;
 }
@@ -286,6 +346,23 @@ ply_boot_connection_send_answer (ply_boot_connection_t *connection,
         }
 }
 
+static void
+ply_boot_connection_send_status (ply_boot_connection_t *connection,
+                                 const char            *status,
+                                 const char            *description)
+{
+        if (connection->batch_statuses != NULL) {
+                ply_buffer_append_bytes (connection->batch_statuses, status, strlen (status));
+                return;
+        }
+
+        if (connection->is_streaming)
+                return;
+
+        if (!ply_write (connection->fd, status, strlen (status)) && errno != EPIPE)
+                ply_trace ("could not finish writing %s: %m", description);
+}
+
 static void
 ply_boot_connection_on_password_answer (ply_boot_connection_t *connection,
                                         const char            *password)
@@ -340,38 +417,50 @@ print_connection_process_identity (ply_boot_connection_t *connection)
         char *command_line, *parent_command_line;
         pid_t parent_pid;
 
+        /* The peer can't change, so only go through /proc once */
+        if (connection->process_identity != NULL) {
+                ply_trace ("%s", connection->process_identity);
+                return;
+        }
+
         command_line = ply_get_process_command_line (connection->pid);
 
         if (connection->pid == 1) {
-                ply_trace ("connection is from toplevel init process (%s)", command_line);
+                asprintf (&connection->process_identity,
+                          "connection is from toplevel init process (%s)", command_line);
         } else {
                 parent_pid = ply_get_process_parent_pid (connection->pid); parent_command_line = ply_get_process_command_line (parent_pid);
 
-                ply_trace ("connection is from pid %ld (%s) with parent pid %ld (%s)",
-                           (long) connection->pid, command_line,
-                           (long) parent_pid, parent_command_line);
+                asprintf (&connection->process_identity,
+                          "connection is from pid %ld (%s) with parent pid %ld (%s)",
+                          (long) connection->pid, command_line,
+                          (long) parent_pid, parent_command_line);
 
                 free (parent_command_line);
         }
 
         free (command_line);
+
+        ply_trace ("%s", connection->process_identity);
 }
 
 static void
-ply_boot_connection_on_request (ply_boot_connection_t *connection)
+ply_boot_connection_handle_request (ply_boot_connection_t *connection,
+                                    char                  *command,
+                                    char                  *argument)
 {
         ply_boot_server_t *server;
-        char *command, *argument;
-
-        assert (connection != NULL);
-        assert (connection->fd >= 0);
 
         server = connection->server;
         assert (server != NULL);
 
-        if (!ply_boot_connection_read_request (connection,
-                                               &command, &argument)) {
-                ply_trace ("could not read connection request");
+        if (!connection->credentials_read) {
+                ply_trace ("no credentials for connection");
+                ply_boot_connection_send_status (connection,
+                                                 PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                 "credentials nak");
+                free (argument);
+                free (command);
                 return;
         }
 
@@ -381,21 +470,18 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
         if (!ply_boot_connection_is_from_root (connection)) {
                 ply_error ("request came from non-root user");
 
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
-                        ply_trace ("could not finish writing is-not-root nak: %m");
+                ply_boot_connection_send_status (connection,
+                                                 PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                 "is-not-root nak");
 
                 free (command);
                 return;
         }
 
         if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE) == 0) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)) &&
-                    errno != EPIPE)
-                        ply_trace ("could not finish writing update reply: %m");
+                ply_boot_connection_send_status (connection,
+                                                 PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                 "update reply");
 
                 ply_trace ("got update request");
                 if (server->update_handler != NULL)
@@ -404,10 +490,9 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 free (command);
                 return;
         } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_CHANGE_MODE) == 0) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                        ply_trace ("could not finish writing update reply: %m");
+                ply_boot_connection_send_status (connection,
+                                                 PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                 "update reply");
 
                 ply_trace ("got change mode notification");
                 if (server->change_mode_handler != NULL)
@@ -426,10 +511,9 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 }
 
                 ply_trace ("got system-update notification %li%%", value);
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                        ply_trace ("could not finish writing update reply: %m");
+                ply_boot_connection_send_status (connection,
+                                                 PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                 "update reply");
 
                 if (server->system_update_handler != NULL)
                         server->system_update_handler (server->user_data, value, server);
@@ -654,33 +738,280 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                         answer = server->has_active_vt_handler (server->user_data, server);
 
                 if (!answer) {
-                        if (!ply_write (connection->fd,
-                                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
-                                ply_trace ("could not finish writing nak: %m");
+                        ply_boot_connection_send_status (connection,
+                                                         PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                         "nak");
 
                         free (command);
                         return;
                 }
+        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STATISTICS) == 0) {
+                char *statistics = NULL;
+
+                ply_trace ("got statistics request");
+                if (server->get_statistics_handler != NULL)
+                        statistics = server->get_statistics_handler (server->user_data, server);
+
+                ply_boot_connection_send_answer (connection, statistics);
+
+                free (statistics);
+                free (command);
+                return;
+        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROTOCOL_VERSION) == 0) {
+                char *version = NULL;
+
+                ply_trace ("got protocol version request");
+
+                asprintf (&version, "%d", PLY_BOOT_PROTOCOL_VERSION);
+                ply_boot_connection_send_answer (connection, version);
+
+                free (version);
+                free (argument);
+                free (command);
+                return;
+        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STREAM) == 0) {
+                ply_trace ("connection is streaming requests from now on");
+
+                ply_boot_connection_send_status (connection,
+                                                 PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                 "stream reply");
+                connection->is_streaming = true;
+
+                free (argument);
+                free (command);
+                return;
         } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PING) != 0) {
                 ply_error ("received unknown command '%s' from client", command);
 
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
-                        ply_trace ("could not finish writing ping reply: %m");
+                ply_boot_connection_send_status (connection,
+                                                 PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                 "ping reply");
 
                 free (command);
                 return;
         }
 
-        if (!ply_write (connection->fd,
-                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                ply_trace ("could not finish writing ack: %m");
+        ply_boot_connection_send_status (connection,
+                                         PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                         "ack");
         free (command);
 }
 
+static uint32_t
+get_uint32 (const uint8_t *bytes)
+{
+        return (uint32_t) bytes[0] |
+               ((uint32_t) bytes[1] << 8) |
+               ((uint32_t) bytes[2] << 16) |
+               ((uint32_t) bytes[3] << 24);
+}
+
+static void
+append_uint32 (ply_buffer_t *buffer,
+               uint32_t      value)
+{
+        uint8_t bytes[4];
+
+        bytes[0] = (value >> 0) & 0xFF;
+        bytes[1] = (value >> 8) & 0xFF;
+        bytes[2] = (value >> 16) & 0xFF;
+        bytes[3] = (value >> 24) & 0xFF;
+
+        ply_buffer_append_bytes (buffer, bytes, sizeof(bytes));
+}
+
+/* Works out how big the batch at the start of the connection's buffer
+ * is.  Returns 0 if it hasn't all arrived yet, and -1 if it's too big
+ * to ever be handled.
+ */
+static ssize_t
+ply_boot_connection_get_batch_size (ply_boot_connection_t *connection)
+{
+        const uint8_t *bytes;
+        size_t size, batch_size;
+        uint32_t number_of_commands, i;
+
+        bytes = (const uint8_t *) ply_buffer_get_bytes (connection->buffer);
+        size = ply_buffer_get_size (connection->buffer);
+
+        if (size < 5)
+                return 0;
+
+        number_of_commands = get_uint32 (bytes + 1);
+
+        batch_size = 5;
+        for (i = 0; i < number_of_commands; i++) {
+                uint32_t argument_size;
+
+                if (batch_size + 5 > PLY_BOOT_CONNECTION_MAX_BATCH_SIZE)
+                        return -1;
+
+                if (size < batch_size + 5)
+                        return 0;
+
+                argument_size = get_uint32 (bytes + batch_size + 1);
+
+                if (argument_size > PLY_BOOT_CONNECTION_MAX_BATCH_SIZE - batch_size - 5)
+                        return -1;
+
+                batch_size += 5 + argument_size;
+        }
+
+        if (size < batch_size)
+                return 0;
+
+        return batch_size;
+}
+
+static void
+ply_boot_connection_handle_batch (ply_boot_connection_t *connection,
+                                  size_t                 batch_size)
+{
+        ply_buffer_t *reply;
+        uint8_t *batch;
+        const char *aggregate_status;
+        size_t offset;
+        uint32_t number_of_commands, i;
+
+        /* Handlers don't touch the connection's buffer, but take the
+         * batch off of it before running them anyway
+         */
+        batch = malloc (batch_size);
+        memcpy (batch, ply_buffer_get_bytes (connection->buffer), batch_size);
+        ply_buffer_remove_bytes (connection->buffer, batch_size);
+
+        number_of_commands = get_uint32 (batch + 1);
+
+        ply_trace ("got batch of %u requests", number_of_commands);
+
+        connection->batch_statuses = ply_buffer_new ();
+
+        offset = 5;
+        for (i = 0; i < number_of_commands; i++) {
+                char *command, *argument;
+                uint32_t argument_size;
+
+                command = calloc (2, sizeof(char));
+                command[0] = batch[offset];
+                argument_size = get_uint32 (batch + offset + 1);
+                offset += 5;
+
+                argument = NULL;
+                if (argument_size > 0) {
+                        argument = calloc (argument_size + 1, sizeof(char));
+                        memcpy (argument, batch + offset, argument_size);
+                        offset += argument_size;
+                }
+
+                if (command[0] == '\0' ||
+                    strchr (PLY_BOOT_PROTOCOL_UNBATCHABLE_REQUEST_TYPES, command[0]) != NULL) {
+                        ply_error ("received command '%s' that can't be batched from client", command);
+                        ply_boot_connection_send_status (connection,
+                                                         PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                         "batch nak");
+                        free (argument);
+                        free (command);
+                        continue;
+                }
+
+                ply_boot_connection_handle_request (connection, command, argument);
+        }
+        free (batch);
+
+        assert (ply_buffer_get_size (connection->batch_statuses) == number_of_commands);
+
+        aggregate_status = PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+        if (memchr (ply_buffer_get_bytes (connection->batch_statuses),
+                    PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK[0],
+                    number_of_commands) != NULL)
+                aggregate_status = PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK;
+
+        reply = ply_buffer_new ();
+        ply_buffer_append_bytes (reply, aggregate_status, strlen (aggregate_status));
+        append_uint32 (reply, number_of_commands);
+
+        /* An empty batch is just acked, with no statuses after the count */
+        if (number_of_commands > 0)
+                ply_buffer_append_bytes (reply,
+                                         ply_buffer_get_bytes (connection->batch_statuses),
+                                         number_of_commands);
+
+        ply_buffer_free (connection->batch_statuses);
+        connection->batch_statuses = NULL;
+
+        if (connection->is_streaming) {
+                ply_buffer_free (reply);
+                return;
+        }
+
+        if (!ply_write (connection->fd, ply_buffer_get_bytes (reply), ply_buffer_get_size (reply)) &&
+            errno != EPIPE)
+                ply_trace ("could not finish writing batch reply: %m");
+
+        ply_buffer_free (reply);
+}
+
+static void
+ply_boot_connection_on_request (ply_boot_connection_t *connection)
+{
+        char *command, *argument;
+
+        assert (connection != NULL);
+        assert (connection->fd >= 0);
+
+        if (!ply_boot_connection_read_available_data (connection))
+                return;
+
+        while (ply_buffer_get_size (connection->buffer) > 0) {
+                const char *bytes;
+
+                bytes = ply_buffer_get_bytes (connection->buffer);
+
+                if (bytes[0] == PLY_BOOT_PROTOCOL_REQUEST_TYPE_BATCH[0]) {
+                        ssize_t batch_size;
+
+                        batch_size = ply_boot_connection_get_batch_size (connection);
+
+                        if (batch_size == 0)
+                                break;
+
+                        /* The rest of the batch is still on its way, and there's no
+                         * telling where it ends, so give up on the connection rather
+                         * than read its arguments as requests.  The hangup handler
+                         * cleans up after it.
+                         */
+                        if (batch_size < 0) {
+                                ply_error ("received batch that is too big from client, closing connection");
+                                ply_buffer_clear (connection->buffer);
+                                ply_boot_connection_send_status (connection,
+                                                                 PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
+                                                                 "batch nak");
+                                shutdown (connection->fd, SHUT_RDWR);
+                                break;
+                        }
+
+                        ply_boot_connection_handle_batch (connection, batch_size);
+                        continue;
+                }
+
+                if (!ply_boot_connection_parse_request (connection, &command, &argument))
+                        break;
+
+                /* Nothing can be sent back, so nothing that needs an answer
+                 * can be asked
+                 */
+                if (connection->is_streaming &&
+                    strchr (PLY_BOOT_PROTOCOL_UNBATCHABLE_REQUEST_TYPES, command[0]) != NULL) {
+                        ply_error ("received command '%s' that needs a reply on a streaming connection", command);
+                        free (argument);
+                        free (command);
+                        continue;
+                }
+
+                ply_boot_connection_handle_request (connection, command, argument);
+        }
+}
+
 static void
 ply_boot_connection_on_hangup (ply_boot_connection_t *connection)
 {
@@ -715,6 +1046,14 @@ ply_boot_server_on_new_connection (ply_boot_server_t *server)
 
         connection = ply_boot_connection_new (server, fd);
 
+        /* The credentials are the ones from when the client connected, so
+         * they don't need looking up again for every request
+         */
+        if (ply_get_credentials_from_fd (fd, &connection->pid, &connection->uid, NULL))
+                connection->credentials_read = true;
+        else
+                ply_trace ("couldn't read credentials from connection: %m");
+
         connection->watch =
                 ply_event_loop_watch_fd (server->loop, fd,
                                          PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,